@@ -0,0 +1,381 @@
+/*
+  Bootstrap confidence intervals for the A/E (actual over expected) ratios of an experience study, by age band
+
+  run as
+	tail +2 stdin.txt | ../exposure/exposure --start=2000-01-01 --end=2008-12-31 --type=3
+	./boot --table=qx.csv --band=5 --replicates=10000 --threads=4 --seed=1 < exposures.csv
+
+  where ~qx.csv~ holds the decrement table of the expected basis, one ~age;q~ pair per line, e.g.
+	printf 'age;q\n40;0.00120\n41;0.00131\n42;0.00143\n' > qx.csv
+  Without --table, the intervals are given for the crude rates (actual over exposure).
+  Partitioned exposures (--partition-by) are read as well, concatenating the part-K.csv files of every partition.
+
+  stdin holds the lines of ~exposures.csv~ (id;age_at_issue;policy_year;attained_age;actual;exposure), which are
+  aggregated into a cube of cells (attained age x policy year). Each replicate resamples the cube:
+
+	--unit=policy-year  (default) Poisson bootstrap: every policy year of the study gets a weight w ~ Poisson(1).
+						The sums of the cells are then drawn from their sufficient statistics, without going
+						through the policies again: the claims of a cell sum to Poisson(A) (claim years carry a
+						full year of exposure), the other exposures to Normal( E, sqrt( sum of E^2 ) ).
+						A replicate costs one pass over the cells, whatever the amount of policies.
+	--unit=cell         the cells of each age band are resampled with replacement.
+
+  Every replicate r seeds the generator of the thread running it with seed + r, so the results are the same
+  whatever the amount of threads.
+*/
+
+#include <stdio.h>       // stdin, stdout, stderr, fprintf, FILE, ...
+#include <stdlib.h>      // malloc, calloc, qsort, strtol, strtod ...
+#include <string.h>      // strchr, strcmp
+#include <stdbool.h>     // bool (data type)
+#include <math.h>        // sqrt, floor, NAN
+#include <getopt.h>      // command line arguments: getopt_long()
+#include <pthread.h>     // worker threads
+#include <gsl/gsl_rng.h>      // one generator per thread
+#include <gsl/gsl_randist.h>  // gsl_ran_poisson, gsl_ran_gaussian
+
+// cube of cells: attained ages 0 .. MAX_AGE-1 and policy years 1 .. MAX_YEAR-1
+#define MAX_AGE  150
+#define MAX_YEAR 150
+
+// sufficient statistics of a cell (attained age x policy year)
+typedef struct cell_str
+{
+  int age;             // attained age
+  int band;            // age band of the attained age
+  long n;              // policy years (lines of exposures.csv) in the cell
+  double A;            // actual: claims in the cell
+  double E;            // exposure of the policy years without claim
+  double E2;           // sum of squared exposures of the policy years without claim
+} cell_str;
+
+// bootstrap options
+typedef enum boot_unit { UNIT_POLICY_YEAR, UNIT_CELL } boot_unit;
+
+typedef struct boot_str
+{
+  cell_str *cell;      // non-empty cells, sorted by age band
+  int n_cell;
+  int *band_first;     // first cell of each age band (n_band + 1 entries, the last one is n_cell)
+  int n_band;          // amount of age bands (the results have one more row, all bands together)
+  int band_width;      // width of the age bands in years
+  double *q;           // decrement table by attained age (NULL for crude rates)
+  boot_unit unit;
+  long replicates;
+  unsigned long seed;
+  double *ratio;       // A/E of each replicate (rows) and band (columns, n_band + 1 of them)
+  long next;           // next replicate to be run (shared by the threads)
+} boot_str;
+
+void read_table(
+				char *fname         // decrement table, one age;q pair per line
+				,double *q          // array of MAX_AGE decrement rates, filled from the table
+				);
+void read_exposures(
+					FILE *f             // lines of exposures.csv
+					,cell_str *cube     // MAX_AGE x MAX_YEAR cells, accumulated
+					);
+void *run_replicates(
+					 void *arg           // pointer to the shared ~boot_str~
+					 );
+int compare_doubles( const void *a, const void *b );
+
+
+// --------------------------------------------------------------------------------------------------------------------------
+// main
+int main(int argc, char **argv){
+
+  boot_str boot = { .band_width = 5, .unit = UNIT_POLICY_YEAR, .replicates = 1000, .seed = 1 };
+  int n_threads = 1;
+  double level = 0.95;
+  char *table = NULL;
+  bool ok = true;
+
+  // Step 1: Read the command line arguments
+  int c;
+  while (1)
+	{
+	  int option_index = 0;
+	  static struct option long_options[] =
+		{
+		  {"table",      required_argument, NULL, 'q' },
+		  {"band",       required_argument, NULL, 'b' },
+		  {"unit",       required_argument, NULL, 'u' },
+		  {"replicates", required_argument, NULL, 'r' },
+		  {"level",      required_argument, NULL, 'l' },
+		  {"threads",    required_argument, NULL, 'j' },
+		  {"seed",       required_argument, NULL, 's' },
+		  {NULL,         0,                 NULL,  0 }
+		};
+
+	  c = getopt_long(argc, argv, ":q:b:u:r:l:j:s:", long_options, &option_index);
+	  if (c == -1)
+		break;
+
+	  switch (c)
+		{
+		case 'q': table = optarg; break;
+		case 'b': boot.band_width = atoi(optarg); break;
+		case 'r': boot.replicates = atol(optarg); break;
+		case 'l': level = atof(optarg); break;
+		case 'j': n_threads = atoi(optarg); break;
+		case 's': boot.seed = strtoul(optarg, NULL, 10); break;
+		case 'u':
+		  if ( strcmp( optarg, "policy-year" ) == 0 ) boot.unit = UNIT_POLICY_YEAR;
+		  else if ( strcmp( optarg, "cell" ) == 0 ) boot.unit = UNIT_CELL;
+		  else {
+			fprintf( stderr, "Resampling unit must be policy-year or cell.\n");
+			ok = false;
+		  }
+		  break;
+		case '?':
+		  fprintf( stderr, "Unknown option %c\n", optopt);
+		  ok = false;
+		  break;
+		case ':':
+		  fprintf( stderr, "Missing option for %c\n", optopt);
+		  ok = false;
+		  break;
+		}
+	}
+  if ( boot.band_width < 1 || boot.replicates < 1 || n_threads < 1 || !(level > 0 && level < 1) ){
+	fprintf( stderr, "Band width, replicates and threads must be positive, and the level between 0 and 1.\n");
+	ok = false;
+  }
+  if ( ok == false ){
+	fprintf( stderr, "Inconsistent bootstrap parameters. Exiting...\n");
+	exit( EXIT_FAILURE );
+  }
+
+  // Step 2: Read the decrement table of the expected basis, if any
+  double q[MAX_AGE];
+  if ( table != NULL ){
+	read_table( table, q );
+	boot.q = q;
+  }
+
+  // Step 3: Aggregate exposures.csv from stdin into the cube of cells
+  cell_str *cube = (cell_str *) calloc( MAX_AGE * MAX_YEAR, sizeof(cell_str) );
+  if ( cube == NULL ){
+	fprintf( stderr, "Could not allocate memory for the cube. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+  read_exposures( stdin, cube );
+
+  // Step 4: Keep the non-empty cells, sorted by age band (the cube is walked by attained age)
+  boot.n_band = MAX_AGE / boot.band_width + 1;
+  boot.cell = (cell_str *) malloc( MAX_AGE * MAX_YEAR * sizeof(cell_str) );
+  boot.band_first = (int *) calloc( boot.n_band + 1, sizeof(int) );
+  if ( boot.cell == NULL || boot.band_first == NULL ){
+	fprintf( stderr, "Could not allocate memory for the cells. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+  for (int x = 0; x < MAX_AGE; x++) {
+	for (int t = 0; t < MAX_YEAR; t++) {
+	  cell_str *cl = &cube[ x * MAX_YEAR + t ];
+	  if ( cl->n > 0 ){
+		cl->age = x;
+		cl->band = x / boot.band_width;
+		boot.cell[ boot.n_cell++ ] = *cl;
+		boot.band_first[ cl->band + 1 ] = boot.n_cell;
+	  }
+	}
+  }
+  for (int b = 1; b <= boot.n_band; b++) {
+	if ( boot.band_first[b] < boot.band_first[b-1] ) boot.band_first[b] = boot.band_first[b-1];
+  }
+  free( cube );
+
+  // Step 5: Run the replicates over the threads, each one with its own generator
+  boot.ratio = (double *) malloc( boot.replicates * (boot.n_band + 1) * sizeof(double) );
+  if ( boot.ratio == NULL ){
+	fprintf( stderr, "Could not allocate memory for the replicates. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+  gsl_rng_env_setup();
+  pthread_t thread[n_threads];
+  for (int i = 0; i < n_threads; i++) {
+	pthread_create( &thread[i], NULL, run_replicates, &boot );
+  }
+  for (int i = 0; i < n_threads; i++) {
+	pthread_join( thread[i], NULL );
+  }
+
+  // Step 6: Observed A/E, bootstrap standard error and percentile interval of each age band (and all of them)
+  double *sorted = (double *) malloc( boot.replicates * sizeof(double) );
+  if ( sorted == NULL ){
+	fprintf( stderr, "Could not allocate memory for the percentiles. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+  printf( "age_from;age_to;policy_years;actual;exposure;expected;ae;se;lower;upper\n" );
+  for (int b = 0; b <= boot.n_band; b++) {
+	int first = ( b < boot.n_band ) ? boot.band_first[b] : 0;
+	int last  = ( b < boot.n_band ) ? boot.band_first[b+1] : boot.n_cell;
+	if ( first == last ) continue;
+
+	long n = 0;
+	double A = 0, E = 0, X = 0;
+	for (int i = first; i < last; i++) {
+	  cell_str *cl = &boot.cell[i];
+	  n += cl->n;
+	  A += cl->A;
+	  E += cl->A + cl->E;
+	  X += ( boot.q != NULL ? boot.q[cl->age] : 1.0 ) * ( cl->A + cl->E );
+	}
+
+	// replicates of the band, without the ones with no expected claims at all
+	long m = 0;
+	double sum = 0, sum2 = 0;
+	for (long r = 0; r < boot.replicates; r++) {
+	  double v = boot.ratio[ r * (boot.n_band + 1) + b ];
+	  if ( isnan(v) ) continue;
+	  sorted[m++] = v;
+	  sum += v;
+	  sum2 += v * v;
+	}
+	qsort( sorted, m, sizeof(double), compare_doubles );
+	double se = ( m > 1 ) ? sqrt( ( sum2 - sum * sum / m ) / (m - 1) ) : NAN;
+	double lower = NAN, upper = NAN;
+	if ( m > 0 ){
+	  double pl = ( 1 - level ) / 2 * (m - 1);
+	  double pu = ( 1 + level ) / 2 * (m - 1);
+	  long il = (long) floor(pl), iu = (long) floor(pu);
+	  lower = sorted[il] + ( il + 1 < m ? (pl - il) * (sorted[il+1] - sorted[il]) : 0 );
+	  upper = sorted[iu] + ( iu + 1 < m ? (pu - iu) * (sorted[iu+1] - sorted[iu]) : 0 );
+	}
+
+	if ( b < boot.n_band ){
+	  printf( "%d;%d;", b * boot.band_width, (b + 1) * boot.band_width - 1 );
+	} else {
+	  printf( "all;all;" );
+	}
+	printf( "%ld;%.0f;%f;%f;%f;%f;%f;%f\n", n, A, E, X, ( X > 0 ) ? A / X : NAN, se, lower, upper );
+  }
+
+  free( sorted );
+  free( boot.ratio );
+  free( boot.cell );
+  free( boot.band_first );
+
+  return EXIT_SUCCESS;
+} // main
+
+
+// --------------------------------------------------------------------------------------------------------------------------
+// declarations of functions
+void read_table(
+				char *fname         // decrement table, one age;q pair per line
+				,double *q          // array of MAX_AGE decrement rates, filled from the table
+				){
+  FILE *f = fopen( fname, "r" );
+  if ( f == NULL ){
+	fprintf( stderr, "Could not open decrement table '%s'. Aborting...\n", fname );
+	exit( EXIT_FAILURE );
+  }
+  for (int x = 0; x < MAX_AGE; x++) q[x] = 0;
+
+  char *line = NULL;
+  size_t len = 0;
+  while ( getline( &line, &len, f ) >= 0 ) {
+	char *rest;
+	long age = strtol( line, &rest, 10 );
+	if ( rest == line || *rest != ';' ) continue; // header or comment
+	if ( age >= 0 && age < MAX_AGE ) q[age] = strtod( rest + 1, NULL );
+  }
+  free( line );
+  fclose( f );
+}
+
+void read_exposures(
+					FILE *f             // lines of exposures.csv
+					,cell_str *cube     // MAX_AGE x MAX_YEAR cells, accumulated
+					){
+  // id;age_at_issue;policy_year;attained_age;actual;exposure
+  char *line = NULL;
+  size_t len = 0;
+  long skipped = 0;
+
+  while ( getline( &line, &len, f ) >= 0 ) {
+	char *p = strchr( line, ';' );  // after the id, which may hold anything but the delimiter
+	if ( p == NULL ){ skipped++; continue; }
+	strtol( p + 1, &p, 10 );                      // age at issue
+	if ( *p != ';' ){ skipped++; continue; }
+	long t = strtol( p + 1, &p, 10 );             // policy year
+	if ( *p != ';' ){ skipped++; continue; }
+	long x = strtol( p + 1, &p, 10 );             // attained age
+	if ( *p != ';' ){ skipped++; continue; }
+	long actual = strtol( p + 1, &p, 10 );        // actual
+	if ( *p != ';' ){ skipped++; continue; }
+	double e = strtod( p + 1, &p );               // exposure
+
+	if ( x < 0 || x >= MAX_AGE || t < 0 || t >= MAX_YEAR ){ skipped++; continue; }
+	cell_str *cl = &cube[ x * MAX_YEAR + t ];
+	cl->n++;
+	if ( actual > 0 ){
+	  cl->A += actual; // exposure of a claim year is a full year, drawn along with the claim
+	} else {
+	  cl->E += e;
+	  cl->E2 += e * e;
+	}
+  }
+  free( line );
+  if ( skipped > 0 ){
+	fprintf( stderr, "%ld lines of stdin skipped (not id;age_at_issue;policy_year;attained_age;actual;exposure).\n", skipped );
+  }
+}
+
+void *run_replicates(
+					 void *arg           // pointer to the shared ~boot_str~
+					 ){
+  boot_str *boot = (boot_str *) arg;
+  int nb = boot->n_band + 1;
+  double A[nb], X[nb];
+
+  // one generator per thread, seeded again for each replicate so that replicate r draws the same numbers
+  // whichever thread runs it
+  gsl_rng *rng = gsl_rng_alloc( gsl_rng_default );
+
+  long r;
+  while ( (r = __atomic_fetch_add( &boot->next, 1, __ATOMIC_RELAXED )) < boot->replicates ) {
+	gsl_rng_set( rng, boot->seed + r );
+	for (int b = 0; b < nb; b++) A[b] = X[b] = 0;
+
+	for (int b = 0; b < boot->n_band; b++) {
+	  int first = boot->band_first[b];
+	  int m = boot->band_first[b+1] - first;
+	  for (int j = 0; j < m; j++) {
+		cell_str *cl;
+		double a, e;
+		if ( boot->unit == UNIT_POLICY_YEAR ){
+		  // weights Poisson(1) on each policy year of the cell
+		  cl = &boot->cell[ first + j ];
+		  a = ( cl->A > 0 ) ? gsl_ran_poisson( rng, cl->A ) : 0;
+		  e = ( cl->E2 > 0 ) ? cl->E + gsl_ran_gaussian( rng, sqrt( cl->E2 ) ) : cl->E;
+		  if ( e < 0 ) e = 0;
+		} else {
+		  // a cell of the band drawn with replacement
+		  cl = &boot->cell[ first + gsl_rng_uniform_int( rng, m ) ];
+		  a = cl->A;
+		  e = cl->E;
+		}
+		double x = ( boot->q != NULL ? boot->q[cl->age] : 1.0 ) * ( a + e );
+		A[b] += a;
+		X[b] += x;
+		A[nb-1] += a;
+		X[nb-1] += x;
+	  }
+	}
+
+	for (int b = 0; b < nb; b++) {
+	  boot->ratio[ r * nb + b ] = ( X[b] > 0 ) ? A[b] / X[b] : NAN;
+	}
+  }
+
+  gsl_rng_free( rng );
+  return NULL;
+}
+
+int compare_doubles( const void *a, const void *b ){
+  double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
@@ -0,0 +1,44 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Memoized date parsing (see datecache.h)
+//
+#include <stdint.h>      // UINT32_MAX
+
+#include "datecache.h"
+
+// 0 when the date was not parsed yet, UINT32_MAX when g_date_set_parse() found it invalid, its julian day otherwise
+static guint32 cache[ DATE_CACHE_YEARS * 372 ];
+
+#define DIGIT(c) ( (unsigned) ((c) - '0') < 10 )
+
+static guint32 parse( const char *s ){
+  GDate date;
+  g_date_clear( &date, 1 );
+  g_date_set_parse( &date, s );
+  return g_date_valid( &date ) ? g_date_get_julian( &date ) : 0;
+}
+
+guint32 date_julian(
+					const char *s       // date string, as read by g_date_set_parse()
+					){
+  // YYYY-MM-DD, nothing after it
+  if ( s == NULL || !( DIGIT(s[0]) && DIGIT(s[1]) && DIGIT(s[2]) && DIGIT(s[3]) && s[4] == '-'
+					   && DIGIT(s[5]) && DIGIT(s[6]) && s[7] == '-' && DIGIT(s[8]) && DIGIT(s[9]) && s[10] == '\0' ) ){
+	return ( s == NULL ) ? 0 : parse( s );
+  }
+  int year  = (s[0] - '0') * 1000 + (s[1] - '0') * 100 + (s[2] - '0') * 10 + (s[3] - '0');
+  int month = (s[5] - '0') * 10 + (s[6] - '0');
+  int day   = (s[8] - '0') * 10 + (s[9] - '0');
+  if ( year < DATE_CACHE_FIRST_YEAR || year >= DATE_CACHE_FIRST_YEAR + DATE_CACHE_YEARS
+	   || month < 1 || month > 12 || day < 1 || day > 31 ){
+	return parse( s );
+  }
+
+  guint32 *entry = &cache[ (year - DATE_CACHE_FIRST_YEAR) * 372 + (month - 1) * 31 + (day - 1) ];
+  guint32 julian = __atomic_load_n( entry, __ATOMIC_RELAXED );
+  if ( julian == 0 ){
+	julian = parse( s );
+	if ( julian == 0 ) julian = UINT32_MAX;
+	__atomic_store_n( entry, julian, __ATOMIC_RELAXED );
+  }
+  return ( julian == UINT32_MAX ) ? 0 : julian;
+}
@@ -0,0 +1,26 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Memoized date parsing
+//
+//  Policy files repeat the same few thousand dates (60 years hold some 22,000 days) over millions of lines, yet
+//  g_date_set_parse() is slow: it guesses the format of every string from scratch. Dates written as YYYY-MM-DD are
+//  therefore looked up in a table indexed directly by their digits, (year - DATE_CACHE_FIRST_YEAR) * 372 +
+//  (month - 1) * 31 + (day - 1), holding the julian day number g_date_set_parse() gave the first time the date was
+//  seen. Any other string (another format, a year out of the table) goes to g_date_set_parse() every time.
+//
+//  The table is shared by all threads: an entry is only ever written with the value every thread would compute, and
+//  written and read atomically, so no lock is needed.
+//
+#ifndef DATECACHE_H
+#define DATECACHE_H
+
+#include <glib.h>        // guint32
+
+// years held by the table, 1800 .. 2199 (595 kB)
+#define DATE_CACHE_FIRST_YEAR 1800
+#define DATE_CACHE_YEARS      400
+
+guint32 date_julian(
+					const char *s       // date string, as read by g_date_set_parse()
+					);                  // julian day number of the date, 0 (G_DATE_BAD_JULIAN) when invalid
+
+#endif
@@ -1,15 +1,85 @@
 #include <stdio.h>
+#include <stdlib.h>      // exit
+#include <string.h>      // strcspn, memchr, memcpy, memmove
+#include <unistd.h>      // read, write
+#include <stdbool.h>     // bool (data type)
+#include <getopt.h>      // command line arguments: getopt_long()
 #include <glib.h>  /*  g_date... */
 #include <time.h>  /* time()  */
 
+#include "datecache.h"   // memoized date parsing
+
 // https://github.com/sailfishos-mirror/glib/blob/92e059280f5be23cf77bbe4ec016b5cc0f9af959/glib/tests/date.c
 
-/*   run as 
+/*   run as
 	 ./dt '1982-11-17' dt.txt
+
+	 or streaming, one date per line from stdin to date;days_between;years_between lines on stdout, the days and
+	 years going from each date to today (or to --to=YYYY-MM-DD), as in dt.txt:
+
+	 cut -d';' -f2 stdin.txt | ./dt --stdin --to=2020-12-31 > ages.csv
+
+	 dates are parsed through the cache of datecache.h, so g_date_set_parse() runs once per distinct date and not
+	 once per line; unparsable dates give empty days and years.
+
+	 or streaming pairs of dates, one date;date pair per line from stdin to days_between;years_between lines on
+	 stdout (from the first date to the second one, years of 365.25 days as above):
+
+	 cut -d';' -f2,3 stdin.txt | ./dt --pairs > ages_at_issue.csv
+
+	 stdin and stdout go through IO_BLOCK buffers with read()/write(), and YYYY-MM-DD dates through an integer
+	 kernel (days_from_civil) with no glib call at all; other formats fall back to date_julian().
 */
 
+// bytes read from stdin, and written to stdout, at a time
+#define IO_BLOCK (4 << 20)
+
+void stream_dates(
+				  FILE *in            // one date per line
+				  ,FILE *out          // date;days_between;years_between lines
+				  ,guint32 to         // julian day number the days are counted to
+				  );
+void stream_pairs(
+				  int in              // file descriptor of date;date lines
+				  ,int out            // file descriptor of days_between;years_between lines
+				  );
+
 int main(int argc, char **argv) {
 
+  bool from_stdin = false;
+  bool pairs = false;
+  char *to = NULL;
+
+  int c;
+  while (1)
+	{
+	  int option_index = 0;
+	  static struct option long_options[] =
+		{
+		  {"stdin", no_argument,       NULL, 'i' },
+		  {"pairs", no_argument,       NULL, 'p' },
+		  {"to",    required_argument, NULL, 't' },
+		  {NULL,    0,                 NULL,  0 }
+		};
+
+	  c = getopt_long(argc, argv, ":ipt:", long_options, &option_index);
+	  if (c == -1)
+		break;
+
+	  switch (c)
+		{
+		case 'i': from_stdin = true; break;
+		case 'p': pairs = true; break;
+		case 't': to = optarg; break;
+		case '?':
+		  fprintf( stderr, "Unknown option %c\n", optopt);
+		  exit( EXIT_FAILURE );
+		case ':':
+		  fprintf( stderr, "Missing option for %c\n", optopt);
+		  exit( EXIT_FAILURE );
+		}
+	}
+
   GDate *d, *h;
   d = g_date_new ();
   h = g_date_new ();
@@ -18,13 +88,30 @@ int main(int argc, char **argv) {
   now = time(NULL);
   g_date_set_time_t (h, now);
 
-  if( argc > 1) {
+  if ( to != NULL ){
+	g_date_set_parse (h, to);
+	if ( !g_date_valid (h) ){
+	  fprintf( stderr, "Date --to must be a valid date YYYY-MM-DD.\n");
+	  exit( EXIT_FAILURE );
+	}
+  }
+
+  if ( pairs ) {
+
+	stream_pairs( 0, 1 );
+
+  } else if ( from_stdin ) {
+
+	stream_dates( stdin, stdout, g_date_get_julian (h) );
+
+  } else if( argc - optind > 1) {
 
 	FILE *fp;
-	char *fname = argv[2];
+	char *date = argv[optind];
+	char *fname = argv[optind + 1];
+
+	g_date_set_parse (d, date);
 
-	g_date_set_parse (d, argv[1]);
-	
 	fp = fopen(fname,"w");
 	if( fp == NULL) {
 	  printf("file can't be opened\n");
@@ -33,7 +120,7 @@ int main(int argc, char **argv) {
 
 	fprintf( fp, "dt.c\n");
 
-	fprintf( fp, "argv[1] = %s\n", argv[1]);
+	fprintf( fp, "argv[1] = %s\n", date);
 	fprintf( fp, "d->day = %d\n", d->day);
 	fprintf( fp, "d->month = %d\n", d->month);
 	fprintf( fp, "d->year = %d\n\n", d->year);
@@ -44,12 +131,229 @@ int main(int argc, char **argv) {
 
 	fprintf( fp, "days between d and h = %d\n", g_date_days_between(d,h));
 	fprintf( fp, "years between d and h = %f\n", g_date_days_between(d,h) / 365.25);
-	
+
 	fclose(fp);
-	
+
   }
 
   g_date_free(d);
+  g_date_free(h);
 
   return EXIT_SUCCESS;
 }
+
+void stream_dates(
+				  FILE *in            // one date per line
+				  ,FILE *out          // date;days_between;years_between lines
+				  ,guint32 to         // julian day number the days are counted to
+				  ){
+  char *line = NULL;
+  size_t len = 0;
+  long bad = 0;
+
+  while ( getline( &line, &len, in ) >= 0 ) {
+	line[ strcspn( line, "\r\n" ) ] = '\0';
+	guint32 julian = date_julian( line );
+	if ( julian == 0 ){
+	  fprintf( out, "%s;;\n", line );
+	  bad++;
+	  continue;
+	}
+	int days = (int) to - (int) julian;
+	fprintf( out, "%s;%d;%f\n", line, days, days / 365.25 );
+  }
+  free( line );
+  if ( bad > 0 ){
+	fprintf( stderr, "%ld lines of stdin without a valid date.\n", bad );
+  }
+}
+
+// days since 1970-01-01 of a valid civil date of year 1 or later (H. Hinnant's days_from_civil), in unsigned
+// integers only, so that every division by a constant compiles to a multiplication
+static inline long days_from_civil( unsigned y, unsigned m, unsigned d ){
+  y -= ( m <= 2 );
+  unsigned era = y / 400;
+  unsigned yoe = y - era * 400;
+  unsigned doy = ( 153 * ( m > 2 ? m - 3 : m + 9 ) + 2 ) / 5 + d - 1;
+  unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return (long) era * 146097 + doe - 719468;
+}
+
+// days of a YYYY-MM-DD date at ~s~, false when ~s~ does not start with one, or it is not a valid date
+static inline bool ymd_days( const char *s, long *days ){
+  static const int DAYS_IN_MONTH[13] = { 0, 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+  unsigned y0 = s[0] - '0', y1 = s[1] - '0', y2 = s[2] - '0', y3 = s[3] - '0';
+  unsigned m0 = s[5] - '0', m1 = s[6] - '0', d0 = s[8] - '0', d1 = s[9] - '0';
+  if ( y0 > 9 || y1 > 9 || y2 > 9 || y3 > 9 || m0 > 9 || m1 > 9 || d0 > 9 || d1 > 9 || s[4] != '-' || s[7] != '-' ){
+	return false;
+  }
+  unsigned y = y0 * 1000 + y1 * 100 + y2 * 10 + y3, m = m0 * 10 + m1, d = d0 * 10 + d1;
+  if ( m < 1 || m > 12 || d < 1 || d > DAYS_IN_MONTH[m] ) return false;
+  if ( m == 2 && d == 29 && !( (y % 4 == 0 && y % 100 != 0) || y % 400 == 0 ) ) return false;
+  if ( y == 0 ) return false; // glib knows no year 0
+  *days = days_from_civil( y, m, d );
+  return true;
+}
+
+// days of the date in s[0 .. n-1]: YYYY-MM-DD through the integer kernel, anything else through date_julian()
+static bool field_days( const char *s, size_t n, long *days ){
+  if ( n == 10 && ymd_days( s, days ) ) return true;
+  char date[64];
+  if ( n >= sizeof(date) ) return false;
+  memcpy( date, s, n );
+  date[n] = '\0';
+  guint32 julian = date_julian( date );
+  *days = (long) julian - 719163; // julian day number of 1970-01-01
+  return julian != 0;
+}
+
+// "00" .. "99": two digits written at a time
+static const char DIGITS2[201] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839404142434445464748495051525354555657585960616263646566676869"
+  "707172737475767778798081828384858687888990919293949596979899";
+
+// writes the decimal digits of 0 <= v < 10^8: all eight of them are laid out in pairs, and the leading zeros skipped
+// by the length of an 8-byte copy (~o~ must have 8 bytes of room), with no branch on the amount of digits
+static inline char *put_digits( char *o, long v ){
+  char tmp[16];
+  memcpy( tmp,     DIGITS2 + 2 * ( v / 1000000 ), 2 );
+  memcpy( tmp + 2, DIGITS2 + 2 * ( v / 10000 % 100 ), 2 );
+  memcpy( tmp + 4, DIGITS2 + 2 * ( v / 100 % 100 ), 2 );
+  memcpy( tmp + 6, DIGITS2 + 2 * ( v % 100 ), 2 );
+  int n = 1 + ( v >= 10 ) + ( v >= 100 ) + ( v >= 1000 ) + ( v >= 10000 ) + ( v >= 100000 ) + ( v >= 1000000 )
+	+ ( v >= 10000000 );
+  memcpy( o, tmp + 8 - n, 8 );
+  return o + n;
+}
+
+// years of 365.25 days in a 4-year cycle of 1461 days: years = 4 q + (4 r / 1461) for days = 1461 q + r, with r / 365.25
+// rounded to millionths once and for all; whole years of r (0 to 3) in ~whole~, ".xxxxxx\n" in ~frac~
+typedef struct cycle_str
+{
+  char frac[8];
+  int whole;
+} cycle_str;
+
+static cycle_str CYCLE[1461];
+
+static void init_cycle(void){
+  // rounding to millionths never meets a tie: 1461 = 3 x 487 shares no factor with 10^6
+  for (long r = 0; r < 1461; r++) {
+	long micro = ( r * 8000000 / 1461 + 1 ) / 2;
+	long f = micro % 1000000;
+	CYCLE[r].whole = (int) ( micro / 1000000 );
+	CYCLE[r].frac[0] = '.';
+	for (int k = 6; k >= 1; k--) {
+	  CYCLE[r].frac[k] = '0' + f % 10;
+	  f /= 10;
+	}
+	CYCLE[r].frac[7] = '\n';
+  }
+}
+
+// writes ~days~ and ~days~ / 365.25 with six decimals, as printf( "%d;%f\n" ) does
+static inline char *put_days( char *o, long days ){
+  if ( days < 0 ){
+	*o++ = '-';
+	days = -days;
+	o = put_digits( o, days );
+	*o++ = ';';
+	*o++ = '-';
+  } else {
+	o = put_digits( o, days );
+	*o++ = ';';
+  }
+  const cycle_str *c = &CYCLE[ days % 1461 ];
+  o = put_digits( o, 4 * ( days / 1461 ) + c->whole );
+  memcpy( o, c->frac, 8 );
+  return o + 8;
+}
+
+static void write_all( int fd, const char *buf, size_t n ){
+  while ( n > 0 ) {
+	ssize_t w = write( fd, buf, n );
+	if ( w < 0 ){
+	  fprintf( stderr, "Could not write to stdout. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+	buf += w;
+	n -= w;
+  }
+}
+
+void stream_pairs(
+				  int in              // file descriptor of date;date lines
+				  ,int out            // file descriptor of days_between;years_between lines
+				  ){
+  // a line is at most a few dozen bytes: the output block is flushed once it has less than ~margin~ bytes left
+  const size_t margin = 256;
+  char *ibuf = (char *) malloc( IO_BLOCK + 1 );
+  char *obuf = (char *) malloc( IO_BLOCK );
+  if ( ibuf == NULL || obuf == NULL ){
+	fprintf( stderr, "Could not allocate memory for ~ibuf~ and ~obuf~ pointers from within ~stream_pairs()~ function. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+  init_cycle();
+  char *o = obuf;
+  size_t kept = 0;   // bytes of an unfinished line carried to the start of ~ibuf~
+  long bad = 0;
+  bool eof = false;
+
+  while ( !eof ) {
+	ssize_t r = read( in, ibuf + kept, IO_BLOCK - kept );
+	if ( r < 0 ){
+	  fprintf( stderr, "Could not read from stdin. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+	size_t n = kept + r;
+	if ( r == 0 ){
+	  // last line without a newline
+	  eof = true;
+	  if ( n == 0 ) break;
+	  ibuf[n++] = '\n';
+	}
+
+	char *p = ibuf, *end = ibuf + n;
+	while ( p < end ) {
+	  long d1, d2;
+	  bool ok;
+	  char *nl;
+	  // fast path: YYYY-MM-DD;YYYY-MM-DD\n, with no search for the end of the line
+	  if ( end - p > 21 && p[21] == '\n' && p[10] == ';' && ymd_days( p, &d1 ) && ymd_days( p + 11, &d2 ) ){
+		nl = p + 21;
+		ok = true;
+	  } else {
+		nl = memchr( p, '\n', end - p );
+		if ( nl == NULL ) break;
+		char *line_end = ( nl > p && nl[-1] == '\r' ) ? nl - 1 : nl;
+		char *sep = memchr( p, ';', line_end - p );
+		ok = ( sep != NULL && field_days( p, sep - p, &d1 ) && field_days( sep + 1, line_end - sep - 1, &d2 ) );
+	  }
+	  if ( ok ){
+		o = put_days( o, d2 - d1 );
+	  } else {
+		*o++ = ';';
+		*o++ = '\n';
+		bad++;
+	  }
+	  if ( (size_t) ( obuf + IO_BLOCK - o ) < margin ){
+		write_all( out, obuf, o - obuf );
+		o = obuf;
+	  }
+	  p = nl + 1;
+	}
+
+	kept = end - p;
+	if ( kept == IO_BLOCK ){
+	  fprintf( stderr, "Line of stdin longer than %d bytes. Aborting...\n", IO_BLOCK );
+	  exit( EXIT_FAILURE );
+	}
+	memmove( ibuf, p, kept );
+  }
+  write_all( out, obuf, o - obuf );
+  free( ibuf );
+  free( obuf );
+  if ( bad > 0 ){
+	fprintf( stderr, "%ld lines of stdin without a valid date;date pair.\n", bad );
+  }
+}
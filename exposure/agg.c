@@ -0,0 +1,245 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Cube of aggregated exposures of a study (see agg.h)
+//
+#include <stdio.h>       // fprintf
+#include <stdlib.h>      // calloc, realloc, free, exit, llabs
+#include <string.h>      // memset
+#include <math.h>        // llround
+
+#include "agg.h"
+
+// grows the cube to ~n_group~ groups, the new ones empty
+static void grow( agg_str *a, long n_group ){
+  if ( n_group <= a->n_group ) return;
+  if ( n_group > a->cap_group ){
+	long cap = ( 2 * a->cap_group > n_group ) ? 2 * a->cap_group : n_group;
+	a->slot = (int *) realloc( a->slot, cap * AGG_CELLS * sizeof(int) );
+	if ( a->slot == NULL ){
+	  fprintf( stderr, "Could not allocate memory for ~a->slot~ pointer from within ~grow()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+	memset( a->slot + a->cap_group * AGG_CELLS, 0, (cap - a->cap_group) * AGG_CELLS * sizeof(int) );
+	a->cap_group = cap;
+  }
+  a->n_group = n_group;
+}
+
+// grows the blocks of the cube to ~cap~, the new ones empty, with their amounts once they are added up (--amount)
+static void grow_blocks( agg_str *a, long cap ){
+  if ( cap > a->cap_block ){
+	a->cell = (agg_cell *) realloc( a->cell, cap * a->per * sizeof(agg_cell) );
+	if ( a->cell == NULL ){
+	  fprintf( stderr, "Could not allocate memory for ~a->cell~ pointer from within ~grow_blocks()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+	memset( a->cell + a->cap_block * a->per, 0, (cap - a->cap_block) * a->per * sizeof(agg_cell) );
+	if ( a->amount != NULL ){
+	  a->amount = (agg_amount *) realloc( a->amount, cap * a->per * sizeof(agg_amount) );
+	  if ( a->amount == NULL ){
+		fprintf( stderr, "Could not allocate memory for ~a->amount~ pointer from within ~grow_blocks()~ function. Aborting...\n");
+		exit( EXIT_FAILURE );
+	  }
+	  memset( a->amount + a->cap_block * a->per, 0, (cap - a->cap_block) * a->per * sizeof(agg_amount) );
+	}
+	a->cap_block = cap;
+  }
+  if ( a->amounts && a->amount == NULL && a->cap_block > 0 ){
+	a->amount = (agg_amount *) calloc( a->cap_block * a->per, sizeof(agg_amount) );
+	if ( a->amount == NULL ){
+	  fprintf( stderr, "Could not allocate memory for ~a->amount~ pointer from within ~grow_blocks()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+  }
+}
+
+// first cell of the block of attained age and policy year ~b~ (x * AGG_YEARS + year) of a group, empty when first
+// added to
+static long block( agg_str *a, long group, long b ){
+  int *s = &a->slot[ group * AGG_CELLS + b ];
+  if ( *s == 0 ){
+	if ( a->n_block == a->cap_block ) grow_blocks( a, ( a->cap_block > 0 ) ? 2 * a->cap_block : 256 );
+	*s = (int) ++a->n_block;
+  }
+  return (long) (*s - 1) * a->per;
+}
+
+// policy year of the block of policy period ~t~ (from 0 by month: months 1 .. 12 are in the block of year 0), and
+// its cell in the block
+#define YEAR_OF(a, t) ( ( (a)->per == 1 ) ? (t) : ( (t) - 1 ) / 12 )
+#define CELL_OF(a, t) ( ( (a)->per == 1 ) ? 0 : ( (t) - 1 ) % 12 )
+
+// cell of a group, attained age and policy period in ~a->cell~ (and ~a->amount~), -1 when never added to
+static long find( const agg_str *a, long group, int attained_age, int period ){
+  if ( group < 0 || group >= a->n_group || attained_age < 0 || attained_age >= AGG_AGES || period < 1 || period >= a->periods ){
+	return -1;
+  }
+  int s = a->slot[ group * AGG_CELLS + attained_age * AGG_YEARS + YEAR_OF( a, period ) ];
+  return ( s == 0 ) ? -1 : (long) (s - 1) * a->per + CELL_OF( a, period );
+}
+
+void agg_init(
+			  agg_str *a          // cube to be allocated, all cells empty
+			  ,int periods        // policy periods of an attained age: AGG_YEARS or AGG_MONTHS
+			  ,bool amounts       // amounts added up as well (--amount)
+			  ){
+  a->periods = periods;
+  a->per = ( periods == AGG_MONTHS ) ? 12 : 1;
+  a->cell = NULL;
+  a->amount = NULL;
+  a->n_block = 0;
+  a->cap_block = 0;
+  a->slot = (int *) calloc( AGG_CELLS, sizeof(int) );
+  a->n_group = 1;
+  a->cap_group = 1;
+  a->dropped = 0;
+  a->scale = 1.0;
+  a->amounts = amounts;
+  if ( a->slot == NULL ){
+	fprintf( stderr, "Could not allocate memory for ~a->slot~ pointer from within ~agg_init()~ function. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+}
+
+void agg_add(
+			 agg_str *a          // cube receiving the policy period
+			 ,long group         // group of the policy (0 when not grouped)
+			 ,int attained_age   // attained age of the policy period
+			 ,int period         // policy year (or month)
+			 ,int actual         // 1 for a claim in the policy period, 0 otherwise
+			 ,double exposure    // exposure of the policy period, in years
+			 ,long long amount   // amount of the policy in hundredths (--amount), 0 when none
+			 ){
+  if ( attained_age < 0 || attained_age >= AGG_AGES || period < 1 || period >= a->periods ){
+	a->dropped++;
+	return;
+  }
+  if ( group >= a->n_group ) grow( a, group + 1 );
+  long i = block( a, group, attained_age * AGG_YEARS + YEAR_OF( a, period ) ) + CELL_OF( a, period );
+  agg_cell *c = &a->cell[i];
+  c->n++;
+  c->actual += actual;
+  c->exposure += llround( exposure * 1e6 );
+  if ( a->amounts ){
+	a->amount[i].actual += actual * amount;
+	a->amount[i].exposure += llround( exposure * amount );
+  }
+}
+
+void agg_merge(
+			   agg_str *into       // cube receiving the sums of ...
+			   ,agg_str *from      // ... this one, of the same periods
+			   ,const long *map    // group of ~into~ of each group of ~from~ (NULL for the same groups)
+			   ){
+  into->amounts = into->amounts || from->amounts;
+  grow_blocks( into, 0 );
+  for (long g = 0; g < from->n_group; g++) {
+	long h = ( map != NULL ) ? map[g] : g;
+	grow( into, h + 1 );
+	for (long b = 0; b < AGG_CELLS; b++) {
+	  int s = from->slot[ g * AGG_CELLS + b ];
+	  if ( s == 0 ) continue;
+	  long to = block( into, h, b );
+	  long c = (long) (s - 1) * from->per;
+	  for (int i = 0; i < from->per; i++) {
+		into->cell[ to + i ].n += from->cell[ c + i ].n;
+		into->cell[ to + i ].actual += from->cell[ c + i ].actual;
+		into->cell[ to + i ].exposure += from->cell[ c + i ].exposure;
+		if ( from->amount == NULL ) continue;
+		into->amount[ to + i ].actual += from->amount[ c + i ].actual;
+		into->amount[ to + i ].exposure += from->amount[ c + i ].exposure;
+	  }
+	}
+  }
+  into->dropped += from->dropped;
+}
+
+void agg_sub(
+			 agg_str *into       // cube whose sums are taken down by ...
+			 ,agg_str *from      // ... this one, of the same groups (e.g. policy years taken back, see --follow)
+			 ){
+  into->amounts = into->amounts || from->amounts;
+  grow_blocks( into, 0 );
+  grow( into, from->n_group );
+  for (long b = 0; b < from->n_group * AGG_CELLS; b++) {
+	int s = from->slot[b];
+	if ( s == 0 ) continue;
+	long to = block( into, b / AGG_CELLS, b % AGG_CELLS );
+	long c = (long) (s - 1) * from->per;
+	for (int i = 0; i < from->per; i++) {
+	  into->cell[ to + i ].n -= from->cell[ c + i ].n;
+	  into->cell[ to + i ].actual -= from->cell[ c + i ].actual;
+	  into->cell[ to + i ].exposure -= from->cell[ c + i ].exposure;
+	  if ( from->amount == NULL ) continue;
+	  into->amount[ to + i ].actual -= from->amount[ c + i ].actual;
+	  into->amount[ to + i ].exposure -= from->amount[ c + i ].exposure;
+	}
+  }
+  into->dropped -= from->dropped;
+}
+
+void agg_clear(
+			   agg_str *a          // cube whose cells are emptied (groups kept)
+			   ){
+  memset( a->cell, 0, a->n_block * a->per * sizeof(agg_cell) );
+  if ( a->amount != NULL ) memset( a->amount, 0, a->n_block * a->per * sizeof(agg_amount) );
+  a->dropped = 0;
+}
+
+const agg_cell *agg_get(
+						const agg_str *a    // cube whose cell is read (an empty one when never added to)
+						,long group         // group of the cell
+						,int attained_age   // attained age of the cell
+						,int period         // policy year (or month) of the cell
+						){
+  static const agg_cell empty = { 0 };
+  long i = find( a, group, attained_age, period );
+  return ( i < 0 ) ? &empty : &a->cell[i];
+}
+
+void agg_write(
+			   agg_str *a          // cube to be written, one line per non-empty cell
+			   ,FILE *f            // file receiving the lines (~aggregate.csv~)
+			   ,char **label       // values heading the lines of each group (NULL when not grouped)
+			   ){
+  for (long g = 0; g < a->n_group; g++) {
+	for (int x = 0; x < AGG_AGES; x++) {
+	  for (int t = 1; t < a->periods; t++) {
+		long i = find( a, g, x, t );
+		if ( i < 0 || a->cell[i].n == 0 ) continue;
+		const agg_cell *c = &a->cell[i];
+		const agg_amount *m = ( a->amount != NULL ) ? &a->amount[i] : &(agg_amount) { 0 };
+		if ( a->scale != 1.0 ){
+		  fprintf( f, "%s%d;%d;%.2f;%.2f;%f", ( label != NULL ) ? label[g] : "", x, t, c->n * a->scale,
+				   c->actual * a->scale, c->exposure * a->scale / 1e6 );
+		  if ( a->amounts ) fprintf( f, ";%.2f;%.2f", m->actual * a->scale / 100, m->exposure * a->scale / 100 );
+		  fprintf( f, "\n" );
+		  continue;
+		}
+		fprintf( f, "%s%d;%d;%ld;%ld;%s%lld.%06lld", ( label != NULL ) ? label[g] : "", x, t, c->n, c->actual,
+				 ( c->exposure < 0 ) ? "-" : "", llabs( c->exposure ) / 1000000, llabs( c->exposure ) % 1000000 );
+		if ( a->amounts ){
+		  fprintf( f, ";%s%lld.%02lld;%s%lld.%02lld", ( m->actual < 0 ) ? "-" : "", llabs( m->actual ) / 100,
+				   llabs( m->actual ) % 100, ( m->exposure < 0 ) ? "-" : "", llabs( m->exposure ) / 100,
+				   llabs( m->exposure ) % 100 );
+		}
+		fprintf( f, "\n" );
+	  }
+	}
+  }
+  if ( a->dropped > 0 ){
+	const char *period = ( a->periods == AGG_MONTHS ) ? "month" : "year";
+	fprintf( stderr, "%ld policy %ss beyond attained age %d or policy %s %d were left out of the aggregate.\n",
+			 a->dropped, period, AGG_AGES - 1, period, a->periods - 1 );
+  }
+}
+
+void agg_free(
+			  agg_str *a          // cube whose cells are freed
+			  ){
+  free( a->cell );
+  free( a->amount );
+  free( a->slot );
+  a->cell = NULL;
+  a->amount = NULL;
+  a->slot = NULL;
+}
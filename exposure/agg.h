@@ -0,0 +1,124 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Cube of aggregated exposures of a study (--aggregate)
+//
+//  Instead of writing every policy year into ~exposures.csv~ and summing them up downstream (e.g. ../bootstrap/boot
+//  reading it back), the exposures are added up in process into cells of attained age x policy year, written once
+//  at the end into ~aggregate.csv~ of the study, one line per non-empty cell, by attained age and policy year:
+//
+//    attained_age;policy_year;policy_years;actual;exposure
+//
+//  Grouped by extra columns of stdin (--group-by, see group.h), the cube holds a block of cells per group, each line
+//  headed by the values of its group:
+//
+//    gender;channel;attained_age;policy_year;policy_years;actual;exposure
+//
+//  Weighted by an amount of each policy (--amount, e.g. its sum assured), the cells add up the claims and exposures
+//  times the amount as well, in two more columns (in hundredths of the amount, as integers too):
+//
+//    attained_age;policy_year;policy_years;actual;exposure;actual_amount;exposure_amount
+//
+//  A cube of a sample of the policies (--sample, see sample.h) is written scaled up, its sums multiplied by ~scale~:
+//  all the policies over the kept ones, one ratio for the whole study. Its totals are therefore not those of
+//  ~sample.csv~, whose estimates are post-stratified (each stratum scaled up by its own ratio), with standard
+//  errors: the cells tell the shape of the study, ~sample.csv~ its totals and rate.
+//
+//  By policy month (--granularity=month), the cells are attained age x policy month, 1 .. AGG_MONTHS-1, the lines
+//  counting policy months (exposures still in years):
+//
+//    attained_age;policy_month;policy_months;actual;exposure
+//
+//  Each worker thread adds into its own cube, merged at the end. Exposures are summed in millionths of a year (as
+//  printed in ~exposures.csv~), in integers: the sums do not depend on the order of the policies, nor on the amount
+//  of threads.
+//
+//  Only the cells reached are allocated: a block of cells per (group, attained age, policy year) added to, one cell
+//  by policy year or the 12 of its months by policy month, found through a slot per (group, attained age, policy year).
+//  A cube takes 4 B x AGG_CELLS (90 KB) per group plus one block (24 B, or 288 B by month) per attained age and policy
+//  year with exposure, at most AGG_CELLS of them per group: a portfolio reaching a few thousand of them takes about
+//  1 MB by month per group, where the cells of every attained age and policy month would take 6.5 MB. The amounts
+//  (--amount) are kept aside, 16 B more per cell, only when added up.
+//
+#ifndef AGG_H
+#define AGG_H
+
+#include <stdio.h>       // FILE
+#include <stdbool.h>     // bool (data type)
+
+// cells: attained ages 0 .. AGG_AGES-1 and policy years 1 .. AGG_YEARS-1 (as the cube of ../bootstrap/boot)
+#define AGG_AGES  150
+#define AGG_YEARS 150
+#define AGG_CELLS ( AGG_AGES * AGG_YEARS )    // cells of a group (by policy year)
+#define AGG_MONTHS ( AGG_YEARS * 12 )          // policy months 1 .. AGG_MONTHS-1 (--granularity=month)
+
+typedef struct agg_cell
+{
+  long n;              // policy years (or months) in the cell
+  long actual;         // claims in the cell
+  long long exposure;  // exposure of the cell, in millionths of a year
+} agg_cell;
+
+typedef struct agg_amount
+{
+  long long actual;    // claims times the amount of their policy (--amount), in hundredths
+  long long exposure;  // exposures times the amount of their policy (--amount), in hundredths of a year
+} agg_amount;
+
+typedef struct agg_str
+{
+  agg_cell *cell;      // blocks of ~per~ cells, in the order they were first added to
+  agg_amount *amount;  // amounts of each cell of ~cell~, allocated only when added up (NULL otherwise)
+  int *slot;           // block in ~cell~ of each group, attained age and policy year (AGG_CELLS per group), plus one
+					   // (0 for none yet)
+  int periods;         // policy periods of an attained age: AGG_YEARS (policy years) or AGG_MONTHS (policy months)
+  int per;             // cells of a block: 1 by policy year, 12 by policy month
+  long n_block;        // blocks in ~cell~
+  long cap_block;      // blocks allocated in ~cell~
+  long n_group;        // groups of the cube, up to the last one added to (1 when not grouped)
+  long cap_group;      // groups allocated in ~slot~
+  long dropped;        // policy periods beyond the cube (attained age or policy period too large)
+  double scale;        // weight of each policy year when written, 1 unless scaled up from a sample (--sample)
+  bool amounts;        // amounts added up (--amount), written in two more columns
+} agg_str;
+
+void agg_init(
+			  agg_str *a          // cube to be allocated, all cells empty
+			  ,int periods        // policy periods of an attained age: AGG_YEARS or AGG_MONTHS
+			  ,bool amounts       // amounts added up as well (--amount)
+			  );
+void agg_add(
+			 agg_str *a          // cube receiving the policy period
+			 ,long group         // group of the policy (0 when not grouped)
+			 ,int attained_age   // attained age of the policy period
+			 ,int period         // policy year (or month)
+			 ,int actual         // 1 for a claim in the policy period, 0 otherwise
+			 ,double exposure    // exposure of the policy period, in years
+			 ,long long amount   // amount of the policy in hundredths (--amount), 0 when none
+			 );
+void agg_merge(
+			   agg_str *into       // cube receiving the sums of ...
+			   ,agg_str *from      // ... this one, of the same periods
+			   ,const long *map    // group of ~into~ of each group of ~from~ (NULL for the same groups)
+			   );
+void agg_sub(
+			 agg_str *into       // cube whose sums are taken down by ...
+			 ,agg_str *from      // ... this one, of the same groups (e.g. policy years taken back, see --follow)
+			 );
+const agg_cell *agg_get(
+						const agg_str *a    // cube whose cell is read (an empty one when never added to)
+						,long group         // group of the cell
+						,int attained_age   // attained age of the cell
+						,int period         // policy year (or month) of the cell
+						);
+void agg_clear(
+			   agg_str *a          // cube whose cells are emptied (groups kept)
+			   );
+void agg_write(
+			   agg_str *a          // cube to be written, one line per non-empty cell
+			   ,FILE *f            // file receiving the lines (~aggregate.csv~)
+			   ,char **label       // values heading the lines of each group (NULL when not grouped)
+			   );
+void agg_free(
+			  agg_str *a          // cube whose cells are freed
+			  );
+
+#endif
@@ -1,14 +1,90 @@
-/*   
+/*
   create test stdin for simulating
     printf 'id;date_of_birth;policy_issue_date;policy_status_code;policy_status_date\n' > stdin.txt
-	printf '1234;1982-11-17;2010-01-01;1;\n' >> stdin.txt 
-	printf '5678;1977-06-23;2012-03-04;3;2015-09-17\n' >> stdin.txt 
-	printf '91011;1977-06-23;2012-33-04;3;2015-09-17\n' >> stdin.txt 
-	printf '121314;1977-06-23;2012-03-04;3;\n' >> stdin.txt 
+	printf '1234;1982-11-17;2010-01-01;1;\n' >> stdin.txt
+	printf '5678;1977-06-23;2012-03-04;3;2015-09-17\n' >> stdin.txt
+	printf '91011;1977-06-23;2012-33-04;3;2015-09-17\n' >> stdin.txt
+	printf '121314;1977-06-23;2012-03-04;3;\n' >> stdin.txt
 
-  run as 
+  run as
     tail +2 stdin.txt | ./exposure --start=2000-01-01 --end=2008-12-31 --type=3
 
+  or, to run several studies over one single scan of stdin, list them in a manifest file
+  (one study per line: start;end;type;basis;output, where output is the directory receiving its files)
+	printf '# start;end;type;basis;output\n' > studies.txt
+	printf '2000-01-01;2008-12-31;3;365;mortality_2000_2008\n' >> studies.txt
+	printf '2005-01-01;2015-12-31;2;365.25;lapse_2005_2015\n' >> studies.txt
+	tail +2 stdin.txt | ./exposure --manifest=studies.txt
+
+  spread the policies over 4 worker threads (and report the metrics of the scheduler on stderr) as
+	tail +2 stdin.txt | ./exposure --start=2000-01-01 --end=2008-12-31 --type=3 --threads=4 --sched-stats
+
+  report the hardware performance counters (cycles, instructions, IPC, LLC and branch misses) of the tokenize,
+  validate and expose stages on stderr, in totals and per million policies, as
+	tail +2 stdin.txt | ./exposure --start=2000-01-01 --end=2008-12-31 --type=3 --threads=4 --perf-counters
+
+  report the progress of a long run on stderr every 30 seconds (lines read, policies validated and rejected, policy
+  years written, their rates and, reading a file, the time left), also rewriting progress.prom for the textfile
+  collector of node_exporter
+	./exposure --start=2000-01-01 --end=2008-12-31 --type=3 --skip=1 --telemetry=30 --telemetry-file=progress.prom < stdin.txt
+
+  write the exposures into a directory tree partitioned by policy year (or attained_age), one part per thread, as
+	tail +2 stdin.txt | ./exposure --start=2000-01-01 --end=2008-12-31 --type=3 --threads=4 --partition-by=policy_year
+  resulting in exposures/policy_year=01/part-0.csv, ..., exposures/policy_year=01/part-3.csv, exposures/policy_year=02/...
+
+  read the next blocks of stdin in a thread of the line reader while the current one is being processed as
+	tail +2 stdin.txt | ./exposure --start=2000-01-01 --end=2008-12-31 --type=3 --threads=4 --read-ahead
+
+  or, instead of chaining tools with shell pipes, run the stages in one process: skip the header line of stdin.txt
+  (as tail does) and add the exposures up into aggregate.csv (attained_age;policy_year;policy_years;actual;exposure)
+  with or without exposures.csv (--aggregate or --aggregate-only), e.g.
+	./exposure --start=2000-01-01 --end=2008-12-31 --type=3 --threads=4 --skip=1 --aggregate-only < stdin.txt
+
+  break the aggregate down by extra columns of stdin, by their position in the line or by their name in its header
+  (the first line, left out by --skip), e.g. with gender and channel in columns 6 and 7
+	./exposure --start=2000-01-01 --end=2008-12-31 --type=3 --skip=1 --aggregate-only --group-by=gender,channel < stdin.txt
+
+  weight the claims and exposures of the aggregate by an amount of each policy as well (e.g. its sum assured, by its
+  position in the line or its name in the header), into two more columns of aggregate.csv (actual_amount and
+  exposure_amount) and the amount at the end of each line of exposures.csv
+	./exposure --start=2000-01-01 --end=2008-12-31 --type=3 --skip=1 --aggregate --amount=sum_assured < stdin.txt
+
+  estimate survival by policy duration as well: Kaplan-Meier in days since issue (survival_km.csv) and the actuarial
+  life table by policy year (survival_table.csv), both with Greenwood's variance, per group when grouped
+	./exposure --start=2000-01-01 --end=2008-12-31 --type=3 --skip=1 --aggregate-only --survival < stdin.txt
+
+  graduate the crude rates of the aggregate (Whittaker-Henderson, weighted by the exposures) by attained age with
+  smoothing 1000, or over attained age x policy year with smoothing 1000 along ages and 100 along years, into
+  graduated.csv (--graduate implies --aggregate)
+	./exposure --start=2000-01-01 --end=2008-12-31 --type=3 --skip=1 --aggregate-only --graduate=1000,100 < stdin.txt
+
+  preview a study on 1% of the policies, kept by the hash of their ID (the same ones from one run to the next),
+  the aggregate scaled up to all of them by one ratio, and sample.csv estimating actual, exposure and their rate with
+  standard errors, stratified by issue year x status code (its totals, not those of the aggregate, are the estimates)
+	./exposure --start=2000-01-01 --end=2008-12-31 --type=3 --skip=1 --aggregate-only --sample=0.01 < stdin.txt
+
+  expose by policy month instead of policy year (--granularity=month), the months added straight into aggregate.csv
+  (attained_age;policy_month;policy_months;actual;exposure, exposures in years), with exposures.csv by month as well
+  only when asked for (--aggregate)
+	./exposure --start=2000-01-01 --end=2008-12-31 --type=3 --skip=1 --granularity=month < stdin.txt
+
+  read input files instead of stdin, each file by a worker thread of its own (up to the cores, or --threads), e.g.
+  extracts split by product line, the results as if the files were concatenated into stdin (--skip leaves out the
+  first lines of every file)
+	./exposure --start=2000-01-01 --end=2008-12-31 --type=3 --skip=1 --aggregate extracts/product_*.csv
+
+  or keep one process running as a server over a Unix domain socket, taking studies from many clients side by side,
+  one study per connection: its parameters in the first line (start;end;type;basis;mode, where mode is exposures,
+  aggregate or all), then the policies, answered with the exposures as they are computed, then the sections
+  #out_of_study, #aggregate (by mode) and #end
+	./exposure --listen=/tmp/exposure.sock &
+	( printf '2000-01-01;2008-12-31;3;365;all\n'; tail +2 stdin.txt ) | socat - UNIX-CONNECT:/tmp/exposure.sock
+
+  or follow a file growing through the day (e.g. status changes appended by the policy admin system), adding its new
+  lines into the aggregate as they arrive and publishing aggregate.csv every 5 minutes (a policy appearing again
+  replaces its earlier line), until stopped with SIGINT or SIGTERM
+	./exposure --start=2000-01-01 --end=2008-12-31 --type=3 --skip=1 --follow=changes.txt --snapshot=300
+
   check memory leaks with valgrind as
     tail +2 stdin.txt | valgrind ./exposure --start=2000-01-01 --end=2008-12-31 --type=3
 
@@ -26,16 +102,42 @@
 #include <getopt.h>      // command line arguments: getopt_long()
 #include <glib.h>        // date calculations: g_date...
 #include <time.h>        // time annotations: time()
-
-// Options for the number of days in a year
+#include <errno.h>       // errno, EEXIST
+#include <sys/stat.h>    // mkdir()
+#include <sys/socket.h>  // socket(), bind(), listen(), accept() (--listen)
+#include <sys/un.h>      // struct sockaddr_un
+#include <unistd.h>      // unlink(), close()
+#include <signal.h>      // signal(), SIGPIPE, SIGINT, SIGTERM
+#include <semaphore.h>   // requests served at a time
+#include <fcntl.h>       // open() (--follow)
+#include <poll.h>        // poll()
+#include <sys/inotify.h> // inotify_init1(), inotify_add_watch()
+#include <glob.h>        // glob() (input files)
+
+#include "sched.h"       // work-stealing scheduler of the threaded engine
+#include "writer.h"      // single or partitioned files of exposures
+#include "datecache.h"   // memoized date parsing, shared with ../dates
+#include "lines.h"       // block line reader of stdin, shared with ../getline
+#include "queue.h"       // bounded queues between the stages of the threaded engine
+#include "agg.h"         // cube of aggregated exposures (--aggregate)
+#include "policy.h"      // compact policy record
+#include "group.h"       // grouping columns of the aggregate (--group-by)
+#include "surv.h"        // survival by policy duration (--survival)
+#include "grad.h"        // Whittaker-Henderson graduation of the aggregate (--graduate)
+#include "sample.h"      // stratified sample of the policies (--sample)
+#include "perf.h"        // hardware performance counters of the stages (--perf-counters)
+#include "tele.h"        // progress telemetry of the run (--telemetry)
+#include <pthread.h>     // threads of the stages of the threaded engine
+
+// Options for the number of days in a year (the study basis, see --basis and the manifest file)
 //
-//  (1) no adjustment for leap years:        365      days/year    
+//  (1) no adjustment for leap years:        365      days/year
 //  (2) accurate adjustment for leap years:  365.2425 days/year --> 365.2425 = ( 291 * 366 + 909 * 365 ) / 1200  )
 //  (3) fair adjustment for leap years:      365.25   days/year --> 365.25   = ( 3 * 365 + 366 ) / 4
 //
-const float DAYS_IN_YEAR = 365.00;
+const float DAYS_IN_YEAR = 365.00; // default basis, when none is given
 //
-// Field delimiter in stdin stream
+// Field delimiter in stdin stream (and in the manifest file)
 //
 const char *DELIM = ";";
 
@@ -47,25 +149,146 @@ typedef struct study_str
   char *start;         // start date of experience study (must be a valid date YYYY-MM-DD)
   char *end;           // end date of experience study (must be a valid date YYYY-MM-DD)
   char *type;          // type of experience study ( 2 Lapse, 3 Mortality, 4 Accidental Death, 5 TPD Disease, 6 TPD Accident
+  float days_in_year;  // basis of the study: 365, 365.25 or 365.2425 days in a year
+  char *output;        // directory where the files ~exposures.csv~ and ~out_of_study.csv~ of the study are written
+  int32_t s;           // study start date in days since 1970-01-01, parsed once from ~start~
+  int32_t e;           // study end date in days since 1970-01-01, parsed once from ~end~
+  int type_code;       // study type when spelled as its single digit, 0 otherwise (claims: see POLICY_STATUS_EXACT)
+  FILE *f_exp;         // file connection to ~exposures.csv~ of the study (NULL when partitioned)
+  writer_str *w_part;  // partitioned exposures (--partition-by): one writer per writer thread, NULL otherwise
+  FILE *f_out;         // file connection to ~out_of_study.csv~ (LOG) of the study
+  agg_str *agg;        // cubes of aggregated exposures (--aggregate): one per worker thread, NULL otherwise
+  surv_str *surv;      // histograms of the durations (--survival): one per worker thread, NULL otherwise
+  sample_str *sample;  // strata of the sampled policies (--sample): one per worker thread, NULL otherwise
 } study_str;
 //
-//  policy level parameters
-typedef struct policy_str
-{
-  char *id;            // any identification possible, must be unique to each policy
-  char *date_of_birth; // date of birth of policyholder (must be a valid date YYYY-MM-DD)
-  char *issue_date;    // day at which policyholder turned into client (must be a valid date YYYY-MM-DD)
-  char *status_code;   // 1 Inforce, 2 Lapsed, 3 Death, 4 Accidental Death, 5 TPD Disease, 6 TPD Accident
-  char *status_date;   // date detailing the status code (must be a valid date YYYY-MM-DD except for status code 1)
-} policy_str;
+//  policy level parameters: compact record of policy.h (~policy_str~)
 
 // Structs containing
 //
-//  - the experience study parameters (initialized to NULL pointer)
+//  - the experience studies parameters (initialized to NULL pointer) and how many of them were given
 study_str *study = NULL;
+int n_study = 0;
+//
+//  - the arenas of the long IDs of the policies, one per worker thread
+policy_arena *arena = NULL;
+//
+//  - the columns grouping the aggregate (--group-by), with the dictionaries of their values, one per worker thread,
+//    and, once stdin is over, the groups of each worker mapped into the groups of ~aggregate.csv~ and their values
+group_by grouping = { .n_field = POLICY_FIELDS };
+group_str *groups = NULL;
+long **group_map = NULL;
+char **group_label = NULL;
+long n_groups = 0;
+//
+//  - the run options: amount of worker threads (--threads) and report of the scheduler metrics (--sched-stats)
+int n_threads = 1;
+bool report_sched = false;
+bool perf_counters = false; // --perf-counters: report of the performance counters of each stage (~perf~, per thread)
+perf_str *perf = NULL;
+int tele_interval = 0;     // --telemetry: seconds between the progress reports on stderr, 0 for none
+char *tele_path = NULL;    // --telemetry-file: Prometheus text file rewritten at each report
+tele_str telemetry;
+tele_str *tele = NULL;     // counters of the run while reported, NULL otherwise
+bool read_ahead = false;   // --read-ahead: a thread of the line reader reads the next blocks of stdin
+long skip_lines = 0;       // --skip: lines at the top of stdin left out (e.g. its header), instead of tail -n+2
+long skip_total = 0;       // ... as given (~skip_lines~ counts down to 0 as they are left out)
+bool aggregate = false;    // --aggregate: exposures added up into ~aggregate.csv~ of each study as well
+bool exposures = true;     // --aggregate-only turns off ~exposures.csv~
+bool survival = false;     // --survival: Kaplan-Meier and life table by policy duration of each study as well
+double grad_h = 0;         // --graduate: smoothing of the graduated rates along attained ages, 0 when not graduated
+double grad_v = 0;         // ... and along policy years, 0 when graduated by attained age only
+double sample_fraction = 1; // --sample: fraction of the policies exposed (by the hash of their ID), 1 for all
+bool by_month = false;     // --granularity=month: exposures by policy month, added up into the aggregate
+int agg_periods = AGG_YEARS; // policy periods of each attained age in the aggregate: AGG_YEARS, or AGG_MONTHS by month
+//
+//  - and the column partitioning the exposures into a directory tree (--partition-by), if any
+partition_by partition = PARTITION_NONE;
+//
+//  - and the Unix domain socket of the server mode (--listen), if any
+char *listen_path = NULL;
 //
-//  - and the policy parameters (initialized to NULL pointer)
-policy_str *policy = NULL;
+//  - or the file followed as it grows (--follow), and how often the aggregates are published (--snapshot)
+char *follow_path = NULL;
+long snapshot_every = 60;
+//
+//  - or the input files given (or matched by the patterns given) after the options, read instead of stdin
+glob_t input = { 0 };
+
+// Threaded engine: a pipeline of stages, side by side in one process, passing batches of lines through bounded queues
+//
+//    read     (thread) takes blocks of lines of stdin from the line reader (lines.h) and skips the first ones (--skip)
+//    expose   (main thread) splits the batch in chunks handed to the worker threads
+//    write    (thread) writes the results of the chunks in the order of stdin
+//
+//  PIPE_BATCHES batches go around, so reading, exposing and writing overlap with bounded memory. The blocks of the line
+//  reader are kept by the batches being read or exposed, released once exposed (before being written): at most
+//  PIPE_BATCHES of them, and with all LINES_RING kept, the read stage waits in lines_take() for the expose stage to
+//  release one (see lines.h)
+#define CHUNK_LINES 256
+#define PIPE_BATCHES 3
+
+// Server mode (--listen): each connection is served by a thread of its own, reading the policies of its request in
+// blocks of SERVE_BLOCK bytes, up to SERVE_CLIENTS connections at a time (the next ones wait to be accepted). The
+// memoized dates (datecache.h) stay warm from one request to the next
+#define SERVE_BLOCK (64 << 10)
+#define SERVE_CLIENTS 64
+
+// Follow mode (--follow): the file is read as it grows, FOLLOW_BLOCK bytes at a time, by one worker thread. The last
+// line of each policy is kept (~followed_str~, by ID): a policy appearing again is a change of its status, whose
+// earlier policy years are taken back out of the aggregate of the studies it was exposed to (at most FOLLOW_STUDIES)
+#define FOLLOW_BLOCK (1 << 20)
+#define FOLLOW_STUDIES 64
+
+// Input files: more than one is read by worker threads of their own (up to the cores, or --threads), each taking the
+// next file once done with its last one, with a line reader, arena and dictionaries of its own. The files of each
+// study are written in the order of the files, one at a time (~written~): a file whose turn it is when taken is
+// written straight into them, and one read ahead of its turn goes into spill files (tmpfile()), appended once the
+// files before it are written (the worker waits for its turn before taking the next file, so at most one file per
+// worker is spilled at a time). The results are those of the files concatenated into stdin (each one left out its
+// --skip lines)
+typedef struct files_str
+{
+  long next;           // next file to be taken by a worker thread
+  long written;        // files written into the files of each study, in their order
+  pthread_mutex_t lock;  // guards ~written~
+  pthread_cond_t turn;   // signalled when ~written~ moves on
+} files_str;
+typedef struct followed_str
+{
+  policy_str policy;   // last line of the policy (a long ID points into the key of the table of followed policies)
+  uint64_t exposed;    // studies the policy is exposed to, bit k for study k
+  int64_t amount;      // amount of the policy (--amount)
+} followed_str;
+//
+//  chunk of a batch, with memory buffers for the exposures and the LOG of each study
+typedef struct chunk_str
+{
+  char **exp_buf;      // exposures of the lines of the chunk, one buffer per study
+  size_t *exp_len;     // length of each buffer in ~exp_buf~
+  char **out_buf;      // LOG of the policies of the chunk out of study, one buffer per study
+  size_t *out_len;     // length of each buffer in ~out_buf~
+} chunk_str;
+//
+//  batch of lines read from stdin (one block of the line reader)
+typedef struct batch_str
+{
+  char **line;         // lines read from stdin, views into the block of the line reader
+  long n;              // amount of lines in the batch
+  int block;           // block of the line reader holding the lines, released once exposed
+  chunk_str *chunk;    // chunks of CHUNK_LINES lines
+  long n_chunk;        // chunks of the batch
+  long n_chunk_max;    // chunks allocated in ~chunk~, grown with the largest batch
+} batch_str;
+//
+//  queues between the stages
+typedef struct pipe_str
+{
+  line_reader *reader; // line reader of stdin
+  queue_str *empty;    // batches back from the write stage, to be filled by the read stage
+  queue_str *read;     // batches of lines, to be exposed
+  queue_str *exposed;  // batches of results, to be written
+} pipe_str;
 
 // --------------------------------------------------------------------------------------------------------------------------
 //  prototypes of the functions
@@ -73,18 +296,118 @@ void study_parameters(
 					  int argc            // amount of command-line arguments
 					  ,char **argv        // array of command-line arguments
 					  ,bool *ok           // flag for validity of study based on the parameters given by the user
-					  ,study_str **study  // pointer to pointer to struct containing pointers to parameters
+					  ,study_str **study  // pointer to array of structs containing pointers to parameters, one per study
+					  ,int *n_study       // pointer to the amount of studies read (1, or the lines of the manifest file)
 					  );
-void tokenize(
-			  char *line             // pointer to single, one at a time, line read from stdin
-			  ,policy_str **policy   // pointer to pointer to policy struct where inputs will be copied
+void process_lines(
+				   study_str *st       // studies the lines are exposed to ...
+				   ,int n_st           // ... and their amount
+				   ,char **line        // lines read from stdin (at most CHUNK_LINES)
+				   ,long n             // amount of lines
+				   ,writer_str **w_exp // array of writers receiving the exposures, one per study
+				   ,FILE **f_out       // array of LOG files receiving the policies out of study, one per study
+				   ,policy_arena *a    // arena of the worker thread, receiving the long IDs
+				   ,group_str *g       // dictionaries of the worker thread, coding the groups (--group-by)
+				   ,perf_str *p        // counters of the worker thread (--perf-counters), NULL otherwise
+				   );
+void expose_chunk(
+				  void *arg           // batch of lines read from stdin (~batch_str~)
+				  ,int worker         // worker thread running the chunk (owner of the partition files part-K.csv)
+				  ,long c             // index of the chunk within the batch
+				  );
+void expose_threaded(
+					 line_reader *reader // line reader of stdin, one block of lines per batch
+					 );
+void *read_stage(
+				 void *arg           // queues of the pipeline (~pipe_str~)
+				 );
+void *write_stage(
+				  void *arg           // queues of the pipeline (~pipe_str~)
+				  );
+void skip_header(
+				 char **line         // lines at the top of stdin left out (--skip)
+				 ,long n             // amount of lines
+				 );
+int open_input(
+			   char *path          // input file
+			   );                  // file descriptor of the file, opened for reading
+void expose_files(
+				  );
+void *file_worker(
+				  void *arg           // worker thread (~intptr_t~), taking files from ~files~
+				  );
+void serve(
+		   char *path          // path of the Unix domain socket to listen on
+		   );
+void follow(
+			char *path          // path of the file followed as it grows
+			);
+void follow_lines(
+				  GHashTable *followed // last line of each policy seen, by ID (~followed_str~)
+				  ,char **line        // new lines of the file (at most CHUNK_LINES)
+				  ,long n             // amount of lines
+				  ,writer_str **w_exp // writers adding the exposures into the aggregate, one per study
+				  ,writer_str **w_back // writers adding the exposures taken back, one per study
+				  ,FILE **f_out       // LOG files receiving the policies out of study, one per study
+				  );
+void snapshot(
+			  study_str *study    // study whose aggregate is published into ~aggregate.csv~
 			  );
+void *serve_request(
+					void *arg           // connection of a client (file descriptor)
+					);
+void read_manifest(
+				   char *fname         // path to the manifest file, one study per line: start;end;type;basis;output
+				   ,bool *ok           // flag for validity of the studies listed in the manifest
+				   ,study_str **study  // pointer to array of structs, grown by one struct per study in the manifest
+				   ,int *n_study       // pointer to the amount of studies read from the manifest
+				   );
+void set_study(
+			   study_str *study    // pointer to the struct receiving the (validated) parameters
+			   ,char *start        // study start date YYYY-MM-DD
+			   ,char *end          // study end date YYYY-MM-DD
+			   ,char *type         // study type (integer between 1 and 6)
+			   ,char *basis        // days in a year (365, 365.25 or 365.2425). NULL or empty means DAYS_IN_YEAR
+			   ,char *output       // output directory. NULL or empty means the current directory
+			   ,bool *ok           // flag for validity of the study
+			   ,char *where        // prefix for error messages, locating the study (e.g. line of the manifest)
+			   );
+void open_study(
+				study_str *study    // pointer to struct whose output directory and files will be created
+				);
+void close_study(
+				 study_str *study    // pointer to struct whose files are closed and pointers freed
+				 );
 void validate(
 			  study_str *study    // pointer to struct containing pointers to parameters
-			  ,policy_str *policy // pointer to policy struct with parsed inputs to be validated
+			  ,policy_str *policy // pointer to policy record with parsed inputs to be validated
+			  ,int64_t amount     // amount of the policy (--amount), POLICY_AMOUNT_NONE when invalid
+			  ,char **field       // fields of the policy as read from stdin, for the LOG
 			  ,bool *exposed      // pointer to boolean flag controlling if policy is exposed to study
 			  ,FILE *f_out        // pointer to LOG file ~f_out~, where the problems will be listed if policy is not exposed to study
 			  );
+int expose(
+		   study_str *study    // pointer to struct containing pointers to parameters
+		   ,policy_str *policy // pointer to policy struct with validated inputs
+		   ,int64_t amount     // amount of the policy in hundredths (--amount), 0 when none
+		   ,writer_str *w_exp  // pointer to writer of the file(s) where the exposure at each policy year is written
+		   );
+int expose_months(
+				  study_str *study    // pointer to struct containing pointers to parameters
+				  ,policy_str *policy // pointer to policy struct with validated inputs
+				  ,int64_t amount     // amount of the policy in hundredths (--amount), 0 when none
+				  ,writer_str *w_exp  // pointer to writer of the file(s) where the exposure at each policy month is written
+				  ,int age_issue      // age at issue of the policy
+				  ,bool claim         // the policy left with a claim of the study (at its status date)
+				  );
+int days_in_month(
+				  int y               // year
+				  ,int m              // month 1 .. 12
+				  );
+void write_amount(
+				  FILE *f_exp         // file of the exposures, whose line is ended ...
+				  ,int64_t amount     // ... with the amount of the policy in hundredths, when given (--amount)
+				  );
 double duration_at_start(
 						 study_str *study    // pointer to struct containing pointers to parameters
 						 ,policy_str *policy // pointer to policy struct with parsed inputs to be validated
@@ -98,160 +421,170 @@ double policy_claim_year(
 						 ,policy_str *policy // pointer to policy struct with parsed inputs to be validated
 						 );
 int age_at_issue(
-				 policy_str *policy // pointer to policy struct with parsed inputs to be validated
+				 study_str *study    // pointer to struct containing pointers to study parameters (basis)
+				 ,policy_str *policy // pointer to policy struct with parsed inputs to be validated
 				 );
 
 
 // --------------------------------------------------------------------------------------------------------------------------
-// main 
+// main
 int main(int argc, char **argv){
-  
+
   // Improve guessing power from glib's g_date_set_parse() function
   //setlocale( LC_ALL, "");
 
-  // File connections
-  //
-  //  ~exposures.csv~ file with the exposures for each policyholder at each policy year in the experience study
-  FILE *f_exp = fopen("exposures.csv", "w");
-  if( f_exp == NULL ){
-	fprintf( stderr, "Could not open file 'exposures.csv'. Aborting...\n");
-	exit( EXIT_FAILURE );
-  }
-  //
-  //  ~out_of_study.csv~ file with the LOG of policies not exposed to study due to inconsistencies in their inputs
-  FILE *f_out = fopen("out_of_study.csv", "w");
-  if( f_out == NULL ){
-	fprintf( stderr, "Could not open file 'out_of_study.csv'. Aborting...\n");
-	exit( EXIT_FAILURE );
-  }
-
-  
   // Step 1: Check study parameters for valid inputs
   //
   //   Do's:
   //     1.1 Both study start and study end dates must be valid
   //     1.2 Study start date must be older than study end date
   //     1.3 Study type must be a valid integer between 1 and 6
+  //     1.4 Study basis must be 365, 365.25 or 365.2425 days in a year
+  //     1.5 Each study listed in a manifest file must have its own output directory
   //
-  bool valid_study = true; 
-  study_parameters(argc, argv, &valid_study, &study);
+  bool valid_study = true;
+  study_parameters(argc, argv, &valid_study, &study, &n_study);
 
-  // if any condition 1.1, 1.2 or 1.3 above fails, print error and abort execution.
+  // if any condition 1.1 to 1.5 above fails, print error and abort execution.
   if ( valid_study == false ) {
 	fprintf( stderr, "Inconsistent study parameters. Exiting...\n" );
 	exit( EXIT_FAILURE );
   }
 
-  // Step 2: Read each line of stdin
-  char *line = NULL;
-  size_t len = 0;
-  ssize_t read = 0;
-  
-  read = getline(&line, &len, stdin);
-  while ( read >= 0  ) {
-	// Step 3: Tokenize line and store policy inputs into the struct ~policy~
-	tokenize( line, &policy);
-
-	// Step 4: Validate policy inputs and flag its exposure to study
-	//
-	//  Do's:
-	//    4.1  Date of birth must be a valid date
-	//    4.2  Policy issue date must be a valid date
-	//    4.3  Policy status code must be a valid integer between 1 and 6
-	//    4.4  Policy status date must be a valid date (when policy status code is not 1)
-	//    4.5  Date of birth must be older than study end date
-	//    4.6  Policy issue date must be older than policy status date (when policy status code is not 1)
-	//    4.7  Policy issue date must be older than study end date
-	//    4.8  Policy status date must be newer than study start date
-	//    4.9  Date of birth must be earlier than policy issue date
-	//
-	//  Result:  If any from 4.1-4.8 fails...
-	//    R1. Flag inconsistencies into log file ~out_of_study.csv~ ( FILE *f_out )
-	//    R2. Flag ~exposed_policy~to false
-	//
-	bool exposed_policy = true;
-	validate( study, policy, &exposed_policy, f_out );
-
-	// Step 5: Calculate exposure by policy year for policies exposed to study
-	// 
-	//  Export results into file ~exposures.csv~ ( FILE *f_exp ) and into well-formated stdout
-	if ( exposed_policy == true){
-
-	  // policy duration at start and at end
-	  double DS = duration_at_start( study, policy );
-	  double DE = duration_at_end(   study, policy );
-
-	  // exposure at policy year
-	  double E_t = 0;
-
-	  // age at issue
-	  int age_issue = age_at_issue( policy );
-
-	  // policy claim
-	  bool claim = false ;
-	  if ( strcmp( study->type, policy-> status_code) == 0 ) {
-		claim = true;
-	  }
-	  if ( strcmp( study->type, "3") == 0 && strcmp( policy->status_code, "4") == 0 ){
-		  claim = true ; // special case: in a death any cause study (PSC==3), accidental death (PSC==4) counts as a claim
-	  }
-	  int claim_year = (int) policy_claim_year( study, policy);
-
-	  // boundaries for policy year loop ahead ( DS < t < DE +1 )
-	  int from_t = 1 + (int) floor(DS);  // t > DS  (or t >= 1 + DS)
-	  int to_t   = (int) floor( DE + 1.0 ) ;  // t < DE + 1   (or t <= DE )
-	  
-	  // calculation of exposure for each policy year
-	  // E(t) = min(DE, t) - max(DS, t-1), for (t > DS) AND (t < DE+1) AND (TD > S) AND (ID < E)
-	  // 
-	  for (int t = from_t; t <= to_t; t++) {
-		// Exposure calculation
-		E_t = (
-			   ((DE < t) ? DE : t)  -  // minimum( DE, t)
-			   ((DS > t-1) ? DS : t-1) // maximum( DS, t-1)
-			   ); 
-		if ( (claim == true) && (t == claim_year ) ) {
-		  E_t = 1; // full exposure in the year when claim happened
-		}
-		// printf( "Id: %10s \tDS: %2.4f\tDE: %2.4f\tt: %3d\tClaim: %d\tE(t): %1.5f\n", policy->id, DS, DE, t, claim_year, E_t);
-		fprintf(
-				f_exp
-				,"%s;%d;%d;%d;%d;%f\n"
-				,policy->id
-				,age_issue
-				,t
-				,age_issue + t - 1 // attained age: age at issue + t - 1
-				,( (claim == true) && (t == claim_year ) ) ? 1 : 0 // actual
-				,E_t // exposure (to be used in the 'expected' calculation
-				);
-	  }
-	  
+  // Server mode (--listen): steps 2 to 7 run for each request, whose study and policies come from the client
+  if ( listen_path != NULL ){
+	serve( listen_path );
+	return EXIT_SUCCESS;
+  }
+
+  // File connections, one pair for each study
+  //
+  //  ~exposures.csv~ file with the exposures for each policyholder at each policy year in the experience study
+  //  ~out_of_study.csv~ file with the LOG of policies not exposed to study due to inconsistencies in their inputs
+  for (int k = 0; k < n_study; k++) {
+	open_study( &study[k] );
+  }
+
+  // Step 2: Read each line of stdin, one at a time (serial engine) or in batches shared by worker threads
+  //         (threaded engine, --threads=N), and run steps 3 to 6 on chunks of CHUNK_LINES of them (see ~process_lines()~).
+  //         stdin is read in large blocks by the line reader (lines.h), whose lines are views into the block
+  //         (or the input file given, or each of the input files given by a worker thread of its own, see ~files_str~)
+  int fd = ( input.gl_pathc == 1 ) ? open_input( input.gl_pathv[0] ) : 0;
+  line_reader *reader = ( follow_path == NULL && input.gl_pathc < 2 ) ? lines_open( fd, 0, read_ahead ) : NULL;
+  char **line = NULL;
+  size_t *len = NULL;
+  long n = 0;
+
+  arena = (policy_arena *) calloc( n_threads, sizeof(policy_arena) );
+  groups = (group_str *) calloc( n_threads, sizeof(group_str) );
+  if ( arena == NULL || groups == NULL ){
+	fprintf( stderr, "Could not allocate memory for ~arena~ pointer from within ~main()~ function. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+  for (int i = 0; i < n_threads; i++) {
+	group_init( &groups[i], grouping.n );
+  }
+  if ( perf_counters == true ){
+	perf = (perf_str *) calloc( n_threads, sizeof(perf_str) );
+	if ( perf == NULL ){
+	  fprintf( stderr, "Could not allocate memory for ~perf~ pointer from within ~main()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
 	}
+	for (int i = 0; i < n_threads; i++) {
+	  perf_init( &perf[i] );
+	}
+  }
 
-	// Step 6: Free memory of ~policy~ struct and its pointers to ~id~, ~date_of_birth~, ~issue_date~, ~status_code~ and ~status_date~
-	free( policy->id );
-	free( policy->date_of_birth );
-	free( policy->issue_date );
-	free( policy->status_code );
-	free( policy->status_date );
-	free( policy );
-	
-	// reads in next line from stdin
-	read = getline(&line, &len, stdin);
-  } // while
+  // progress of the run (--telemetry), through the size of the input when read from regular files
+  if ( tele_interval > 0 ){
+	long total_bytes = 0;
+	struct stat st;
+	for (size_t i = 0; i < input.gl_pathc; i++) {
+	  if ( stat( input.gl_pathv[i], &st ) == 0 && S_ISREG( st.st_mode ) ) total_bytes += st.st_size;
+	}
+	if ( input.gl_pathc == 0 && fstat( 0, &st ) == 0 && S_ISREG( st.st_mode ) ) total_bytes = st.st_size - lseek( 0, 0, SEEK_CUR );
+	tele = &telemetry;
+	tele_start( tele, tele_interval, tele_path, total_bytes );
+  }
+
+  if ( follow_path != NULL ) {
+	follow( follow_path );
+  } else if ( input.gl_pathc > 1 ) {
+	expose_files();
+  } else if ( n_threads > 1 ) {
+	expose_threaded( reader );
+  } else {
+	writer_str single[n_study];
+	writer_str *w_exp[n_study];
+	FILE *f_out[n_study];
+	for (int k = 0; k < n_study; k++) {
+	  writer_single( &single[k], study[k].f_exp );
+	  single[k].agg = ( aggregate == true ) ? &study[k].agg[0] : NULL;
+	  single[k].surv = ( survival == true ) ? &study[k].surv[0] : NULL;
+	  single[k].sample = ( sample_fraction < 1 ) ? &study[k].sample[0] : NULL;
+	  w_exp[k] = ( partition != PARTITION_NONE ) ? &study[k].w_part[0] : &single[k];
+	  f_out[k] = study[k].f_out;
+	}
+
+	while ( (n = lines_block( reader, &line, &len )) > 0 ) {
+	  if ( tele != NULL ) tele_read( tele, len, n );
+	  // lines at the top of stdin left out (--skip)
+	  long first = ( skip_lines < n ) ? skip_lines : n;
+	  skip_header( line, first );
+	  for (long i = first; i < n; i += CHUNK_LINES) {
+		process_lines( study, n_study, line + i, ( n - i < CHUNK_LINES ) ? n - i : CHUNK_LINES, w_exp, f_out, &arena[0], &groups[0], ( perf != NULL ) ? &perf[0] : NULL );
+	  }
+	} // while
+  }
 
   // Step 7: Free memory of allocated structs and pointers
-  //   7.1 ~line~, used to read lines of stdin 
-  free(line);
-  //   7.2 ~study~ struct and its pointers to ~start~, ~end~ and ~type~
-  free( study->start );
-  free( study->end   );
-  free( study->type  );
+  //   7.1 ~reader~, used to read lines of stdin (or of the input file), and the input files matched
+  if ( reader != NULL ) lines_close( reader );
+  if ( fd > 0 ) close( fd );
+  globfree( &input );
+  //       (and the telemetry thread, reporting a last time, --telemetry)
+  if ( tele != NULL ){
+	tele_stop( tele );
+	tele = NULL;
+  }
+  //       (and the performance counters, reported first, --perf-counters)
+  if ( perf != NULL ){
+	perf_report( perf, n_threads, stderr );
+	for (int i = 0; i < n_threads; i++) {
+	  perf_close( &perf[i] );
+	}
+	free( perf );
+  }
+  //       (the groups met by the worker threads are mapped into the groups of ~aggregate.csv~, --group-by)
+  if ( grouping.n > 0 ){
+	group_map = (long **) calloc( n_threads, sizeof(long *) );
+	if ( group_map == NULL ){
+	  fprintf( stderr, "Could not allocate memory for ~group_map~ pointer from within ~main()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+	n_groups = group_collect( groups, n_threads, &grouping, group_map, &group_label );
+  }
+  //   7.2 ~study~ structs and their pointers to ~start~, ~end~, ~type~ and ~output~,
+  //       closing file connections to ~exposures.csv~ and ~out_of_study.csv~ of each study
+  //       (and writing ~aggregate.csv~, --aggregate).
+  for (int k = 0; k < n_study; k++) {
+	close_study( &study[k] );
+  }
   free( study );
-
-  // Step 8: Close file connections to ~exposures.csv~ and ~out_of_study.csv~.
-  fclose(f_exp);
-  fclose(f_out);
+  //   7.3 arenas of the long IDs, and dictionaries and groups of the grouping columns
+  for (int i = 0; i < n_threads; i++) {
+	policy_arena_free( &arena[i] );
+	group_free( &groups[i], grouping.n );
+	if ( group_map != NULL ) free( group_map[i] );
+  }
+  free( arena );
+  free( groups );
+  free( group_map );
+  for (long g = 0; g < n_groups; g++) {
+	free( group_label[g] );
+  }
+  free( group_label );
+  group_by_free( &grouping );
 
   return EXIT_SUCCESS;
 } // main
@@ -261,119 +594,1105 @@ int main(int argc, char **argv){
 
 // --------------------------------------------------------------------------------------------------------------------------
 // declarations of functions
+void process_lines(
+				   study_str *st       // studies the lines are exposed to ...
+				   ,int n_st           // ... and their amount
+				   ,char **line        // lines read from stdin (at most CHUNK_LINES)
+				   ,long n             // amount of lines
+				   ,writer_str **w_exp // array of writers receiving the exposures, one per study
+				   ,FILE **f_out       // array of LOG files receiving the policies out of study, one per study
+				   ,policy_arena *a    // arena of the worker thread, receiving the long IDs
+				   ,group_str *g       // dictionaries of the worker thread, coding the groups (--group-by)
+				   ,perf_str *p        // counters of the worker thread (--perf-counters), NULL otherwise
+				   ){
+  // Step 3: Tokenize each line, packing its inputs into a compact record (policy.h) with its dates parsed once for all
+  //         studies. The records of the chunk (8 KB) stay in cache while every study goes over them; the fields as
+  //         read (views into the lines) are only needed for the LOG of the policies out of study
+  //         (~policy~ and ~field~ are local: worker threads of the threaded engine process chunks side by side).
+  //         The values of the grouping columns (--group-by) are coded into the group of the policy, and its amount
+  //         (--amount) parsed into hundredths.
+  //         Previewed on a sample (--sample), only the policies whose ID hashes into it are kept, each policy counting
+  //         into its stratum (issue year x status code) to scale the kept ones up
+  policy_str policy[n];
+  char *field[n][grouping.n_field];
+  int64_t amount[n];
+  bool kept[n];
+  int stratum[n];
+  policy_arena_reset( a );
+  if ( p != NULL ){
+	p->policies += n;
+	perf_mark( p, -1 );
+  }
+  for (long i = 0; i < n; i++) {
+	policy_split( line[i], field[i], grouping.n_field );
+	policy_pack( &policy[i], field[i], a );
+	amount[i] = ( grouping.amount_name != NULL ) ? policy_amount( field[i][grouping.amount] ) : 0;
+	if ( sample_fraction < 1 ){
+	  stratum[i] = sample_stratum_of( &policy[i] );
+	  kept[i] = sample_keep( policy_id( &policy[i] ), sample_fraction );
+	  if ( kept[i] == false ) continue;
+	}
+	if ( grouping.n > 0 ) policy[i].group = group_code( g, &grouping, field[i] );
+  }
+
+  if ( p != NULL ) perf_mark( p, PERF_TOKENIZE );
+
+  // Steps 4 and 5 are repeated for each study (of the manifest), sharing the tokenized and parsed policies: the
+  // policies of the chunk are all validated, then the valid ones exposed (counted once per chunk, --telemetry)
+  bool exposed_policy[n];
+  long validated = 0, rejected = 0, policy_years = 0;
+  for (int k = 0; k < n_st; k++) {
+	for (long i = 0; i < n; i++) {
+	  exposed_policy[i] = false;
+	  if ( sample_fraction < 1 ){
+		sample_count( w_exp[k]->sample, stratum[i], kept[i] );
+		if ( kept[i] == false ) continue;
+	  }
+
+	  // Step 4: Validate policy inputs and flag its exposure to study
+	  //
+	  //  Do's:
+	  //    4.1  Date of birth must be a valid date
+	  //    4.2  Policy issue date must be a valid date
+	  //    4.3  Policy status code must be a valid integer between 1 and 6
+	  //    4.4  Policy status date must be a valid date (when policy status code is not 1)
+	  //    4.5  Date of birth must be older than study end date
+	  //    4.6  Policy issue date must be older than policy status date (when policy status code is not 1)
+	  //    4.7  Policy issue date must be older than study end date
+	  //    4.8  Policy status date must be newer than study start date
+	  //    4.9  Date of birth must be earlier than policy issue date
+	  //
+	  //  Result:  If any from 4.1-4.8 fails...
+	  //    R1. Flag inconsistencies into log file ~out_of_study.csv~ of the study ( FILE *f_out )
+	  //    R2. Flag ~exposed_policy~to false
+	  //
+	  exposed_policy[i] = true;
+	  validate( &st[k], &policy[i], amount[i], field[i], &exposed_policy[i], f_out[k] );
+	  validated++;
+	  if ( exposed_policy[i] == false ) rejected++;
+	}
+	if ( p != NULL ) perf_mark( p, PERF_VALIDATE );
+
+	for (long i = 0; i < n; i++) {
+	  // Step 5: Calculate exposure by policy year for policies exposed to study
+	  //
+	  //  Export results into file ~exposures.csv~ of the study, or into its partitions ( writer_str *w_exp )
+	  if ( exposed_policy[i] == true){
+		policy_years += expose( &st[k], &policy[i], amount[i], w_exp[k] );
+	  }
+	}
+	if ( p != NULL ) perf_mark( p, PERF_EXPOSE );
+  }
+  if ( tele != NULL ){
+	TELE_ADD( tele, validated, validated );
+	TELE_ADD( tele, rejected, rejected );
+	TELE_ADD( tele, policy_years, policy_years );
+  }
+
+  // Step 6: Nothing to free: the records live on the stack and the long IDs in the arena, reused by the next chunk
+}
+
+void expose_chunk(
+				  void *arg           // batch of lines read from stdin (~batch_str~)
+				  ,int worker         // worker thread running the chunk (owner of the partition files part-K.csv)
+				  ,long c             // index of the chunk within the batch
+				  ){
+  // task of the work-stealing scheduler: runs ~process_lines()~ on the lines of chunk ~c~, writing into
+  // memory buffers of the chunk, which are later written to the files of each study in the order of stdin
+  // (partitioned exposures are written by each worker into its own files instead)
+
+  batch_str *batch = (batch_str *) arg;
+  chunk_str *chunk = &batch->chunk[c];
+  FILE *f_exp[n_study];
+  FILE *f_out[n_study];
+  writer_str single[n_study];
+  writer_str *w_exp[n_study];
+
+  for (int k = 0; k < n_study; k++) {
+	// partitioned exposures go straight into the files of the worker (part-K.csv), in no particular order
+	f_exp[k] = NULL;
+	if ( partition != PARTITION_NONE ){
+	  w_exp[k] = &study[k].w_part[worker];
+	} else {
+	  if ( exposures == true ){
+		f_exp[k] = open_memstream( &chunk->exp_buf[k], &chunk->exp_len[k] );
+	  }
+	  writer_single( &single[k], f_exp[k] );
+	  single[k].agg = ( aggregate == true ) ? &study[k].agg[worker] : NULL;
+	  single[k].surv = ( survival == true ) ? &study[k].surv[worker] : NULL;
+	  single[k].sample = ( sample_fraction < 1 ) ? &study[k].sample[worker] : NULL;
+	  w_exp[k] = &single[k];
+	}
+	f_out[k] = open_memstream( &chunk->out_buf[k], &chunk->out_len[k] );
+	if ( ( partition == PARTITION_NONE && exposures == true && f_exp[k] == NULL ) || f_out[k] == NULL ){
+	  fprintf( stderr, "Could not open memory buffers from within ~expose_chunk()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+  }
+
+  long last = (c + 1) * CHUNK_LINES;
+  if ( last > batch->n ) last = batch->n;
+  process_lines( study, n_study, batch->line + c * CHUNK_LINES, last - c * CHUNK_LINES, w_exp, f_out, &arena[worker], &groups[worker], ( perf != NULL ) ? &perf[worker] : NULL );
+
+  // closing the memory streams sets the buffers and their lengths
+  for (int k = 0; k < n_study; k++) {
+	if ( f_exp[k] != NULL ) fclose( f_exp[k] );
+	fclose( f_out[k] );
+  }
+}
+
+void expose_threaded(
+					 line_reader *reader // line reader of stdin, one block of lines per batch
+					 ){
+  // threaded engine: reads stdin in batches of lines (a block of the line reader each), split in chunks of CHUNK_LINES
+  // lines which the worker threads share through the work-stealing scheduler (sched.h). Policies issued long before
+  // the study start expand into many more policy years than recent ones, so chunks take uneven time: idle workers
+  // steal the pending chunks of the busy ones. Each chunk writes into its own memory buffers, written to the files of
+  // the studies in the order of stdin, so the results do not depend on the amount of threads.
+  //
+  // Reading, exposing and writing are the stages of a pipeline (see PIPE_BATCHES): while the workers expose a batch,
+  // the read stage gets the next one ready and the write stage writes the previous one.
+
+  sched_pool *pool = sched_new( n_threads );
+  if ( pool == NULL ){
+	fprintf( stderr, "Could not allocate memory for the scheduler from within ~expose_threaded()~ function. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+
+  pipe_str pipe;
+  pipe.reader  = reader;
+  pipe.empty   = queue_new( PIPE_BATCHES );
+  pipe.read    = queue_new( PIPE_BATCHES );
+  pipe.exposed = queue_new( PIPE_BATCHES );
+
+  batch_str batch[PIPE_BATCHES];
+  for (int b = 0; b < PIPE_BATCHES; b++) {
+	batch[b].chunk = NULL;
+	batch[b].n_chunk_max = 0;
+	queue_push( pipe.empty, &batch[b] );
+  }
+
+  pthread_t reading, writing;
+  if ( pthread_create( &reading, NULL, read_stage, &pipe ) != 0 || pthread_create( &writing, NULL, write_stage, &pipe ) != 0 ){
+	fprintf( stderr, "Could not start the stages of the pipeline from within ~expose_threaded()~ function. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+
+  // expose stage
+  batch_str *b;
+  while ( (b = (batch_str *) queue_pop( pipe.read )) != NULL ) {
+	b->n_chunk = (b->n + CHUNK_LINES - 1) / CHUNK_LINES;
+
+	// blocks hold as many lines as fit in their bytes: grow the chunks with the largest batch
+	if ( b->n_chunk > b->n_chunk_max ){
+	  b->chunk = (chunk_str *) realloc( b->chunk, b->n_chunk * sizeof(chunk_str) );
+	  if ( b->chunk == NULL ){
+		fprintf( stderr, "Could not allocate memory for batches from within ~expose_threaded()~ function. Aborting...\n");
+		exit( EXIT_FAILURE );
+	  }
+	  for (long c = b->n_chunk_max; c < b->n_chunk; c++) {
+		b->chunk[c].exp_buf = (char **) calloc( n_study, sizeof(char *) );
+		b->chunk[c].out_buf = (char **) calloc( n_study, sizeof(char *) );
+		b->chunk[c].exp_len = (size_t *) calloc( n_study, sizeof(size_t) );
+		b->chunk[c].out_len = (size_t *) calloc( n_study, sizeof(size_t) );
+		if ( b->chunk[c].exp_buf == NULL || b->chunk[c].out_buf == NULL || b->chunk[c].exp_len == NULL || b->chunk[c].out_len == NULL ){
+		  fprintf( stderr, "Could not allocate memory for chunks from within ~expose_threaded()~ function. Aborting...\n");
+		  exit( EXIT_FAILURE );
+		}
+	  }
+	  b->n_chunk_max = b->n_chunk;
+	}
+
+	if ( b->n_chunk > 0 ) sched_run( pool, b->n_chunk, expose_chunk, b );
+
+	// the lines are no longer needed: their block goes back to the line reader
+	lines_release( reader, b->block );
+	queue_push( pipe.exposed, b );
+  }
+  queue_close( pipe.exposed );
+
+  pthread_join( reading, NULL );
+  pthread_join( writing, NULL );
+
+  if ( report_sched == true ){
+	sched_report( pool, stderr );
+  }
+
+  for (int i = 0; i < PIPE_BATCHES; i++) {
+	for (long c = 0; c < batch[i].n_chunk_max; c++) {
+	  free( batch[i].chunk[c].exp_buf );
+	  free( batch[i].chunk[c].out_buf );
+	  free( batch[i].chunk[c].exp_len );
+	  free( batch[i].chunk[c].out_len );
+	}
+	free( batch[i].chunk );
+  }
+  queue_free( pipe.empty );
+  queue_free( pipe.read );
+  queue_free( pipe.exposed );
+  sched_free( pool );
+}
+
+void *read_stage(
+				 void *arg           // queues of the pipeline (~pipe_str~)
+				 ){
+  // fills the empty batches with the next blocks of lines of stdin, leaving out its first lines (--skip)
+  pipe_str *pipe = (pipe_str *) arg;
+  batch_str *b;
+  size_t *len;
+  while ( (b = (batch_str *) queue_pop( pipe->empty )) != NULL ) {
+	b->n = lines_take( pipe->reader, &b->line, &len, &b->block );
+	if ( b->n == 0 ) break;
+	if ( tele != NULL ) tele_read( tele, len, b->n );
+	if ( skip_lines > 0 ){
+	  long k = ( skip_lines < b->n ) ? skip_lines : b->n;
+	  skip_header( b->line, k );
+	  b->line += k;
+	  b->n -= k;
+	}
+	queue_push( pipe->read, b );
+  }
+  queue_close( pipe->read );
+  return NULL;
+}
+
+void *write_stage(
+				  void *arg           // queues of the pipeline (~pipe_str~)
+				  ){
+  // writes the buffers of the chunks of each exposed batch in the order of stdin, then hands the batch back
+  pipe_str *pipe = (pipe_str *) arg;
+  batch_str *b;
+  while ( (b = (batch_str *) queue_pop( pipe->exposed )) != NULL ) {
+	for (long c = 0; c < b->n_chunk; c++) {
+	  for (int k = 0; k < n_study; k++) {
+		if ( b->chunk[c].exp_buf[k] != NULL ){
+		  fwrite( b->chunk[c].exp_buf[k], 1, b->chunk[c].exp_len[k], study[k].f_exp );
+		  free( b->chunk[c].exp_buf[k] );
+		  b->chunk[c].exp_buf[k] = NULL;
+		}
+		fwrite( b->chunk[c].out_buf[k], 1, b->chunk[c].out_len[k], study[k].f_out );
+		free( b->chunk[c].out_buf[k] );
+	  }
+	}
+	queue_push( pipe->empty, b );
+  }
+  return NULL;
+}
+
+void skip_header(
+				 char **line         // lines at the top of stdin left out (--skip)
+				 ,long n             // amount of lines
+				 ){
+  // the first line of stdin, when left out, is its header: grouping columns given by name are found there
+  if ( n > 0 && skip_lines == skip_total && group_by_named( &grouping ) ){
+	if ( group_by_header( &grouping, line[0] ) == false ){
+	  fprintf( stderr, "Inconsistent study parameters. Exiting...\n" );
+	  exit( EXIT_FAILURE );
+	}
+  }
+  skip_lines -= n;
+}
+
+int open_input(
+			   char *path          // input file
+			   ){
+  int fd = open( path, O_RDONLY );
+  if ( fd < 0 ){
+	fprintf( stderr, "Could not open input file '%s'. Aborting...\n", path );
+	exit( EXIT_FAILURE );
+  }
+  return fd;
+}
+
+// input files shared by the worker threads
+files_str files;
+
+void expose_files(
+				  ){
+  // multi-file engine: one worker thread per file at a time (see ~files_str~). Grouping columns given by name are
+  // found in the header of the first file, left out as the header of every file (--skip)
+  if ( group_by_named( &grouping ) ){
+	FILE *f = fopen( input.gl_pathv[0], "r" );
+	char *header = NULL;
+	size_t cap = 0;
+	ssize_t n = ( f != NULL ) ? getline( &header, &cap, f ) : -1;
+	if ( n > 0 && header[n-1] == '\n' ) header[n-1] = '\0';
+	if ( n < 0 || group_by_header( &grouping, header ) == false ){
+	  fprintf( stderr, "Inconsistent study parameters. Exiting...\n" );
+	  exit( EXIT_FAILURE );
+	}
+	free( header );
+	fclose( f );
+  }
+
+  files.next = 0;
+  files.written = 0;
+  pthread_mutex_init( &files.lock, NULL );
+  pthread_cond_init( &files.turn, NULL );
+
+  pthread_t worker[n_threads];
+  for (int i = 0; i < n_threads; i++) {
+	if ( pthread_create( &worker[i], NULL, file_worker, (void *) (intptr_t) i ) != 0 ){
+	  fprintf( stderr, "Could not start the worker threads from within ~expose_files()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+  }
+  for (int i = 0; i < n_threads; i++) {
+	pthread_join( worker[i], NULL );
+  }
+  pthread_mutex_destroy( &files.lock );
+  pthread_cond_destroy( &files.turn );
+}
+
+void *file_worker(
+				  void *arg           // worker thread (~intptr_t~), taking files from ~files~
+				  ){
+  int worker = (int) (intptr_t) arg;
+  writer_str single[n_study];
+  writer_str *w_exp[n_study];
+  char **line = NULL;
+  size_t *len = NULL;
+  long n = 0;
+  long i;
+  FILE *f_exp[n_study];
+  FILE *f_out[n_study];
+  char buf[1 << 16];
+  size_t got;
+
+  while ( (i = __atomic_fetch_add( &files.next, 1, __ATOMIC_RELAXED )) < (long) input.gl_pathc ) {
+	// written straight into the files of each study when its turn already came (no file before it left unwritten)
+	pthread_mutex_lock( &files.lock );
+	bool spilled = ( files.written < i );
+	pthread_mutex_unlock( &files.lock );
+	for (int k = 0; k < n_study; k++) {
+	  f_exp[k] = spilled ? NULL : study[k].f_exp;
+	  // partitioned exposures go straight into the files of the worker (part-K.csv), as in the threaded engine
+	  if ( partition != PARTITION_NONE ){
+		w_exp[k] = &study[k].w_part[worker];
+	  } else {
+		if ( spilled && exposures == true ) f_exp[k] = tmpfile();
+		writer_single( &single[k], f_exp[k] );
+		single[k].agg = ( aggregate == true ) ? &study[k].agg[worker] : NULL;
+		single[k].surv = ( survival == true ) ? &study[k].surv[worker] : NULL;
+		single[k].sample = ( sample_fraction < 1 ) ? &study[k].sample[worker] : NULL;
+		w_exp[k] = &single[k];
+	  }
+	  f_out[k] = spilled ? tmpfile() : study[k].f_out;
+	  if ( ( partition == PARTITION_NONE && exposures == true && f_exp[k] == NULL ) || f_out[k] == NULL ){
+		fprintf( stderr, "Could not open spill files from within ~file_worker()~ function. Aborting...\n");
+		exit( EXIT_FAILURE );
+	  }
+	}
+
+	int fd = open_input( input.gl_pathv[i] );
+	line_reader *reader = lines_open( fd, 0, read_ahead );
+	long skip = skip_total;
+	while ( (n = lines_block( reader, &line, &len )) > 0 ) {
+	  if ( tele != NULL ) tele_read( tele, len, n );
+	  // lines at the top of the file left out (--skip)
+	  long first = ( skip < n ) ? skip : n;
+	  skip -= first;
+	  for (long j = first; j < n; j += CHUNK_LINES) {
+		process_lines( study, n_study, line + j, ( n - j < CHUNK_LINES ) ? n - j : CHUNK_LINES, w_exp, f_out, &arena[worker], &groups[worker], ( perf != NULL ) ? &perf[worker] : NULL );
+	  }
+	}
+	lines_close( reader );
+	close( fd );
+
+	// its turn: the spill files appended to the files of each study, then the next file may be written
+	pthread_mutex_lock( &files.lock );
+	while ( files.written < i ) {
+	  pthread_cond_wait( &files.turn, &files.lock );
+	}
+	pthread_mutex_unlock( &files.lock );
+	for (int k = 0; k < n_study && spilled; k++) {
+	  FILE *spill[2] = { f_exp[k], f_out[k] };
+	  FILE *into[2] = { study[k].f_exp, study[k].f_out };
+	  for (int j = 0; j < 2; j++) {
+		if ( spill[j] == NULL ) continue;
+		rewind( spill[j] );
+		while ( (got = fread( buf, 1, sizeof(buf), spill[j] )) > 0 ) {
+		  fwrite( buf, 1, got, into[j] );
+		}
+		fclose( spill[j] );
+	  }
+	}
+	pthread_mutex_lock( &files.lock );
+	files.written = i + 1;
+	pthread_cond_broadcast( &files.turn );
+	pthread_mutex_unlock( &files.lock );
+  }
+  return NULL;
+}
+
+// server mode: requests being served (up to SERVE_CLIENTS), and the socket to be removed once the server is stopped
+sem_t serving;
+char *socket_path = NULL;
+
+static void stop_serving( int sig ){
+  unlink( socket_path );
+  _exit( EXIT_SUCCESS );
+}
+
+void serve(
+		   char *path          // path of the Unix domain socket to listen on
+		   ){
+  // listens on the socket until stopped (SIGINT or SIGTERM), handing each connection to a thread of its own
+  struct sockaddr_un addr;
+  memset( &addr, 0, sizeof(addr) );
+  addr.sun_family = AF_UNIX;
+  if ( strlen( path ) >= sizeof(addr.sun_path) ){
+	fprintf( stderr, "Socket path '%s' is too long. Aborting...\n", path );
+	exit( EXIT_FAILURE );
+  }
+  strcpy( addr.sun_path, path );
+
+  int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+  unlink( path ); // left behind by a server not stopped cleanly
+  if ( fd < 0 || bind( fd, (struct sockaddr *) &addr, sizeof(addr) ) != 0 || listen( fd, SOMAXCONN ) != 0 ){
+	fprintf( stderr, "Could not listen on socket '%s'. Aborting...\n", path );
+	exit( EXIT_FAILURE );
+  }
+  socket_path = path;
+  signal( SIGINT, stop_serving );
+  signal( SIGTERM, stop_serving );
+  signal( SIGPIPE, SIG_IGN );  // a client gone away is seen as a failed write instead
+  sem_init( &serving, 0, SERVE_CLIENTS );
+
+  while (1) {
+	sem_wait( &serving );
+	int client = accept( fd, NULL, NULL );
+	if ( client < 0 ){
+	  sem_post( &serving );
+	  if ( errno == EINTR || errno == ECONNABORTED ) continue;
+	  fprintf( stderr, "Could not accept connections on socket '%s'. Aborting...\n", path );
+	  exit( EXIT_FAILURE );
+	}
+	pthread_t t;
+	if ( pthread_create( &t, NULL, serve_request, (void *) (intptr_t) client ) != 0 ){
+	  fprintf( stderr, "Could not start the thread of a request from within ~serve()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+	pthread_detach( t );
+  }
+}
+
+void *serve_request(
+					void *arg           // connection of a client (file descriptor)
+					){
+  // one study per connection: its parameters in the first line (start;end;type;basis;mode), then its policies up to
+  // the end of the input of the client (e.g. shutdown(SHUT_WR)). The exposures are sent back as each block of policies
+  // is exposed, as in ~exposures.csv~, followed by the sections of the LOG of the policies out of study and, by mode
+  // (exposures, aggregate or all), of the aggregate, as in ~out_of_study.csv~ and ~aggregate.csv~:
+  //
+  //   <exposures>
+  //   #out_of_study
+  //   <LOG>
+  //   #aggregate
+  //   <aggregate>
+  //   #end
+  //
+  // or #error and its reason, when the parameters of the study are not valid.
+  static long requests = 0;
+  int fd = (int) (intptr_t) arg;
+  long id = __atomic_add_fetch( &requests, 1, __ATOMIC_RELAXED );
+  line_reader *reader = lines_open( fd, SERVE_BLOCK, false );
+  FILE *f = fdopen( fd, "w" );
+  if ( f == NULL ){
+	fprintf( stderr, "Could not open the connection of request %ld from within ~serve_request()~ function. Aborting...\n", id );
+	exit( EXIT_FAILURE );
+  }
+
+  char **line;
+  size_t *len;
+  long n = lines_block( reader, &line, &len );
+
+  // Step 1: Check study parameters for valid inputs (see main)
+  study_str st;
+  memset( &st, 0, sizeof(study_str) );
+  bool ok = ( n > 0 );
+  bool send_exp = true, send_agg = false;
+  if ( ok == true ){
+	char *field[POLICY_FIELDS];
+	char where[64];
+	snprintf( where, sizeof(where), "Request %ld: ", id );
+	policy_split( line[0], field, POLICY_FIELDS );
+	set_study( &st, field[0], field[1], field[2], field[3], NULL, &ok, where );
+	if ( strcmp( field[4], "aggregate" ) == 0 ){
+	  send_exp = false;
+	  send_agg = true;
+	} else if ( strcmp( field[4], "all" ) == 0 ){
+	  send_agg = true;
+	} else if ( field[4][0] != '\0' && strcmp( field[4], "exposures" ) != 0 ){
+	  fprintf( stderr, "%sMode must be exposures, aggregate or all.\n", where );
+	  ok = false;
+	}
+  }
+  if ( ok == false ){
+	fprintf( f, "#error Inconsistent study parameters (start;end;type;basis;mode expected)\n" );
+  } else {
+	// Steps 2 to 6 over the policies of the request, by chunks of CHUNK_LINES, with the buffers of its thread
+	char *out_buf = NULL;
+	size_t out_len = 0;
+	st.f_out = open_memstream( &out_buf, &out_len );
+	agg_str cube;
+	if ( send_agg == true ){
+	  agg_init( &cube, agg_periods, grouping.amount_name != NULL );
+	}
+	policy_arena a;
+	group_str g;
+	memset( &a, 0, sizeof(policy_arena) );
+	group_init( &g, grouping.n );
+	writer_str single;
+	writer_single( &single, ( send_exp == true ) ? f : NULL );
+	single.agg = ( send_agg == true ) ? &cube : NULL;
+	writer_str *w_exp[1] = { &single };
+	FILE *f_out[1] = { st.f_out };
+	if ( st.f_out == NULL ){
+	  fprintf( stderr, "Could not open memory buffers from within ~serve_request()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+
+	long first = 1;  // the parameters of the study
+	do {
+	  for (long i = first; i < n; i += CHUNK_LINES) {
+		process_lines( &st, 1, line + i, ( n - i < CHUNK_LINES ) ? n - i : CHUNK_LINES, w_exp, f_out, &a, &g, NULL );
+	  }
+	  fflush( f );
+	  first = 0;
+	} while ( (n = lines_block( reader, &line, &len )) > 0 );
+
+	fclose( st.f_out );
+	fprintf( f, "#out_of_study\n" );
+	fwrite( out_buf, 1, out_len, f );
+	free( out_buf );
+
+	if ( send_agg == true ){
+	  // groups coded by this request only (--group-by)
+	  long *map = NULL;
+	  char **label = NULL;
+	  long n_label = 0;
+	  if ( grouping.n > 0 ){
+		agg_str total;
+		agg_init( &total, cube.periods, cube.amounts );
+		n_label = group_collect( &g, 1, &grouping, &map, &label );
+		agg_merge( &total, &cube, map );
+		agg_free( &cube );
+		cube = total;
+	  }
+	  fprintf( f, "#aggregate\n" );
+	  agg_write( &cube, f, label );
+	  agg_free( &cube );
+	  for (long k = 0; k < n_label; k++) {
+		free( label[k] );
+	  }
+	  free( label );
+	  free( map );
+	}
+	policy_arena_free( &a );
+	group_free( &g, grouping.n );
+  }
+  fprintf( f, "#end\n" );
+
+  // Step 7: Free memory (the reader leaves the connection open, closed with its stream)
+  lines_close( reader );
+  fclose( f );
+  free( st.start );
+  free( st.end );
+  free( st.type );
+  free( st.output );
+  sem_post( &serving );
+  return NULL;
+}
+
+// follow mode: stopped by SIGINT or SIGTERM, once the lines read so far are added up
+volatile sig_atomic_t following = 1;
+
+static void stop_following( int sig ){
+  following = 0;
+}
+
+static double now_seconds(void){
+  struct timespec t;
+  clock_gettime( CLOCK_MONOTONIC, &t );
+  return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+void follow(
+			char *path          // path of the file followed as it grows
+			){
+  // reads the complete lines of the file up to its current end, then waits (inotify) for more to be appended,
+  // publishing the aggregates of the studies every ~snapshot_every~ seconds when they changed. A last line still
+  // without its '\n' waits for the rest of it. The file truncated is read again from its start (its policies then
+  // replace themselves); the file moved or deleted ends the run, as SIGINT or SIGTERM do
+  int fd = open( path, O_RDONLY );
+  int watch = inotify_init1( IN_CLOEXEC );
+  if ( fd < 0 || watch < 0 || inotify_add_watch( watch, path, IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF ) < 0 ){
+	fprintf( stderr, "Could not follow file '%s'. Aborting...\n", path );
+	exit( EXIT_FAILURE );
+  }
+  struct sigaction sa;
+  memset( &sa, 0, sizeof(sa) );
+  sa.sa_handler = stop_following;  // no SA_RESTART: poll() returns on the signal
+  sigaction( SIGINT, &sa, NULL );
+  sigaction( SIGTERM, &sa, NULL );
+
+  // writers of each study into its aggregate, and of the policy years taken back (subtracted after each read)
+  writer_str single[n_study], back[n_study];
+  writer_str *w_exp[n_study], *w_back[n_study];
+  agg_str taken[n_study];
+  FILE *f_out[n_study];
+  for (int k = 0; k < n_study; k++) {
+	agg_init( &taken[k], agg_periods, grouping.amount_name != NULL );
+	writer_single( &single[k], NULL );
+	single[k].agg = &study[k].agg[0];
+	writer_single( &back[k], NULL );
+	back[k].agg = &taken[k];
+	w_exp[k] = &single[k];
+	w_back[k] = &back[k];
+	f_out[k] = study[k].f_out;
+  }
+  GHashTable *followed = g_hash_table_new_full( g_str_hash, g_str_equal, g_free, g_free );
+
+  size_t cap = FOLLOW_BLOCK, have = 0;
+  off_t offset = 0;
+  char *buf = (char *) malloc( cap + 1 );
+  long cap_line = 4096;
+  char **line = (char **) malloc( cap_line * sizeof(char *) );
+  if ( buf == NULL || line == NULL ){
+	fprintf( stderr, "Could not allocate memory for ~buf~ pointer from within ~follow()~ function. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+  bool changed = false, gone = false;
+  double next = now_seconds();
+
+  while ( following ) {
+	ssize_t k = read( fd, buf + have, cap - have );
+	if ( k < 0 ){
+	  if ( errno == EINTR ) continue;
+	  fprintf( stderr, "Could not read file '%s'. Aborting...\n", path );
+	  exit( EXIT_FAILURE );
+	}
+	if ( k > 0 ){
+	  // complete lines, each '\n' turned into '\0' as by the line reader; the rest waits for the next read
+	  have += k;
+	  offset += k;
+	  long n = 0;
+	  char *p = buf, *end = buf + have, *nl;
+	  while ( (nl = memchr( p, '\n', end - p )) != NULL ) {
+		*nl = '\0';
+		if ( n == cap_line ){
+		  cap_line *= 2;
+		  line = (char **) realloc( line, cap_line * sizeof(char *) );
+		  if ( line == NULL ){
+			fprintf( stderr, "Could not allocate memory for ~line~ pointer from within ~follow()~ function. Aborting...\n");
+			exit( EXIT_FAILURE );
+		  }
+		}
+		line[n++] = p;
+		p = nl + 1;
+	  }
+	  long first = ( skip_lines < n ) ? skip_lines : n;
+	  skip_header( line, first );
+	  for (long i = first; i < n; i += CHUNK_LINES) {
+		follow_lines( followed, line + i, ( n - i < CHUNK_LINES ) ? n - i : CHUNK_LINES, w_exp, w_back, f_out );
+	  }
+	  for (int j = 0; j < n_study && n > first; j++) {
+		agg_sub( &study[j].agg[0], &taken[j] );
+		agg_clear( &taken[j] );
+	  }
+	  changed = changed || ( n > first );
+	  have = end - p;
+	  memmove( buf, p, have );
+	  // a line longer than the buffer grows it
+	  if ( have == cap ){
+		cap *= 2;
+		buf = (char *) realloc( buf, cap + 1 );
+		if ( buf == NULL ){
+		  fprintf( stderr, "Could not allocate memory for ~buf~ pointer from within ~follow()~ function. Aborting...\n");
+		  exit( EXIT_FAILURE );
+		}
+	  }
+	  continue;
+	}
+
+	// at the end of the file, for now
+	if ( gone ) break;
+	struct stat st;
+	if ( fstat( fd, &st ) != 0 || st.st_nlink == 0 ) break;  // deleted (kept open here: no IN_DELETE_SELF)
+	if ( st.st_size < offset ){
+	  fprintf( stderr, "File '%s' was truncated: reading it again from its start.\n", path );
+	  lseek( fd, 0, SEEK_SET );
+	  offset = 0;
+	  have = 0;
+	  continue;
+	}
+	double t = now_seconds();
+	if ( changed && t >= next ){
+	  for (int j = 0; j < n_study; j++) {
+		fflush( study[j].f_out );
+		snapshot( &study[j] );
+	  }
+	  changed = false;
+	  next = t + snapshot_every;
+	  t = now_seconds();
+	}
+	struct pollfd pfd = { watch, POLLIN, 0 };
+	int timeout = changed ? (int) ( 1000 * ( next - t ) ) + 1 : -1;
+	if ( poll( &pfd, 1, timeout ) > 0 ){
+	  char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	  ssize_t m = read( watch, events, sizeof(events) );
+	  for (char *e = events; m > 0 && e < events + m; e += sizeof(struct inotify_event) + ((struct inotify_event *) e)->len) {
+		if ( ((struct inotify_event *) e)->mask & IN_MOVE_SELF ) gone = true;
+	  }
+	}
+  }
+
+  for (int k = 0; k < n_study; k++) {
+	agg_free( &taken[k] );
+  }
+  g_hash_table_destroy( followed );
+  free( buf );
+  free( line );
+  close( watch );
+  close( fd );
+}
+
+void follow_lines(
+				  GHashTable *followed // last line of each policy seen, by ID (~followed_str~)
+				  ,char **line        // new lines of the file (at most CHUNK_LINES)
+				  ,long n             // amount of lines
+				  ,writer_str **w_exp // writers adding the exposures into the aggregate, one per study
+				  ,writer_str **w_back // writers adding the exposures taken back, one per study
+				  ,FILE **f_out       // LOG files receiving the policies out of study, one per study
+				  ){
+  // Step 3 as in ~process_lines()~, then steps 4 and 5 line by line (a policy may change twice in the chunk)
+  policy_str policy[n];
+  char *field[n][grouping.n_field];
+  int64_t amount[n];
+  policy_arena_reset( &arena[0] );
+  for (long i = 0; i < n; i++) {
+	policy_split( line[i], field[i], grouping.n_field );
+	policy_pack( &policy[i], field[i], &arena[0] );
+	amount[i] = ( grouping.amount_name != NULL ) ? policy_amount( field[i][grouping.amount] ) : 0;
+	if ( grouping.n > 0 ) policy[i].group = group_code( &groups[0], &grouping, field[i] );
+  }
+
+  for (long i = 0; i < n; i++) {
+	// the earlier line of the policy, if any, is taken back out of the studies it was exposed to
+	const char *id = policy_id( &policy[i] );
+	gpointer key, value;
+	followed_str *f;
+	if ( g_hash_table_lookup_extended( followed, id, &key, &value ) ){
+	  f = (followed_str *) value;
+	  for (int k = 0; k < n_study; k++) {
+		if ( f->exposed & ( (uint64_t) 1 << k ) ) expose( &study[k], &f->policy, f->amount, w_back[k] );
+	  }
+	} else {
+	  key = g_strdup( id );
+	  f = g_new( followed_str, 1 );
+	  g_hash_table_insert( followed, key, f );
+	}
+
+	f->exposed = 0;
+	for (int k = 0; k < n_study; k++) {
+	  bool exposed_policy = true;
+	  validate( &study[k], &policy[i], amount[i], field[i], &exposed_policy, f_out[k] );
+	  if ( exposed_policy == true ){
+		expose( &study[k], &policy[i], amount[i], w_exp[k] );
+		f->exposed |= (uint64_t) 1 << k;
+	  }
+	}
+
+	// kept beyond the arena of the chunk: a long ID points into the key instead
+	f->policy = policy[i];
+	f->amount = amount[i];
+	if ( f->policy.id[POLICY_ID_INLINE] == POLICY_ID_SPILLED ){
+	  memcpy( f->policy.id, &key, sizeof(key) );
+	}
+  }
+}
+
+void snapshot(
+			  study_str *study    // study whose aggregate is published into ~aggregate.csv~
+			  ){
+  // written aside then renamed over ~aggregate.csv~: readers see either the previous snapshot or this one
+  agg_str *a = &study->agg[0];
+  agg_str total;
+  long *map = NULL;
+  char **label = NULL;
+  long n_label = 0;
+  if ( grouping.n > 0 ){
+	n_label = group_collect( &groups[0], 1, &grouping, &map, &label );
+	agg_init( &total, a->periods, a->amounts );
+	agg_merge( &total, a, map );
+	a = &total;
+  }
+
+  char *fname = (char *) malloc( strlen(study->output) + strlen("/aggregate.csv.tmp") + 1 );
+  char *tname = (char *) malloc( strlen(study->output) + strlen("/aggregate.csv.tmp") + 1 );
+  if ( fname == NULL || tname == NULL ){
+	fprintf( stderr, "Could not allocate memory for file names from within ~snapshot()~ function. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+  sprintf( fname, "%s/aggregate.csv", study->output );
+  sprintf( tname, "%s/aggregate.csv.tmp", study->output );
+  FILE *f_agg = fopen( tname, "w" );
+  if( f_agg == NULL ){
+	fprintf( stderr, "Could not open file '%s'. Aborting...\n", tname );
+	exit( EXIT_FAILURE );
+  }
+  agg_write( a, f_agg, label );
+  if ( fclose( f_agg ) != 0 || rename( tname, fname ) != 0 ){
+	fprintf( stderr, "Could not write file '%s'. Aborting...\n", fname );
+	exit( EXIT_FAILURE );
+  }
+
+  if ( grouping.n > 0 ) agg_free( &total );
+  for (long g = 0; g < n_label; g++) {
+	free( label[g] );
+  }
+  free( label );
+  free( map );
+  free( fname );
+  free( tname );
+}
+
 void study_parameters(
 					  int argc            // amount of command-line arguments
 					  ,char **argv        // array of command-line arguments
 					  ,bool *ok           // flag for validity of study based on the parameters given by the user
-					  ,study_str **study  // pointer to pointer to struct containing pointers to parameters
+					  ,study_str **study  // pointer to array of structs containing pointers to parameters, one per study
+					  ,int *n_study       // pointer to the amount of studies read (1, or the lines of the manifest file)
 					  ){
 
-  // Read the command line arguments --start=YYYY-MM-DD --end=YYYY-MM-DD --type=int
-  // and return ~false~ to the variable ~valid_study~ in main() in case of any errors
+  // Read the command line arguments --start=YYYY-MM-DD --end=YYYY-MM-DD --type=int [--basis=days] [--output=dir]
+  // or --manifest=FILE, plus the run options [--threads=N] [--sched-stats] [--perf-counters] [--partition-by=column]
+  // [--read-ahead] [--skip=N] [--aggregate] [--aggregate-only] [--group-by=col,...] [--survival] [--graduate=h[,v]]
+  // [--sample=fraction] [--telemetry=seconds] [--telemetry-file=path] [--granularity=year|month] [--amount=column],
+  // then the input files (or patterns matching them) instead of stdin, or [--follow=file]
+  // [--snapshot=seconds], or the server mode [--listen=socket], and return ~false~ to the variable ~valid_study~ in
+  // main() in case of any errors
 
   // Set study pointer to NULL before allocating memory to it
   *study = NULL;
-  *study = (study_str *) malloc( sizeof(study_str) );
-  if (*study == NULL){
-	fprintf( stderr, "Could not allocate memory for ~study_str~ pointer from within ~study_parameters()~ function. Aborting...\n");
-	exit( EXIT_FAILURE );
-  }
-  // By succeeding memory allocation, initialize the struct pointers all to NULL
-  (*study)->start = NULL;
-  (*study)->end = NULL;
-  (*study)->type = NULL;
-
-  int study_type = 0;
-  
-  // temporary variable for correct parsing of study start and study end dates
-  GDate *date = g_date_new();
+  *n_study = 0;
+
+  // parameters as given in the command line (pointers into ~argv~)
+  char *start = NULL;
+  char *end = NULL;
+  char *type = NULL;
+  char *basis = NULL;
+  char *output = NULL;
+  char *manifest = NULL;
+  bool threads_given = false;
+  bool rows_given = false;   // --aggregate: the exposures written along with their aggregate
 
   // parsing of command line arguments
   int c;
-  while (1) 
+  while (1)
 	{
       int option_index = 0;
-      static struct option long_options[] = 
+	  static struct option long_options[] =
 		{
-          {"start", required_argument, NULL, 's' },
-          {"end",   required_argument, NULL, 'e' },
-          {"type",  required_argument, NULL, 't' },
-          {NULL,    0,                 NULL,  0 }
+		  {"start",    required_argument, NULL, 's' },
+		  {"end",      required_argument, NULL, 'e' },
+		  {"type",     required_argument, NULL, 't' },
+		  {"basis",    required_argument, NULL, 'b' },
+		  {"output",   required_argument, NULL, 'o' },
+		  {"manifest", required_argument, NULL, 'm' },
+		  {"threads",  required_argument, NULL, 'j' },
+		  {"sched-stats", no_argument,    NULL, 'S' },
+		  {"partition-by", required_argument, NULL, 'P' },
+		  {"read-ahead", no_argument,     NULL, 'R' },
+		  {"skip",     required_argument, NULL, 'k' },
+		  {"aggregate", no_argument,      NULL, 'A' },
+		  {"aggregate-only", no_argument, NULL, 'a' },
+		  {"group-by", required_argument, NULL, 'g' },
+		  {"listen",   required_argument, NULL, 'L' },
+		  {"follow",   required_argument, NULL, 'f' },
+		  {"snapshot", required_argument, NULL, 'N' },
+		  {"survival", no_argument,       NULL, 'V' },
+		  {"graduate", required_argument, NULL, 'W' },
+		  {"sample",   required_argument, NULL, 'F' },
+		  {"perf-counters", no_argument,  NULL, 'C' },
+		  {"telemetry", required_argument, NULL, 'T' },
+		  {"telemetry-file", required_argument, NULL, 'Y' },
+		  {"granularity", required_argument, NULL, 'G' },
+		  {"amount",   required_argument, NULL, 'U' },
+		  {NULL,       0,                 NULL,  0 }
 		};
 
-      c = getopt_long(argc, argv, "-:s:e:t:", long_options, &option_index);
+	  c = getopt_long(argc, argv, "-:s:e:t:b:o:m:j:SP:Rk:Aag:L:f:N:VW:F:CT:Y:G:U:", long_options, &option_index);
       if (c == -1)
 		break;
 
-      switch (c) 
+	  switch (c)
 		{
 		case 1:
-		  fprintf( stderr, "Missing mandatory study parameters: start, end and type.\n");
-		  *ok = false; // setting flag on due to the error
+		  // Read in an input file, or the files matched by a pattern (in the order of their names)
+		  if ( glob( optarg, ( input.gl_pathc > 0 ) ? GLOB_APPEND : 0, NULL, &input ) != 0 ){
+			fprintf( stderr, "No input file matches '%s'.\n", optarg );
+			*ok = false; // setting flag on due to the error
+		  }
 		  break;
 
 		case 's':
-		  // Read in the study start date
-		  g_date_set_parse (date, optarg);
-		  if ( g_date_valid(date) ){
-			/* (*study)->start = (char *) realloc( (*study)->start, strlen(optarg)*sizeof((*study)->start) ); */
-			(*study)->start = (char *) calloc( strlen(optarg), sizeof((*study)->start) );
-			if ( (*study)->start == NULL ){
-			  fprintf( stderr, "Could not allocate memory for ~(*study)->start~ pointer from within ~study_parameters()~ function. Aborting...\n");
-			  exit( EXIT_FAILURE );
-			}
-			// initializing char* to NUL
-			size_t start_n = sizeof( (*study)->start );
-			memset( (*study)->start, 0, start_n);
-			// copying contents to struct
-			strncpy( (*study)->start, optarg, strlen(optarg));
+		  start = optarg;
+		  break;
+
+		case 'e':
+		  end = optarg;
+		  break;
+
+		case 't':
+		  type = optarg;
+		  break;
+
+		case 'b':
+		  basis = optarg;
+		  break;
+
+		case 'o':
+		  output = optarg;
+		  break;
+
+		case 'm':
+		  manifest = optarg;
+		  break;
+
+		case 'j':
+		  // Read in the amount of worker threads
+		  n_threads = atoi(optarg);
+		  threads_given = true;
+		  if ( n_threads < 1 ){
+			fprintf( stderr, "Amount of threads must be a positive integer.\n");
+			*ok = false; // setting flag on due to the error
 		  }
-		  else {
-			fprintf( stderr, "Study start date must be a valid date.\n");
+		  break;
+
+		case 'S':
+		  report_sched = true;
+		  break;
+
+		case 'C':
+		  perf_counters = true;
+		  break;
+
+		case 'T':
+		  // Read in the seconds between the progress reports
+		  tele_interval = atoi(optarg);
+		  if ( tele_interval < 1 ){
+			fprintf( stderr, "Seconds between progress reports must be a positive integer.\n");
 			*ok = false; // setting flag on due to the error
 		  }
 		  break;
 
-		case 'e':
-		  // Read in the study end date
-		  g_date_set_parse (date, optarg);
-		  if( g_date_valid(date) ){
-			/* (*study)->end = (char *) realloc( (*study)->end, strlen(optarg)*sizeof((*study)->end) ); */
-			(*study)->end = (char *) calloc( strlen(optarg), sizeof((*study)->end) );
-			if ( (*study)->end == NULL ){
-			  fprintf( stderr, "Could not allocate memory for ~(*study)->end~ pointer from within ~study_parameters()~ function. Aborting...\n");
-			  exit( EXIT_FAILURE );
-			}
-			// initializing char* to NUL
-			size_t end_n = sizeof( (*study)->end );
-			memset( (*study)->end, 0, end_n);
-			// copying contents to struct
-			strncpy( (*study)->end, optarg, strlen(optarg));
+		case 'Y':
+		  tele_path = optarg;
+		  break;
+
+		case 'P':
+		  // Read in the column partitioning the exposures
+		  partition = partition_parse(optarg);
+		  if ( partition == PARTITION_NONE ){
+			fprintf( stderr, "Exposures can only be partitioned by policy_year or attained_age.\n");
+			*ok = false; // setting flag on due to the error
 		  }
-		  else {
-			fprintf( stderr, "Study end date must be a valid date.\n");
+		  break;
+
+		case 'R':
+		  read_ahead = true;
+		  break;
+
+		case 'k':
+		  // Read in the amount of lines at the top of stdin to be left out
+		  skip_lines = skip_total = atol(optarg);
+		  if ( skip_lines < 0 ){
+			fprintf( stderr, "Amount of lines to skip must be a non-negative integer.\n");
 			*ok = false; // setting flag on due to the error
 		  }
 		  break;
 
-		case 't':
-		  // Read in the study type
-		  if ( atoi(optarg) == 0 ){
-			fprintf( stderr, "Study type must be a integer.\n");
+		case 'A':
+		  aggregate = true;
+		  rows_given = true;
+		  break;
+
+		case 'G':
+		  // Read in the policy period of the exposures: year (default) or month
+		  if ( strcmp( optarg, "month" ) == 0 ){
+			by_month = true;
+		  } else if ( strcmp( optarg, "year" ) != 0 ){
+			fprintf( stderr, "Exposures can only be computed by policy year or month.\n");
 			*ok = false; // setting flag on due to the error
-		  } else {
-			/* (*study)->type = (char *) realloc( (*study)->type, strlen(optarg)*sizeof((*study)->type) ); */
-			(*study)->type = (char *) calloc( strlen(optarg), sizeof((*study)->type) );
-			if ( (*study)->type == NULL ){
-			  fprintf( stderr, "Could not allocate memory for ~(*study)->type~ pointer from within ~study_parameters()~ function. Aborting...\n");
-			  exit( EXIT_FAILURE );
+		  }
+		  break;
+
+		case 'a':
+		  aggregate = true;
+		  exposures = false;
+		  break;
+
+		case 'V':
+		  survival = true;
+		  break;
+
+		case 'W':
+		  // Read in the smoothing of the graduated rates, h along attained ages [,v along policy years]
+		  aggregate = true;
+		  {
+			char *rest = NULL;
+			grad_h = strtod( optarg, &rest );
+			if ( *rest == ',' ) grad_v = strtod( rest + 1, &rest );
+			if ( *rest != '\0' || grad_h <= 0 || grad_v < 0 || ( rest[-1] == ',' ) ){
+			  fprintf( stderr, "Graduation takes a positive smoothing along attained ages, then optionally along policy years (h[,v]).\n");
+			  *ok = false; // setting flag on due to the error
 			}
-			// initializing char* to NUL
-			size_t type_n = sizeof( (*study)->type );
-			memset( (*study)->type, 0, type_n );
-			// copying contents to struct
-			strncpy( (*study)->type, optarg, strlen(optarg));
-			study_type = atoi((*study)->type);
+		  }
+		  break;
+
+		case 'F':
+		  // Read in the fraction of the policies previewed
+		  sample_fraction = atof(optarg);
+		  if ( sample_fraction <= 0 || sample_fraction > 1 ){
+			fprintf( stderr, "Fraction of the policies sampled must be greater than 0 and at most 1.\n");
+			*ok = false; // setting flag on due to the error
+		  }
+		  break;
+
+		case 'L':
+		  listen_path = optarg;
+		  break;
+
+		case 'f':
+		  // the file is added up into the aggregate, published as it grows
+		  follow_path = optarg;
+		  aggregate = true;
+		  exposures = false;
+		  break;
+
+		case 'N':
+		  // Read in how often (seconds) the aggregates are published in follow mode
+		  snapshot_every = atol(optarg);
+		  if ( snapshot_every < 1 ){
+			fprintf( stderr, "Seconds between snapshots must be a positive integer.\n");
+			*ok = false; // setting flag on due to the error
+		  }
+		  break;
+
+		case 'g':
+		  // Read in the columns grouping the aggregate (which they imply)
+		  aggregate = true;
+		  if ( group_by_parse( &grouping, optarg ) == false ){
+			*ok = false; // setting flag on due to the error
+		  }
+		  break;
+
+		case 'U':
+		  // Read in the column of the amount weighting the claims and exposures of the aggregate
+		  if ( group_by_amount( &grouping, optarg ) == false ){
+			*ok = false; // setting flag on due to the error
 		  }
 		  break;
 
@@ -389,116 +1708,476 @@ void study_parameters(
 		} // switch case
 	} // while
 
+  if ( group_by_named( &grouping ) && skip_total == 0 ){
+	fprintf( stderr, "Columns given by name (--group-by, --amount) are found in the header of stdin, which must be left out (--skip).\n");
+	*ok = false; // setting flag on due to the error
+  }
+
+  if ( input.gl_pathc > 0 && ( follow_path != NULL || listen_path != NULL ) ){
+	fprintf( stderr, "Input files are read instead of stdin: no --follow nor --listen.\n");
+	*ok = false; // setting flag on due to the error
+  }
+
+  // more than one input file: a worker thread per file, up to the cores (or --threads)
+  if ( input.gl_pathc > 1 ){
+	if ( threads_given == false ) n_threads = sysconf( _SC_NPROCESSORS_ONLN );
+	if ( n_threads > (int) input.gl_pathc ) n_threads = input.gl_pathc;
+	if ( n_threads < 1 ) n_threads = 1;
+  }
+
+  if ( follow_path != NULL && ( n_threads > 1 || partition != PARTITION_NONE || listen_path != NULL ) ){
+	fprintf( stderr, "Follow mode (--follow) adds up the aggregate in one thread: no --threads, --partition-by nor --listen.\n");
+	*ok = false; // setting flag on due to the error
+  }
+
+  // the progress of the run is reported every 10 seconds unless told otherwise (--telemetry-file alone)
+  if ( tele_path != NULL && tele_interval == 0 ) tele_interval = 10;
+  if ( tele_interval > 0 && ( follow_path != NULL || listen_path != NULL ) ){
+	fprintf( stderr, "Telemetry (--telemetry, --telemetry-file) reports the progress through the input: no --follow nor --listen.\n");
+	*ok = false; // setting flag on due to the error
+  }
+
+  if ( ( survival == true || grad_h > 0 || sample_fraction < 1 ) && ( follow_path != NULL || listen_path != NULL ) ){
+	fprintf( stderr, "Survival, graduation and samples (--survival, --graduate, --sample) take the whole input: no --follow nor --listen.\n");
+	*ok = false; // setting flag on due to the error
+  }
+
+  // by policy month, the months are added up into the aggregate, written line by line only when asked for
+  // (--aggregate, or --partition-by): twelve times the lines of the policy years
+  if ( by_month == true ){
+	agg_periods = AGG_MONTHS;
+	aggregate = true;
+	if ( rows_given == false && partition == PARTITION_NONE ) exposures = false;
+	if ( grad_h > 0 || listen_path != NULL ){
+	  fprintf( stderr, "Policy months (--granularity=month) are added up into their own aggregate: no --graduate nor --listen.\n");
+	  *ok = false; // setting flag on due to the error
+	}
+  }
+
+  if ( exposures == false && partition != PARTITION_NONE ){
+	fprintf( stderr, "Exposures cannot be partitioned when only their aggregate is written (--aggregate-only).\n");
+	*ok = false; // setting flag on due to the error
+  }
+
+  // server mode: the studies come with the requests, each one choosing what is sent back
+  if ( listen_path != NULL ){
+	if ( start != NULL || end != NULL || type != NULL || basis != NULL || output != NULL || manifest != NULL ){
+	  fprintf( stderr, "Study parameters are given by each request in server mode (--listen), not in the command line.\n");
+	  *ok = false; // setting flag on due to the error
+	}
+	if ( partition != PARTITION_NONE || skip_total > 0 || exposures == false ){
+	  fprintf( stderr, "Server mode (--listen) sends the exposures back: no --partition-by, --skip nor --aggregate-only.\n");
+	  *ok = false; // setting flag on due to the error
+	}
+	return;
+  }
+
+  // either one study from the command line or many from the manifest file
+  if ( manifest != NULL ){
+	if ( start != NULL || end != NULL || type != NULL || basis != NULL || output != NULL ){
+	  fprintf( stderr, "Study parameters must be given either in the command line or in the manifest file, not both.\n");
+	  *ok = false; // setting flag on due to the error
+	  return;
+	}
+	read_manifest( manifest, ok, study, n_study );
+	if ( follow_path != NULL && *n_study > FOLLOW_STUDIES ){
+	  fprintf( stderr, "At most %d studies can be followed at a time.\n", FOLLOW_STUDIES );
+	  *ok = false; // setting flag on due to the error
+	}
+	return;
+  }
+
+  *study = (study_str *) calloc( 1, sizeof(study_str) );
+  if (*study == NULL){
+	fprintf( stderr, "Could not allocate memory for ~study_str~ pointer from within ~study_parameters()~ function. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+  *n_study = 1;
+  set_study( *study, start, end, type, basis, output, ok, "" );
+}
+
+void read_manifest(
+				   char *fname         // path to the manifest file, one study per line: start;end;type;basis;output
+				   ,bool *ok           // flag for validity of the studies listed in the manifest
+				   ,study_str **study  // pointer to array of structs, grown by one struct per study in the manifest
+				   ,int *n_study       // pointer to the amount of studies read from the manifest
+				   ){
+  // Read one study per line of the manifest file, with fields delimited by DELIM as in stdin:
+  //
+  //    start;end;type;basis;output
+  //
+  // where ~basis~ may be left empty (DAYS_IN_YEAR is used). Empty lines and lines starting with '#' are skipped.
+
+  FILE *f_man = fopen( fname, "r" );
+  if( f_man == NULL ){
+	fprintf( stderr, "Could not open manifest file '%s'.\n", fname );
+	*ok = false; // setting flag on due to the error
+	return;
+  }
+
+  char *line = NULL;
+  size_t len = 0;
+  int line_no = 0;
+  char where[64];
+
+  while ( getline(&line, &len, f_man) >= 0 ) {
+	line_no++;
+	// trim "\n" (and "\r" from files edited elsewhere) out of the line, then skip comments and empty lines
+	line[ strcspn( line, "\r\n" ) ] = '\0';
+	if ( line[0] == '\0' || line[0] == '#' ) {
+	  continue;
+	}
+
+	// one more study struct, initialized to zero (NULL pointers)
+	*study = (study_str *) realloc( *study, (*n_study + 1)*sizeof(study_str) );
+	if (*study == NULL){
+	  fprintf( stderr, "Could not allocate memory for ~study_str~ pointer from within ~read_manifest()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+	memset( &(*study)[*n_study], 0, sizeof(study_str) );
+
+	// fields of the line (strsep() keeps empty fields, such as an empty basis)
+	char *rest = line;
+	char *start  = strsep( &rest, DELIM );
+	char *end    = strsep( &rest, DELIM );
+	char *type   = strsep( &rest, DELIM );
+	char *basis  = strsep( &rest, DELIM );
+	char *output = strsep( &rest, DELIM );
+
+	snprintf( where, sizeof(where), "Manifest line %d: ", line_no );
+	if ( output == NULL || output[0] == '\0' ){
+	  fprintf( stderr, "%sEach study of the manifest must have its own output directory.\n", where );
+	  *ok = false; // setting flag on due to the error
+	}
+	set_study( &(*study)[*n_study], start, end, type, basis, output, ok, where );
+	(*n_study)++;
+  }
+  free( line );
+  fclose( f_man );
+
+  if ( *n_study == 0 ){
+	fprintf( stderr, "Manifest file '%s' lists no study.\n", fname );
+	*ok = false; // setting flag on due to the error
+  }
+
+  // two studies writing to the same directory would overwrite each other's files
+  for (int i = 0; i < *n_study; i++) {
+	for (int j = i + 1; j < *n_study; j++) {
+	  if ( (*study)[i].output != NULL && (*study)[j].output != NULL && strcmp( (*study)[i].output, (*study)[j].output ) == 0 ){
+		fprintf( stderr, "Studies %d and %d of the manifest share the output directory '%s'.\n", i + 1, j + 1, (*study)[i].output );
+		*ok = false; // setting flag on due to the error
+	  }
+	}
+  }
+}
+
+void set_study(
+			   study_str *study    // pointer to the struct receiving the (validated) parameters
+			   ,char *start        // study start date YYYY-MM-DD
+			   ,char *end          // study end date YYYY-MM-DD
+			   ,char *type         // study type (integer between 1 and 6)
+			   ,char *basis        // days in a year (365, 365.25 or 365.2425). NULL or empty means DAYS_IN_YEAR
+			   ,char *output       // output directory. NULL or empty means the current directory
+			   ,bool *ok           // flag for validity of the study
+			   ,char *where        // prefix for error messages, locating the study (e.g. line of the manifest)
+			   ){
+
+  // temporary variable for correct parsing of study start and study end dates
+  GDate *date = g_date_new();
+
+  if ( start == NULL || end == NULL || type == NULL ){
+	fprintf( stderr, "%sMissing mandatory study parameters: start, end and type.\n", where);
+	*ok = false; // setting flag on due to the error
+	g_date_free(date);
+	return;
+  }
+
+  // Read in the study start date
+  g_date_set_parse (date, start);
+  if ( g_date_valid(date) ){
+	study->start = strdup( start );
+	study->s = epoch_days( g_date_get_julian( date ) );
+  }
+  else {
+	fprintf( stderr, "%sStudy start date must be a valid date.\n", where);
+	*ok = false; // setting flag on due to the error
+  }
+
+  // Read in the study end date
+  g_date_set_parse (date, end);
+  if( g_date_valid(date) ){
+	study->end = strdup( end );
+	study->e = epoch_days( g_date_get_julian( date ) );
+  }
+  else {
+	fprintf( stderr, "%sStudy end date must be a valid date.\n", where);
+	*ok = false; // setting flag on due to the error
+  }
+
+  // Read in the study type
+  int study_type = atoi( type );
+  if ( study_type == 0 ){
+	fprintf( stderr, "%sStudy type must be a integer.\n", where);
+	*ok = false; // setting flag on due to the error
+  } else {
+	study->type = strdup( type );
+  }
+  study->type_code = ( study_type >= 1 && study_type <= 6 && type[0] == '0' + study_type && type[1] == '\0' ) ? study_type : 0;
+
+  // Read in the study basis (days in a year)
+  study->days_in_year = DAYS_IN_YEAR;
+  if ( basis != NULL && basis[0] != '\0' ){
+	if ( strcmp( basis, "365" ) == 0 ) {
+	  study->days_in_year = 365.00;
+	} else if ( strcmp( basis, "365.25" ) == 0 ) {
+	  study->days_in_year = 365.25;
+	} else if ( strcmp( basis, "365.2425" ) == 0 ) {
+	  study->days_in_year = 365.2425;
+	} else {
+	  fprintf( stderr, "%sStudy basis must be 365, 365.25 or 365.2425 days in a year.\n", where);
+	  *ok = false; // setting flag on due to the error
+	}
+  }
+
+  // Read in the output directory
+  study->output = strdup( ( output != NULL && output[0] != '\0' ) ? output : "." );
+
+  if ( study->start == NULL || study->end == NULL || study->type == NULL || study->output == NULL ){
+	if ( *ok == true ){
+	  fprintf( stderr, "Could not allocate memory for ~study~ pointers from within ~set_study()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+  }
+
   // study start date after study end date
-  if( ((*study)->start != NULL) && ((*study)->end != NULL) && ( strcmp( (*study)->start, (*study)->end ) >= 0) ){
-	fprintf( stderr, "Study start date must be before study end date.\n");
+  if( (study->start != NULL) && (study->end != NULL) && ( study->s >= study->e ) ){
+	fprintf( stderr, "%sStudy start date must be before study end date.\n", where);
 	*ok = false; // setting flag on due to the error
   }
 
   // study type non numeric or outside interval [1,6]
   if( study_type == 0 || !(study_type >= 1 && study_type <= 6) ){
-	fprintf( stderr, "Study type must be a number between 1 and 6 .\n");
+	fprintf( stderr, "%sStudy type must be a number between 1 and 6 .\n", where);
 	*ok = false; // setting flag on due to the error
   }
 
   // frees memory of the temporary variable for correct parsing of study start and study end dates
   g_date_free(date);
-
 }
 
-void tokenize(
-			  char *line             // single, one at a time, line read from stdin
-			  ,policy_str **policy   // pointer to pointer to policy struct where inputs will be copied
-			  ){
-  // read one line at a time from stdin
-  // and tokenize its content into the policy struct elements (pointers to id, DOB, issue date, status code and status date)
-
-  // Set ~policy~ pointer to NULL before allocating memory to it
-  *policy = NULL;
-  *policy = (policy_str *) malloc( sizeof(policy_str) );
-  if (*policy == NULL){
-	fprintf( stderr, "Could not allocate memory for ~policy_str~ pointer from within ~tokenize()~ function. Aborting...\n");
+void open_study(
+				study_str *study    // pointer to struct whose output directory and files will be created
+				){
+  // creates the output directory of the study (one level only) and opens its files
+  // ~exposures.csv~ (or the directory ~exposures~ of its partitions) and ~out_of_study.csv~ for writing
+
+  if ( strcmp( study->output, "." ) != 0 && mkdir( study->output, 0777 ) != 0 && errno != EEXIST ){
+	fprintf( stderr, "Could not create output directory '%s'. Aborting...\n", study->output );
 	exit( EXIT_FAILURE );
   }
-  // By succeeding memory allocation, initialize the struct pointers all to NULL
-  (*policy)->id = NULL;
-  (*policy)->date_of_birth = NULL;
-  (*policy)->issue_date = NULL;
-  (*policy)->status_code = NULL;
-  (*policy)->status_date = NULL;
-
-  // pointers needed to tokenize the read line
-  char *token = NULL;
-  char *rest = line;
-  
-  int token_len = 0;
-
-  // parsing the policyholder's ID
-  //token = strtok_r(rest, DELIM, &rest);
-  token = strsep( &rest, DELIM);
-  token_len  = (strlen(token)==0) ? 1 : strlen(token);
-  (*policy)->id = (char *) realloc( (*policy)->id, (token_len + 1)*sizeof((*policy)->id));
-  if( (*policy)->id == NULL){
-	fprintf( stderr, "Could not allocate memory for ~(*policy)->id~ pointer from within ~tokenize()~ function. Aborting...\n");
+
+  char *fname = (char *) malloc( strlen(study->output) + strlen("/out_of_study.csv") + 1 );
+  if ( fname == NULL ){
+	fprintf( stderr, "Could not allocate memory for file names from within ~open_study()~ function. Aborting...\n");
 	exit( EXIT_FAILURE );
   }
-  strcpy( (*policy)->id, token ) ;
 
-  // parsing the date of birth of the policyholder
-  //token = strtok_r(rest, DELIM, &rest);
-  token = strsep( &rest, DELIM);
-  token_len = (strlen(token)==0) ? 1 : strlen(token);
-  (*policy)->date_of_birth = (char *) realloc( (*policy)->date_of_birth, (token_len + 1)*sizeof((*policy)->date_of_birth) );
-  if( (*policy)->date_of_birth == NULL){
-	fprintf( stderr, "Could not allocate memory for ~(*policy)->date_of_birth~ pointer from within ~tokenize()~ function. Aborting...\n");
-	exit( EXIT_FAILURE );
+  if ( partition != PARTITION_NONE ){
+	// partitioned exposures: directory ~exposures~ of the study, holding one directory per partition value,
+	// and one writer per writer thread
+	sprintf( fname, "%s/exposures", study->output );
+	if ( mkdir( fname, 0777 ) != 0 && errno != EEXIST ){
+	  fprintf( stderr, "Could not create output directory '%s'. Aborting...\n", fname );
+	  exit( EXIT_FAILURE );
+	}
+	study->w_part = (writer_str *) calloc( n_threads, sizeof(writer_str) );
+	if ( study->w_part == NULL ){
+	  fprintf( stderr, "Could not allocate memory for ~study->w_part~ pointer from within ~open_study()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+	for (int i = 0; i < n_threads; i++) {
+	  writer_partitioned( &study->w_part[i], partition, fname, i );
+	}
+  } else if ( exposures == true ){
+	sprintf( fname, "%s/exposures.csv", study->output );
+	study->f_exp = fopen( fname, "w" );
+	if( study->f_exp == NULL ){
+	  fprintf( stderr, "Could not open file '%s'. Aborting...\n", fname );
+	  exit( EXIT_FAILURE );
+	}
   }
-  strcpy( (*policy)->date_of_birth, token ) ;
 
-  // parsing the issue date of the policy
-  //token = strtok_r(rest, DELIM, &rest);
-  token = strsep( &rest, DELIM);
-  token_len = (strlen(token)==0) ? 1 : strlen(token);
-  (*policy)->issue_date = (char *) realloc( (*policy)->issue_date, (token_len + 1)*sizeof((*policy)->issue_date) );
-  if( (*policy)->issue_date == NULL){
-	fprintf( stderr, "Could not allocate memory for ~(*policy)->issue_date~ pointer from within ~tokenize()~ function. Aborting...\n");
-	exit( EXIT_FAILURE );
+  // cubes of aggregated exposures, one per worker thread (--aggregate)
+  if ( aggregate == true ){
+	study->agg = (agg_str *) calloc( n_threads, sizeof(agg_str) );
+	if ( study->agg == NULL ){
+	  fprintf( stderr, "Could not allocate memory for ~study->agg~ pointer from within ~open_study()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+	for (int i = 0; i < n_threads; i++) {
+	  agg_init( &study->agg[i], agg_periods, grouping.amount_name != NULL );
+	  if ( study->w_part != NULL ) study->w_part[i].agg = &study->agg[i];
+	}
   }
-  strcpy( (*policy)->issue_date, token ) ;
 
-  // parsing the status code of the policy
-  //token = strtok_r(rest, DELIM, &rest);
-  token = strsep( &rest, DELIM);
-  token_len = (strlen(token)==0) ? 1 : strlen(token);
-  (*policy)->status_code = (char *) realloc( (*policy)->status_code, (token_len + 1)*sizeof((*policy)->status_code));
-  if( (*policy)->status_code == NULL){
-	fprintf( stderr, "Could not allocate memory for ~(*policy)->status_code~ pointer from within ~tokenize()~ function. Aborting...\n");
-	exit( EXIT_FAILURE );
+  // histograms of the durations, one per worker thread (--survival)
+  if ( survival == true ){
+	study->surv = (surv_str *) calloc( n_threads, sizeof(surv_str) );
+	if ( study->surv == NULL ){
+	  fprintf( stderr, "Could not allocate memory for ~study->surv~ pointer from within ~open_study()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+	for (int i = 0; i < n_threads; i++) {
+	  surv_init( &study->surv[i] );
+	  if ( study->w_part != NULL ) study->w_part[i].surv = &study->surv[i];
+	}
   }
-  strcpy( (*policy)->status_code, token ) ;
 
-  // parsing the date regarding the status date
-  //token = strtok_r(rest, DELIM, &rest);
-  token = strsep( &rest, DELIM);
-  token_len = (strlen(token)==0) ? 1 : strlen(token);
-  (*policy)->status_date = (char *) realloc( (*policy)->status_date, (token_len + 1)*sizeof((*policy)->status_date));
-  if( (*policy)->status_date == NULL){
-	fprintf( stderr, "Could not allocate memory for ~(*policy)->status_date~ pointer from within ~tokenize()~ function. Aborting...\n");
+  // strata of the sampled policies, one per worker thread (--sample)
+  if ( sample_fraction < 1 ){
+	study->sample = (sample_str *) calloc( n_threads, sizeof(sample_str) );
+	if ( study->sample == NULL ){
+	  fprintf( stderr, "Could not allocate memory for ~study->sample~ pointer from within ~open_study()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+	for (int i = 0; i < n_threads; i++) {
+	  sample_init( &study->sample[i] );
+	  if ( study->w_part != NULL ) study->w_part[i].sample = &study->sample[i];
+	}
+  }
+
+  sprintf( fname, "%s/out_of_study.csv", study->output );
+  study->f_out = fopen( fname, "w" );
+  if( study->f_out == NULL ){
+	fprintf( stderr, "Could not open file '%s'. Aborting...\n", fname );
 	exit( EXIT_FAILURE );
   }
-  size_t psd_n = sizeof((*policy)->status_date);
-  memset( (*policy)->status_date, 0, psd_n );
-  token = strsep( &token, "\n" ); // trick to trim "\n" out of string 'token'
-  strcpy( (*policy)->status_date, token ) ; 
 
-  // Free memory from pointers used for tokenize the read line from stdin
-  token = NULL;
-  rest = NULL;
+  free( fname );
+}
+
+void close_study(
+				 study_str *study    // pointer to struct whose files are closed and pointers freed
+				 ){
+  if ( study->f_exp != NULL ) fclose( study->f_exp );
+  if ( study->w_part != NULL ){
+	for (int i = 0; i < n_threads; i++) {
+	  writer_close( &study->w_part[i] );
+	}
+	free( study->w_part );
+  }
+  if ( study->f_out != NULL ) fclose( study->f_out );
+  double scale = 1.0;
+  if ( study->sample != NULL ){
+	// the strata of the worker threads add up into the first one, estimated into ~sample.csv~, whose policies over
+	// the kept ones scale the aggregate up
+	for (int i = 1; i < n_threads; i++) {
+	  sample_merge( &study->sample[0], &study->sample[i] );
+	  sample_free( &study->sample[i] );
+	}
+	char *fname = (char *) malloc( strlen(study->output) + strlen("/sample.csv") + 1 );
+	if ( fname == NULL ){
+	  fprintf( stderr, "Could not allocate memory for file names from within ~close_study()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+	sprintf( fname, "%s/sample.csv", study->output );
+	FILE *f_sample = fopen( fname, "w" );
+	if( f_sample == NULL ){
+	  fprintf( stderr, "Could not open file '%s'. Aborting...\n", fname );
+	  exit( EXIT_FAILURE );
+	}
+	sample_write( &study->sample[0], f_sample );
+	fclose( f_sample );
+	scale = sample_scale( &study->sample[0] );
+	sample_free( &study->sample[0] );
+	free( study->sample );
+	free( fname );
+  }
+  if ( study->agg != NULL ){
+	// the cubes of the worker threads add up into the first one, written into ~aggregate.csv~. Grouped (--group-by),
+	// each worker coded its own groups: every cube, the first one included, is added up into the collected groups
+	if ( group_map != NULL ){
+	  agg_str total;
+	  agg_init( &total, study->agg[0].periods, study->agg[0].amounts );
+	  for (int i = 0; i < n_threads; i++) {
+		agg_merge( &total, &study->agg[i], group_map[i] );
+		agg_free( &study->agg[i] );
+	  }
+	  study->agg[0] = total;
+	}
+	for (int i = 1; i < n_threads && group_map == NULL; i++) {
+	  agg_merge( &study->agg[0], &study->agg[i], NULL );
+	  agg_free( &study->agg[i] );
+	}
+	char *fname = (char *) malloc( strlen(study->output) + strlen("/graduated.csv") + 1 );
+	if ( fname == NULL ){
+	  fprintf( stderr, "Could not allocate memory for file names from within ~close_study()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+	sprintf( fname, "%s/aggregate.csv", study->output );
+	FILE *f_agg = fopen( fname, "w" );
+	if( f_agg == NULL ){
+	  fprintf( stderr, "Could not open file '%s'. Aborting...\n", fname );
+	  exit( EXIT_FAILURE );
+	}
+	study->agg[0].scale = scale;
+	agg_write( &study->agg[0], f_agg, group_label );
+	fclose( f_agg );
+	// the crude rates of the cube graduated into ~graduated.csv~ (--graduate)
+	if ( grad_h > 0 ){
+	  sprintf( fname, "%s/graduated.csv", study->output );
+	  FILE *f_grad = fopen( fname, "w" );
+	  if( f_grad == NULL ){
+		fprintf( stderr, "Could not open file '%s'. Aborting...\n", fname );
+		exit( EXIT_FAILURE );
+	  }
+	  grad_write( &study->agg[0], f_grad, grad_h, grad_v, group_label );
+	  fclose( f_grad );
+	}
+	agg_free( &study->agg[0] );
+	free( study->agg );
+	free( fname );
+  }
+  if ( study->surv != NULL ){
+	// the histograms of the worker threads add up as the cubes do, then are swept into ~survival_km.csv~ and
+	// ~survival_table.csv~
+	surv_str total;
+	surv_init( &total );
+	for (int i = 0; i < n_threads; i++) {
+	  surv_merge( &total, &study->surv[i], ( group_map != NULL ) ? group_map[i] : NULL );
+	  surv_free( &study->surv[i] );
+	}
+	char *fname = (char *) malloc( strlen(study->output) + strlen("/survival_table.csv") + 1 );
+	if ( fname == NULL ){
+	  fprintf( stderr, "Could not allocate memory for file names from within ~close_study()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+	sprintf( fname, "%s/survival_km.csv", study->output );
+	FILE *f_km = fopen( fname, "w" );
+	sprintf( fname, "%s/survival_table.csv", study->output );
+	FILE *f_table = fopen( fname, "w" );
+	if( f_km == NULL || f_table == NULL ){
+	  fprintf( stderr, "Could not open the survival files in '%s'. Aborting...\n", study->output );
+	  exit( EXIT_FAILURE );
+	}
+	surv_write( &total, f_km, f_table, study->days_in_year, group_label );
+	fclose( f_km );
+	fclose( f_table );
+	surv_free( &total );
+	free( study->surv );
+	free( fname );
+  }
+  free( study->start );
+  free( study->end   );
+  free( study->type  );
+  free( study->output );
 }
 
 void validate(
 			  study_str *study    // pointer to struct containing pointers to study parameters
-			  ,policy_str *policy // pointer to policy struct with parsed inputs to be validated
+			  ,policy_str *policy // pointer to policy record with parsed inputs to be validated
+			  ,int64_t amount     // amount of the policy (--amount), POLICY_AMOUNT_NONE when invalid
+			  ,char **field       // fields of the policy as read from stdin, for the LOG
 			  ,bool *exposed      // pointer to boolean flag controlling if policy is exposed to study
 			  ,FILE *f_out        // pointer to LOG file ~f_out~, where the problems will be listed if policy is not exposed to study
 			  ){
@@ -509,6 +2188,7 @@ void validate(
   //    - I2. Policy issue date must be a valid date
   //    - I3. Policy status code must be a valid integer between 1 and 6
   //    - I4. Policy status date must be a valid date (when policy status code is valid and not equal to 1)
+  //    - I5. Amount must be a non-negative number (when an amount column is given, --amount)
   //
   //   Compound ones
   //    - C1. Date of birth must be older then study end date
@@ -520,85 +2200,186 @@ void validate(
   //  Result:  If any of the above fails, then
   //    - Flag inconsistencies into log file ~out_of_study.csv~ ( FILE *f_out )
   //    - Flag ~exposed_policy~to false
+  //    - Count the rule broken (--telemetry)
+  //
+  //  Dates were parsed once by ~policy_pack()~ into days since 1970-01-01 (POLICY_DATE_NONE when invalid), which
+  //  compare as integers. The LOG quotes the fields as read from stdin (~field~: id, date of birth, issue date,
+  //  status code and status date).
 
   // Declaration of variables used to validate exposure of policy to study
-  GDate   *s = g_date_new(); // study start date
-  GDate   *e = g_date_new(); // study end date
-  GDate *dob = g_date_new(); // policyholder's date of birth
-  GDate *pid = g_date_new(); // policy issue date
-  int    psc = 0;            // policy status code (PSC)
+  int32_t   s = study->s;    // study start date
+  int32_t   e = study->e;    // study end date
+  int32_t dob = policy->dob; // policyholder's date of birth
+  int32_t pid = policy->pid; // policy issue date
+  int     psc = 0;           // policy status code (PSC)
   bool psc_valid;            // PSC numeric and between 1 and 6
-  GDate *psd = g_date_new(); // policy status date
-  
-  //  both study start and study end dates are valid as a result of function ~study_parameters()~
-  g_date_set_parse( s, study->start );
-  g_date_set_parse( e, study->end );
-  
+  int32_t psd = policy->psd; // policy status date
+  const int32_t NONE = POLICY_DATE_NONE;
+
   // Individual validations
   //
   //  I1. Policyholder's Date of Birth must be a valid date
-  g_date_set_parse( dob, policy->date_of_birth );
-  if( !g_date_valid(dob) ){
-	fprintf( f_out, "%s;Invalid date of birth;%s\n", policy->id, policy->date_of_birth );
+  if( dob == NONE ){
+	fprintf( f_out, "%s;Invalid date of birth;%s\n", field[0], field[1] );
 	*exposed = false;
+	if ( tele != NULL ) TELE_ADD( tele, broken[TELE_I1], 1 );
   }
   //  I2. Policy issue date must be a valid date
-  g_date_set_parse( pid, policy->issue_date );
-  if( !g_date_valid(pid) ){
-	fprintf( f_out, "%s;Invalid policy issue date;%s\n", policy->id, policy->issue_date );
+  if( pid == NONE ){
+	fprintf( f_out, "%s;Invalid policy issue date;%s\n", field[0], field[2] );
 	*exposed = false;
+	if ( tele != NULL ) TELE_ADD( tele, broken[TELE_I2], 1 );
   }
   //  I3. Policy status code must be a valid integer between 1 and 6
   psc_valid = true;
-  if(
-	 (psc = atoi(policy->status_code)) == 0 || // if policy status code is not a number OR
-	 !(atoi(policy->status_code) >= 1 && atoi(policy->status_code) <=6) // is not 1,2,3,4,5 nor 6
-	 ){
-	fprintf( f_out, "%s;Invalid policy status code (must be a number between 1 and 6);%s\n", policy->id, policy->status_code );
+  if( (psc = policy->status) == 0 ){ // policy status code is not a number, or is not 1,2,3,4,5 nor 6
+	fprintf( f_out, "%s;Invalid policy status code (must be a number between 1 and 6);%s\n", field[0], field[3] );
 	*exposed = false;
+	if ( tele != NULL ) TELE_ADD( tele, broken[TELE_I3], 1 );
 	psc_valid = false;
   }
   //  I4. Policy status date must be a valid date (when policy status code is valid and not equal to 1)
-  g_date_set_parse( psd, policy->status_date );
-  if( psc_valid == true && psc != 1 && !g_date_valid(psd) ){
-	fprintf( f_out, "%s;Invalid or missing policy status date;%s\n", policy->id, policy->status_date );
+  if( psc_valid == true && psc != 1 && psd == NONE ){
+	fprintf( f_out, "%s;Invalid or missing policy status date;%s\n", field[0], field[4] );
 	*exposed = false;
+	if ( tele != NULL ) TELE_ADD( tele, broken[TELE_I4], 1 );
+  }
+  //  I5. Amount must be a non-negative number (when an amount column is given)
+  if( amount == POLICY_AMOUNT_NONE ){
+	fprintf( f_out, "%s;Invalid amount;%s\n", field[0], field[grouping.amount] );
+	*exposed = false;
+	if ( tele != NULL ) TELE_ADD( tele, broken[TELE_I5], 1 );
   }
 
   // Compound validations
   //
   //  C1. Date of birth must be older then study end date
-  if ( g_date_valid(dob) && g_date_compare(dob, e) >= 0 ){
-	fprintf( f_out, "%s;Date of birth (DOB) after study end date (EOS);DOB %s >= EOS %s\n", policy->id, policy->date_of_birth, study->end );
+  if ( dob != NONE && dob >= e ){
+	fprintf( f_out, "%s;Date of birth (DOB) after study end date (EOS);DOB %s >= EOS %s\n", field[0], field[1], study->end );
 	*exposed = false;
+	if ( tele != NULL ) TELE_ADD( tele, broken[TELE_C1], 1 );
   }
   //  C2. Policy issue date must be older than policy status date (when policy status code is valid and not equal to 1)
-  if ( psc_valid == true && psc != 1 && g_date_valid(pid) && g_date_valid(psd) && g_date_compare(pid, psd) >= 0 ){
-	fprintf( f_out, "%s;Policy issue date (PID) after Policy status date (PSD);PID %s >= PSD %s\n", policy->id, policy->issue_date, policy->status_date );
+  if ( psc_valid == true && psc != 1 && pid != NONE && psd != NONE && pid >= psd ){
+	fprintf( f_out, "%s;Policy issue date (PID) after Policy status date (PSD);PID %s >= PSD %s\n", field[0], field[2], field[4] );
 	*exposed = false;
+	if ( tele != NULL ) TELE_ADD( tele, broken[TELE_C2], 1 );
   }
   //  C3. Policy issue date must be older than study end date
-  if ( g_date_valid(pid) && g_date_compare(pid, e) >= 0 ){
-	fprintf( f_out, "%s;Policy issue date (PID) after study end date (EOS);PID %s >= EOS %s\n", policy->id, policy->issue_date, study->end );
+  if ( pid != NONE && pid >= e ){
+	fprintf( f_out, "%s;Policy issue date (PID) after study end date (EOS);PID %s >= EOS %s\n", field[0], field[2], study->end );
 	*exposed = false;
+	if ( tele != NULL ) TELE_ADD( tele, broken[TELE_C3], 1 );
   }
   //  C4. Policy status date must be sooner than study start date
-  if ( psc_valid == true && psc != 1 && g_date_valid(psd) && g_date_compare(psd, s) < 0 ){
-	fprintf( f_out, "%s;Policy status date (PSD) before Study start date (SOS);PSD %s < SOS %s\n", policy->id, policy->status_date, study->start );
+  if ( psc_valid == true && psc != 1 && psd != NONE && psd < s ){
+	fprintf( f_out, "%s;Policy status date (PSD) before Study start date (SOS);PSD %s < SOS %s\n", field[0], field[4], study->start );
 	*exposed = false;
+	if ( tele != NULL ) TELE_ADD( tele, broken[TELE_C4], 1 );
   }
   //  C5. Date of birth must be earlier than policy issue date
-  if ( g_date_valid(dob) && g_date_valid(pid) && g_date_compare(dob, pid) >= 0 ){
-	fprintf( f_out, "%s;Date of birth (DOB) after Policy issue date (PID);DOB %s > PID %s\n", policy->id, policy->date_of_birth, policy->issue_date );
+  if ( dob != NONE && pid != NONE && dob >= pid ){
+	fprintf( f_out, "%s;Date of birth (DOB) after Policy issue date (PID);DOB %s > PID %s\n", field[0], field[1], field[2] );
 	*exposed = false;
+	if ( tele != NULL ) TELE_ADD( tele, broken[TELE_C5], 1 );
+  }
+}
+
+int expose(
+		   study_str *study    // pointer to struct containing pointers to parameters
+		   ,policy_str *policy // pointer to policy struct with validated inputs
+		   ,int64_t amount     // amount of the policy in hundredths (--amount), 0 when none
+		   ,writer_str *w_exp  // pointer to writer of the file(s) where the exposure at each policy year is written
+		   ){
+  // calculates the exposure of the policy at each policy year of the study and
+  // writes one line per policy year through the writer ~w_exp~ (into the file of its partition, if partitioned),
+  // returning the amount of policy years
+
+  // policy duration at start and at end
+  double DS = duration_at_start( study, policy );
+  double DE = duration_at_end(   study, policy );
+
+  // exposure at policy year
+  double E_t = 0;
+
+  // age at issue
+  int age_issue = age_at_issue( study, policy );
+
+  // policy claim (status code spelled as the study type)
+  bool exact = ( policy->flags & POLICY_STATUS_EXACT ) != 0;
+  bool claim = false ;
+  if ( exact && study->type_code == policy->status ) {
+	claim = true;
+  }
+  if ( exact && study->type_code == 3 && policy->status == 4 ){
+	  claim = true ; // special case: in a death any cause study (PSC==3), accidental death (PSC==4) counts as a claim
+  }
+  int claim_year = (int) policy_claim_year( study, policy);
+
+  // boundaries for policy year loop ahead ( DS < t < DE +1 )
+  int from_t = 1 + (int) floor(DS);  // t > DS  (or t >= 1 + DS)
+  int to_t   = (int) floor( DE + 1.0 ) ;  // t < DE + 1   (or t <= DE )
+
+  // the policy observed in days since issue, from max(ID, S) to min(E, TD), leaving with a claim when its status
+  // date is a claim of the study within it (a claim after E is censored at E, though its policy year has an actual)
+  if ( w_exp->surv != NULL ){
+	int32_t td = ( policy->status == 1 ) ? study->e : policy->psd;
+	surv_add(
+			 w_exp->surv
+			 ,policy->group
+			 ,( (policy->pid < study->s) ? study->s : policy->pid ) - policy->pid
+			 ,( (td < study->e) ? td : study->e ) - policy->pid
+			 ,claim_year > 0 && td <= study->e
+			 );
   }
-  
-  // frees memory from GDate pointers use to validate dates
-  g_date_free(s);
-  g_date_free(e);
-  g_date_free(pid);
-  g_date_free(dob);
-  g_date_free(psd);
+
+  // by policy month (--granularity=month), a claim counted in its month as it is in its year
+  if ( by_month == true ){
+	return expose_months( study, policy, amount, w_exp, age_issue, claim_year > 0 );
+  }
+
+  // totals of the policy over the study, scaling up its stratum (--sample)
+  long actual_total = 0;
+  long long exposure_total = 0;
+
+  // calculation of exposure for each policy year
+  // E(t) = min(DE, t) - max(DS, t-1), for (t > DS) AND (t < DE+1) AND (TD > S) AND (ID < E)
+  //
+  for (int t = from_t; t <= to_t; t++) {
+	// Exposure calculation
+	E_t = (
+		   ((DE < t) ? DE : t)  -  // minimum( DE, t)
+		   ((DS > t-1) ? DS : t-1) // maximum( DS, t-1)
+		   );
+	if ( (claim == true) && (t == claim_year ) ) {
+	  E_t = 1; // full exposure in the year when claim happened
+	}
+	// printf( "Id: %10s \tDS: %2.4f\tDE: %2.4f\tt: %3d\tClaim: %d\tE(t): %1.5f\n", policy_id( policy ), DS, DE, t, claim_year, E_t);
+	if ( w_exp->agg != NULL ){
+	  agg_add( w_exp->agg, policy->group, age_issue + t - 1, t, ( (claim == true) && (t == claim_year ) ) ? 1 : 0, E_t, amount );
+	}
+	if ( w_exp->sample != NULL ){
+	  actual_total += ( (claim == true) && (t == claim_year ) ) ? 1 : 0;
+	  exposure_total += llround( E_t * 1e6 );
+	}
+	FILE *f_exp = writer_file( w_exp, t, age_issue + t - 1 );
+	if ( f_exp == NULL ) continue; // only the aggregate is written (--aggregate-only)
+	fprintf(
+			f_exp
+			,"%s;%d;%d;%d;%d;%f"
+			,policy_id( policy )
+			,age_issue
+			,t
+			,age_issue + t - 1 // attained age: age at issue + t - 1
+			,( (claim == true) && (t == claim_year ) ) ? 1 : 0 // actual
+			,E_t // exposure (to be used in the 'expected' calculation
+			);
+	write_amount( f_exp, amount );
+  }
+  if ( w_exp->sample != NULL ){
+	sample_add( w_exp->sample, sample_stratum_of( policy ), actual_total, exposure_total );
+  }
+  return ( to_t >= from_t ) ? to_t - from_t + 1 : 0;
 }
 
 double duration_at_start(
@@ -611,21 +2392,13 @@ double duration_at_start(
 
   // variable declarations
   double result = 0;
-  GDate *pid = g_date_new();
-  GDate *s = g_date_new();
-
-  // assigning dates
-  g_date_set_parse( pid, policy->issue_date);
-  g_date_set_parse( s, study->start);
+  gint pid = policy->pid;
+  gint s = study->s;
 
   // calculation of duration at start
-  result = g_date_days_between(
-							   pid
-							   ,(g_date_compare( pid, s) < 0) ? s : pid
-							   ) / DAYS_IN_YEAR;
-  // frees memory from allocated dates
-  g_date_free(pid);
-  g_date_free(s);
+  result = (
+			( (pid < s) ? s : pid ) - pid
+			) / study->days_in_year;
 
   return result;
 }
@@ -640,27 +2413,16 @@ double duration_at_end(
 
   // variable declarations
   double result = 0;
-  GDate *pid = g_date_new();
-  GDate *td = g_date_new(); // termination date. equals end of study (e) if policy is inforce
-  GDate *e = g_date_new();
-
-  // assigning dates
-  g_date_set_parse( pid, policy->issue_date);
-  g_date_set_parse( e, study->end);
-  g_date_set_parse( td,  ( atoi(policy->status_code) == 1) ? study->end : policy->status_date );
+  gint pid = policy->pid;
+  gint td = ( policy->status == 1) ? study->e : policy->psd; // termination date. equals end of study (e) if policy is inforce
+  gint e = study->e;
 
   // calculation of duration at end
-  result = g_date_days_between(
-							   pid
-							   ,(g_date_compare( e, td) < 0) ? e : td 
-							   ) / DAYS_IN_YEAR;
+  result = (
+			( (e < td) ? e : td ) - pid
+			) / study->days_in_year;
   // result = (policy->status_code == study->type) ? ceil(result) : result;
 
-  // frees memory from allocated dates
-  g_date_free(pid);
-  g_date_free(td);
-  g_date_free(e);
-
   return result;
 }
 
@@ -672,51 +2434,127 @@ double policy_claim_year(
 
   // variable declarations
   double result = 0;
-  GDate *pid = g_date_new();
-  GDate *psd = g_date_new();
-  
-  // assigning dates
-  g_date_set_parse( pid, policy->issue_date);
-  g_date_set_parse( psd, policy->status_date);
-
-  // if policy status code coincides with study type, then it is a 'claim'
-  if( strcmp( study->type, policy->status_code ) == 0 ){
-	result = g_date_days_between( pid, psd ) / DAYS_IN_YEAR;
+  gint pid = policy->pid;
+  gint psd = policy->psd;
+
+  // if policy status code coincides with study type (spelled as it), then it is a 'claim'
+  if( ( policy->flags & POLICY_STATUS_EXACT ) && study->type_code == policy->status ){
+	result = ( psd - pid ) / study->days_in_year;
 	result = result + 1.0; // 0 years difference means the policy terminated in its first policy year
 	result = floor( result ); // take just the integral part
   }
 
-  // frees memory from allocated dates
-  g_date_free( pid );
-  g_date_free( psd );
-  
   return result;
 }
 
+int expose_months(
+				  study_str *study    // pointer to struct containing pointers to parameters
+				  ,policy_str *policy // pointer to policy struct with validated inputs
+				  ,int64_t amount     // amount of the policy in hundredths (--amount), 0 when none
+				  ,writer_str *w_exp  // pointer to writer of the file(s) where the exposure at each policy month is written
+				  ,int age_issue      // age at issue of the policy
+				  ,bool claim         // the policy left with a claim of the study (at its status date)
+				  ){
+  // calculates the exposure of the policy at each policy month of the study (--granularity=month), in years as by
+  // policy year, and adds it into the aggregate (writing one line per policy month through the writer ~w_exp~ only
+  // when exposures are written), returning the amount of policy months
+  //
+  // Policy month m runs from monthiversary M(m-1) to M(m), the issue date moved on by whole calendar months (its day
+  // kept, or the last day of a shorter month), all of them integer dates:
+  //
+  // E(m) = ( min(E, TD, M(m)) - max(S, ID, M(m-1)) ) / days in a year, for the months from the one of max(S, ID) to
+  //        the one of min(E, TD), the whole month M(m) - M(m-1) when its claim happened
+
+  int32_t td = ( policy->status == 1 ) ? study->e : policy->psd; // termination date
+  int32_t from = ( policy->pid < study->s ) ? study->s : policy->pid;
+  int32_t to = ( td < study->e ) ? td : study->e;
+  int d, y, m, from_d, from_y, from_m;
+  epoch_to_civil( policy->pid, &y, &m, &d );
+  epoch_to_civil( from, &from_y, &from_m, &from_d );
+
+  // whole months k from issue to max(S, ID), M(k) <= max(S, ID) < M(k+1): M(k) falls in the month (y, m) starting
+  // on day ~first~, each next monthiversary a month length later
+  int k = ( from_y - y ) * 12 + ( from_m - m );
+  if ( from_d < d && from_d < days_in_month( from_y, from_m ) ){
+	k--;
+	from_m = ( from_m == 1 ) ? 12 : from_m - 1;
+	from_y -= ( from_m == 12 ) ? 1 : 0;
+  }
+  y = from_y;
+  m = from_m;
+  int32_t first = civil_to_epoch( y, m, 1 );
+  int length = days_in_month( y, m );
+  int32_t lo = first + ( ( d < length ) ? d : length ) - 1, hi;
+
+  // totals of the policy over the study, scaling up its stratum (--sample)
+  long actual_total = 0;
+  long long exposure_total = 0;
+  int months = 0;
+
+  for ( ; lo <= to; k++, lo = hi ) {
+	first += length;
+	y += ( m == 12 ) ? 1 : 0;
+	m = ( m == 12 ) ? 1 : m + 1;
+	length = days_in_month( y, m );
+	hi = first + ( ( d < length ) ? d : length ) - 1;
+	int actual = ( claim == true && lo <= policy->psd && policy->psd < hi ) ? 1 : 0;
+	int32_t a = ( from > lo ) ? from : lo;
+	int32_t b = ( to < hi ) ? to : hi;
+	if ( b <= a && actual == 0 ) continue; // left on the monthiversary: nothing exposed in the month
+	double E_m = ( ( actual == 1 ) ? hi - lo : b - a ) / study->days_in_year;
+	int t = k / 12 + 1; // policy year of the month
+	months++;
+	if ( w_exp->agg != NULL ){
+	  agg_add( w_exp->agg, policy->group, age_issue + t - 1, k + 1, actual, E_m, amount );
+	}
+	if ( w_exp->sample != NULL ){
+	  actual_total += actual;
+	  exposure_total += llround( E_m * 1e6 );
+	}
+	FILE *f_exp = writer_file( w_exp, t, age_issue + t - 1 );
+	if ( f_exp == NULL ) continue; // only the aggregate is written
+	fprintf( f_exp, "%s;%d;%d;%d;%d;%f", policy_id( policy ), age_issue, k + 1, age_issue + t - 1, actual, E_m );
+	write_amount( f_exp, amount );
+  }
+  if ( w_exp->sample != NULL ){
+	sample_add( w_exp->sample, sample_stratum_of( policy ), actual_total, exposure_total );
+  }
+  return months;
+}
+
+void write_amount(
+				  FILE *f_exp         // file of the exposures, whose line is ended ...
+				  ,int64_t amount     // ... with the amount of the policy in hundredths, when given (--amount)
+				  ){
+  if ( grouping.amount_name != NULL ){
+	fprintf( f_exp, ";%lld.%02lld\n", (long long) amount / 100, (long long) amount % 100 );
+  } else {
+	fputc( '\n', f_exp );
+  }
+}
+
+int days_in_month(
+				  int y               // year
+				  ,int m              // month 1 .. 12
+				  ){
+  static const int days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+  return days[m - 1] + ( ( m == 2 && y % 4 == 0 && ( y % 100 != 0 || y % 400 == 0 ) ) ? 1 : 0 );
+}
+
 int age_at_issue(
-			  policy_str *policy // pointer to policy struct with parsed inputs to be validated
+			  study_str *study    // pointer to struct containing pointers to study parameters (basis)
+			  ,policy_str *policy // pointer to policy struct with parsed inputs to be validated
 			  ){
   // calculates the age at issue
 
   // variable declarations
   double result = 0;
-  GDate *dob = g_date_new();
-  GDate *pid = g_date_new();
-
-  // assigning dates
-  g_date_set_parse( dob, policy->date_of_birth);
-  g_date_set_parse( pid, policy->issue_date);
+  gint dob = policy->dob;
+  gint pid = policy->pid;
 
   // calculation of duration at start
-  result = g_date_days_between(
-							   dob
-							   ,pid
-							   ) / DAYS_IN_YEAR;
+  result = ( pid - dob ) / study->days_in_year;
   result = floor( result );
-  
-  // frees memory from allocated dates
-  g_date_free(pid);
-  g_date_free(dob);
 
   return (int) result;
 }
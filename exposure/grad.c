@@ -0,0 +1,181 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Whittaker-Henderson graduation of the aggregate (see grad.h)
+//
+#include <stdio.h>       // fprintf
+#include <stdlib.h>      // calloc, malloc, free, exit
+#include <math.h>        // sqrt
+
+#include "grad.h"
+
+// lower band of a symmetric matrix of half-bandwidth p: element (i, j) for j <= i <= j + p
+#define BAND(b, p, i, j) ( (b)[ (size_t)(i) * ( (p) + 1 ) + (i) - (j) ] )
+
+// adds lambda D'D to the band for the differences along ~n_line~ lines of m cells, ~stride~ apart
+static void penalize( double *band, int p, double lambda, int m, int stride, int n_line, int line_stride ){
+  // coefficients of the differences of order GRAD_ORDER: (-1)^(z-k) C(z, k)
+  double d[GRAD_ORDER + 1];
+  d[0] = ( GRAD_ORDER % 2 == 0 ) ? 1 : -1;
+  for (int k = 1; k <= GRAD_ORDER; k++) {
+	d[k] = -d[k-1] * ( GRAD_ORDER - k + 1 ) / k;
+  }
+  for (int l = 0; l < n_line; l++) {
+	for (int r = 0; r + GRAD_ORDER < m; r++) {
+	  int first = l * line_stride + r * stride;
+	  for (int k = 0; k <= GRAD_ORDER; k++) {
+		for (int j = 0; j <= k; j++) {
+		  BAND( band, p, first + k * stride, first + j * stride ) += lambda * d[k] * d[j];
+		}
+	  }
+	}
+  }
+}
+
+// Cholesky factor L L' of the band, in place; false if the matrix is not positive definite
+static bool cholesky( double *band, int n, int p ){
+  for (int i = 0; i < n; i++) {
+	int j0 = ( i > p ) ? i - p : 0;
+	for (int j = j0; j <= i; j++) {
+	  double s = BAND( band, p, i, j );
+	  for (int k = j0; k < j; k++) {
+		s -= BAND( band, p, i, k ) * BAND( band, p, j, k );
+	  }
+	  if ( i == j ){
+		if ( s <= 0 ) return false;
+		BAND( band, p, i, i ) = sqrt( s );
+	  } else {
+		BAND( band, p, i, j ) = s / BAND( band, p, j, j );
+	  }
+	}
+  }
+  return true;
+}
+
+// solves L L' x = b, in place
+static void substitute( double *band, int n, int p, double *x ){
+  for (int i = 0; i < n; i++) {
+	for (int k = ( i > p ) ? i - p : 0; k < i; k++) {
+	  x[i] -= BAND( band, p, i, k ) * x[k];
+	}
+	x[i] /= BAND( band, p, i, i );
+  }
+  for (int i = n - 1; i >= 0; i--) {
+	for (int k = i + 1; k <= i + p && k < n; k++) {
+	  x[i] -= BAND( band, p, k, i ) * x[k];
+	}
+	x[i] /= BAND( band, p, i, i );
+  }
+}
+
+bool grad_solve(
+				const double *w     // weight of each cell (exposure), ~n_age~ x ~n_year~, policy years running fastest
+				,const double *c    // crude rate of each cell
+				,double *u          // graduated rate of each cell
+				,int n_age          // attained ages of the cells
+				,int n_year         // policy years of the cells (1 when graduated by attained age)
+				,double h           // smoothing along attained ages
+				,double v           // smoothing along policy years (unused when ~n_year~ is 1)
+				){
+  // the shorter side runs fastest in the system, keeping the band narrow
+  bool by_year = ( n_year <= n_age );
+  int n = n_age * n_year;
+  int fast = by_year ? n_year : n_age;
+  int p = GRAD_ORDER * ( ( n_year > 1 ) ? fast : 1 );
+  double *band = (double *) calloc( (size_t) n * ( p + 1 ), sizeof(double) );
+  int *cell = (int *) malloc( n * sizeof(int) );
+  if ( band == NULL || cell == NULL ){
+	fprintf( stderr, "Could not allocate memory for ~band~ pointer from within ~grad_solve()~ function. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+  // cell of each row of the system
+  for (int x = 0; x < n_age; x++) {
+	for (int t = 0; t < n_year; t++) {
+	  cell[ by_year ? x * n_year + t : t * n_age + x ] = x * n_year + t;
+	}
+  }
+  for (int i = 0; i < n; i++) {
+	BAND( band, p, i, i ) = w[ cell[i] ];
+	u[i] = w[ cell[i] ] * c[ cell[i] ];
+  }
+  if ( by_year ){
+	penalize( band, p, h, n_age, n_year, n_year, 1 );
+	if ( n_year > 1 ) penalize( band, p, v, n_year, 1, n_age, n_year );
+  } else {
+	penalize( band, p, h, n_age, 1, n_year, n_age );
+	penalize( band, p, v, n_year, n_age, n_age, 1 );
+  }
+  bool ok = cholesky( band, n, p );
+  if ( ok ){
+	substitute( band, n, p, u );
+	// back from the rows of the system to the cells
+	for (int i = 0; i < n; i++) {
+	  band[i] = u[i];
+	}
+	for (int i = 0; i < n; i++) {
+	  u[ cell[i] ] = band[i];
+	}
+  }
+  free( band );
+  free( cell );
+  return ok;
+}
+
+void grad_write(
+				agg_str *a          // cube whose rates are graduated
+				,FILE *f            // file receiving the graduated rates (~graduated.csv~)
+				,double h           // smoothing along attained ages
+				,double v           // smoothing along policy years, 0 to graduate by attained age only
+				,char **label       // values heading the lines of each group (NULL when not grouped)
+				){
+  for (long g = 0; g < a->n_group; g++) {
+	const char *l = ( label != NULL ) ? label[g] : "";
+
+	// ages and years between the first and the last cells with exposure
+	int x0 = AGG_AGES, x1 = -1, t0 = AGG_YEARS, t1 = -1;
+	for (int x = 0; x < AGG_AGES; x++) {
+	  for (int t = 1; t < AGG_YEARS; t++) {
+		if ( agg_get( a, g, x, t )->exposure <= 0 ) continue;
+		if ( x < x0 ) x0 = x;
+		if ( x > x1 ) x1 = x;
+		if ( t < t0 ) t0 = t;
+		if ( t > t1 ) t1 = t;
+	  }
+	}
+	if ( x1 < 0 ) continue;
+	int n_age = x1 - x0 + 1;
+	int n_year = ( v > 0 ) ? t1 - t0 + 1 : 1;
+
+	double *w = (double *) calloc( 3 * (size_t) n_age * n_year, sizeof(double) );
+	long *actual = (long *) calloc( (size_t) n_age * n_year, sizeof(long) );
+	if ( w == NULL || actual == NULL ){
+	  fprintf( stderr, "Could not allocate memory for ~w~ pointer from within ~grad_write()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+	double *c = w + (size_t) n_age * n_year;
+	double *u = c + (size_t) n_age * n_year;
+	for (int x = x0; x <= x1; x++) {
+	  for (int t = t0; t <= t1; t++) {
+		int i = ( x - x0 ) * n_year + ( ( v > 0 ) ? t - t0 : 0 );
+		const agg_cell *cell = agg_get( a, g, x, t );
+		w[i] += cell->exposure / 1e6;
+		actual[i] += cell->actual;
+	  }
+	}
+	for (int i = 0; i < n_age * n_year; i++) {
+	  c[i] = ( w[i] > 0 ) ? actual[i] / w[i] : 0;
+	}
+
+	if ( grad_solve( w, c, u, n_age, n_year, h, v ) == false ){
+	  fprintf( stderr, "%sToo few cells with exposure to be graduated.\n", l );
+	} else {
+	  for (int i = 0; i < n_age * n_year; i++) {
+		if ( v > 0 ){
+		  fprintf( f, "%s%d;%d;%ld;%f;%.8f;%.8f\n", l, x0 + i / n_year, t0 + i % n_year, actual[i], w[i], c[i], u[i] );
+		} else {
+		  fprintf( f, "%s%d;%ld;%f;%.8f;%.8f\n", l, x0 + i, actual[i], w[i], c[i], u[i] );
+		}
+	  }
+	}
+	free( w );
+	free( actual );
+  }
+}
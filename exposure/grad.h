@@ -0,0 +1,49 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Whittaker-Henderson graduation of the aggregate (--graduate)
+//
+//  The crude rates c = actual / exposure of the cube (agg.h) are graduated into the rates u minimizing
+//
+//    sum w (u - c)^2 + h sum (D_age^z u)^2 [ + v sum (D_year^z u)^2 ]
+//
+//  weighted by the exposures w (in years), where D^z are the differences of order z = GRAD_ORDER along attained
+//  ages (and along policy years). With --graduate=h the rates are graduated by attained age, the policy years added
+//  up; with --graduate=h,v over the whole cube, attained age x policy year. Either way the minimum solves
+//  (W + h D'D [+ v D'D]) u = W c, whose matrix is symmetric, positive definite and banded: ordered with the shorter
+//  side of the cube running fastest, its half-bandwidth is z times that side, and its Cholesky factor keeps that
+//  band. Only the band is stored and factored, O(n p^2) for n cells and half-bandwidth p, then solved in O(n p),
+//  against O(n^3) for the dense system. The cells between the first and last ages (and years) with exposure are
+//  graduated, the empty ones taking the rates the neighbours give them, into ~graduated.csv~:
+//
+//    attained_age;actual;exposure;crude;graduated                 (--graduate=h)
+//    attained_age;policy_year;actual;exposure;crude;graduated     (--graduate=h,v)
+//
+//  Grouped (--group-by, see group.h), each group is graduated on its own, its lines headed by its values.
+//
+#ifndef GRAD_H
+#define GRAD_H
+
+#include <stdio.h>       // FILE
+#include <stdbool.h>     // bool (data type)
+
+#include "agg.h"         // cube of aggregated exposures
+
+#define GRAD_ORDER 2     // order of the differences penalized
+
+bool grad_solve(
+				const double *w     // weight of each cell (exposure), ~n_age~ x ~n_year~, policy years running fastest
+				,const double *c    // crude rate of each cell
+				,double *u          // graduated rate of each cell
+				,int n_age          // attained ages of the cells
+				,int n_year         // policy years of the cells (1 when graduated by attained age)
+				,double h           // smoothing along attained ages
+				,double v           // smoothing along policy years (unused when ~n_year~ is 1)
+				);                  // false if the system is singular (too few cells with exposure)
+void grad_write(
+				agg_str *a          // cube whose rates are graduated
+				,FILE *f            // file receiving the graduated rates (~graduated.csv~)
+				,double h           // smoothing along attained ages
+				,double v           // smoothing along policy years, 0 to graduate by attained age only
+				,char **label       // values heading the lines of each group (NULL when not grouped)
+				);
+
+#endif
@@ -0,0 +1,370 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Grouping columns of the aggregate (see group.h)
+//
+//  Dictionaries of a few values (gender, channel, ...) are scanned, comparing lengths first: no hash is computed for
+//  them. Past DICT_SCAN values, the codes go into an open-addressing hash table (FNV-1a, linear probing).
+//
+#include <stdio.h>       // fprintf
+#include <stdlib.h>      // malloc, calloc, realloc, free, exit, qsort, atoi
+#include <string.h>      // memcmp, memcpy, memset, strlen, strcmp, strcat, strdup, strsep, strspn
+
+#include "group.h"
+#include "policy.h"      // POLICY_FIELDS
+
+#define DICT_SCAN 8      // values of a dictionary scanned before its hash table is built
+
+static uint64_t hash( const char *s, size_t len ){
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < len; i++) {
+	h = ( h ^ (unsigned char) s[i] ) * 1099511628211ULL;
+  }
+  return h;
+}
+
+// (re)builds the hash table of the dictionary with ~n_slot~ slots
+static void rehash( dict_str *d, long n_slot ){
+  free( d->slot );
+  d->slot = (long *) malloc( n_slot * sizeof(long) );
+  if ( d->slot == NULL ){
+	fprintf( stderr, "Could not allocate memory for ~d->slot~ pointer from within ~rehash()~ function. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+  d->n_slot = n_slot;
+  for (long i = 0; i < n_slot; i++) {
+	d->slot[i] = -1;
+  }
+  for (long c = 0; c < d->n; c++) {
+	long i = hash( d->value[c], d->len[c] ) & (n_slot - 1);
+	while ( d->slot[i] >= 0 ) {
+	  i = (i + 1) & (n_slot - 1);
+	}
+	d->slot[i] = c;
+  }
+}
+
+// copies a new value into the dictionary
+static long add( dict_str *d, const char *s, size_t len ){
+  if ( d->n == d->cap ){
+	d->cap = ( d->cap > 0 ) ? 2 * d->cap : DICT_SCAN;
+	d->value = (char **) realloc( d->value, d->cap * sizeof(char *) );
+	d->len = (size_t *) realloc( d->len, d->cap * sizeof(size_t) );
+	if ( d->value == NULL || d->len == NULL ){
+	  fprintf( stderr, "Could not allocate memory for ~d->value~ pointer from within ~add()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+  }
+  char *v = (char *) malloc( len + 1 );
+  if ( v == NULL ){
+	fprintf( stderr, "Could not allocate memory for ~v~ pointer from within ~add()~ function. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+  memcpy( v, s, len );
+  v[len] = '\0';
+  d->value[d->n] = v;
+  d->len[d->n] = len;
+  return d->n++;
+}
+
+// code of a value, added to the dictionary when first seen
+static long dict_code( dict_str *d, const char *s, size_t len ){
+  if ( d->n_slot == 0 ){
+	for (long c = 0; c < d->n; c++) {
+	  if ( d->len[c] == len && memcmp( d->value[c], s, len ) == 0 ) return c;
+	}
+	if ( d->n < DICT_SCAN ) return add( d, s, len );
+	rehash( d, 4 * DICT_SCAN );
+  }
+  if ( 2 * (d->n + 1) > d->n_slot ) rehash( d, 2 * d->n_slot );
+
+  long i = hash( s, len ) & (d->n_slot - 1);
+  while ( d->slot[i] >= 0 ) {
+	long c = d->slot[i];
+	if ( d->len[c] == len && memcmp( d->value[c], s, len ) == 0 ) return c;
+	i = (i + 1) & (d->n_slot - 1);
+  }
+  return d->slot[i] = add( d, s, len );
+}
+
+static void dict_free( dict_str *d ){
+  for (long c = 0; c < d->n; c++) {
+	free( d->value[c] );
+  }
+  free( d->value );
+  free( d->len );
+  free( d->slot );
+  memset( d, 0, sizeof(dict_str) );
+}
+
+// fields to be split out of each line, up to the last column (or the amount column)
+static void fields( group_by *gb ){
+  gb->n_field = POLICY_FIELDS;
+  for (int c = 0; c < gb->n; c++) {
+	if ( gb->col[c] + 1 > gb->n_field ) gb->n_field = gb->col[c] + 1;
+  }
+  if ( gb->amount_name != NULL && gb->amount + 1 > gb->n_field ) gb->n_field = gb->amount + 1;
+}
+
+bool group_by_parse(
+					group_by *gb        // columns to be filled
+					,char *arg          // comma-separated positions or names, as given to --group-by
+					){
+  for (int c = 0; c < gb->n; c++) {
+	free( gb->name[c] );
+  }
+  gb->n = 0;
+  char *copy = strdup( arg );
+  if ( copy == NULL ){
+	fprintf( stderr, "Could not allocate memory for ~copy~ pointer from within ~group_by_parse()~ function. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+  bool ok = true;
+  char *rest = copy, *name;
+  while ( ok && (name = strsep( &rest, "," )) != NULL ) {
+	if ( name[0] == '\0' ){
+	  fprintf( stderr, "Empty column name in --group-by=%s.\n", arg );
+	  ok = false;
+	  break;
+	}
+	if ( gb->n == GROUP_COLS ){
+	  fprintf( stderr, "At most %d columns can be grouped by.\n", GROUP_COLS );
+	  ok = false;
+	  break;
+	}
+	// a position (1 for the first column) or a name, found later in the header
+	int col = -1;
+	if ( strspn( name, "0123456789" ) == strlen( name ) ){
+	  col = atoi( name ) - 1;
+	  if ( col < 0 ){
+		fprintf( stderr, "Columns are numbered from 1 in --group-by=%s.\n", arg );
+		ok = false;
+		break;
+	  }
+	}
+	gb->col[gb->n] = col;
+	gb->name[gb->n] = strdup( name );
+	gb->n++;
+  }
+  free( copy );
+
+  fields( gb );
+  return ok;
+}
+
+bool group_by_amount(
+					 group_by *gb        // columns receiving the amount column
+					 ,char *arg          // position or name, as given to --amount
+					 ){
+  free( gb->amount_name );
+  gb->amount_name = NULL;
+  if ( arg[0] == '\0' ){
+	fprintf( stderr, "Empty column name in --amount.\n" );
+	return false;
+  }
+  // a position (1 for the first column) past the inputs of the policy, or a name, found later in the header
+  gb->amount = -1;
+  if ( strspn( arg, "0123456789" ) == strlen( arg ) ){
+	gb->amount = atoi( arg ) - 1;
+	if ( gb->amount < POLICY_FIELDS ){
+	  fprintf( stderr, "The amount column comes after the %d inputs of a policy, from column %d.\n", POLICY_FIELDS, POLICY_FIELDS + 1 );
+	  return false;
+	}
+  }
+  gb->amount_name = strdup( arg );
+  fields( gb );
+  return true;
+}
+
+bool group_by_named(
+					group_by *gb        // columns
+					){
+  for (int c = 0; c < gb->n; c++) {
+	if ( gb->col[c] < 0 ) return true;
+  }
+  return gb->amount_name != NULL && gb->amount < 0;
+}
+
+bool group_by_header(
+					 group_by *gb        // columns, whose names are looked up in ...
+					 ,char *header       // ... the header line (cut in place at each delimiter)
+					 ){
+  char *rest = header, *name;
+  for (int k = 0; (name = strsep( &rest, ";" )) != NULL; k++) {
+	// header of a file edited elsewhere ("\r\n")
+	size_t len = strlen( name );
+	if ( len > 0 && name[len - 1] == '\r' ) name[len - 1] = '\0';
+	for (int c = 0; c < gb->n; c++) {
+	  if ( gb->col[c] < 0 && strcmp( gb->name[c], name ) == 0 ) gb->col[c] = k;
+	}
+	if ( gb->amount_name != NULL && gb->amount < 0 && strcmp( gb->amount_name, name ) == 0 ) gb->amount = k;
+  }
+
+  bool ok = true;
+  for (int c = 0; c < gb->n; c++) {
+	if ( gb->col[c] < 0 ){
+	  fprintf( stderr, "Column '%s' of --group-by is not in the header of stdin.\n", gb->name[c] );
+	  ok = false;
+	}
+  }
+  if ( gb->amount_name != NULL && gb->amount < 0 ){
+	fprintf( stderr, "Column '%s' of --amount is not in the header of stdin.\n", gb->amount_name );
+	ok = false;
+  }
+  fields( gb );
+  return ok;
+}
+
+void group_by_free(
+				   group_by *gb        // columns whose names are freed
+				   ){
+  for (int c = 0; c < gb->n; c++) {
+	free( gb->name[c] );
+  }
+  free( gb->amount_name );
+  memset( gb, 0, sizeof(group_by) );
+}
+
+void group_init(
+				group_str *g        // dictionaries to be initialized, empty
+				,int n_col          // amount of grouping columns
+				){
+  memset( g, 0, sizeof(group_str) );
+  g->dict = (dict_str *) calloc( n_col > 0 ? n_col : 1, sizeof(dict_str) );
+  if ( g->dict == NULL ){
+	fprintf( stderr, "Could not allocate memory for ~g->dict~ pointer from within ~group_init()~ function. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+}
+
+uint16_t group_code(
+					group_str *g        // dictionaries of the worker thread
+					,const group_by *gb // grouping columns
+					,char **field       // fields of the line, from policy_split()
+					){
+  // codes of the values of the columns, then code of their combination (its bytes)
+  // (a column has no more values than there are groups)
+  uint16_t key[GROUP_COLS];
+  long group = 0;
+  for (int c = 0; c < gb->n && group < GROUP_MAX; c++) {
+	// (the last column of a line of a CRLF file ends with its '\r', left out of the value)
+	const char *v = field[ gb->col[c] ];
+	size_t len = strlen( v );
+	if ( len > 0 && v[ len - 1 ] == '\r' ) len--;
+	group = dict_code( &g->dict[c], v, len );
+	key[c] = (uint16_t) group;
+  }
+  if ( group < GROUP_MAX ) group = dict_code( &g->combo, (const char *) key, gb->n * sizeof(uint16_t) );
+  if ( group >= GROUP_MAX ){
+	fprintf( stderr, "More than %d groups (combinations of the values of --group-by) from within ~group_code()~ function. Aborting...\n", GROUP_MAX );
+	exit( EXIT_FAILURE );
+  }
+  return (uint16_t) group;
+}
+
+// group to be sorted by its values, column by column: qsort() takes no context, so each entry carries its own
+// (group_collect() may run in several threads at once, one per request of --serve)
+typedef struct group_sort
+{
+  long code;           // group in ~g->combo~
+  const group_str *g;  // dictionaries of the group
+  int n_col;           // amount of grouping columns
+} group_sort;
+
+static int by_values( const void *a, const void *b ){
+  const group_sort *sa = (const group_sort *) a, *sb = (const group_sort *) b;
+  uint16_t ka[GROUP_COLS], kb[GROUP_COLS];
+  memcpy( ka, sa->g->combo.value[ sa->code ], sa->n_col * sizeof(uint16_t) );
+  memcpy( kb, sb->g->combo.value[ sb->code ], sb->n_col * sizeof(uint16_t) );
+  for (int c = 0; c < sa->n_col; c++) {
+	int r = strcmp( sa->g->dict[c].value[ ka[c] ], sb->g->dict[c].value[ kb[c] ] );
+	if ( r != 0 ) return r;
+  }
+  return 0;
+}
+
+long group_collect(
+				   group_str *g        // dictionaries of each worker thread
+				   ,int n_g            // amount of worker threads
+				   ,const group_by *gb // grouping columns
+				   ,long **map         // allocated: group of each group of each worker thread
+				   ,char ***label      // allocated: values of each group, "value;value;" (heading the lines of the cube)
+				   ){
+  // groups of every worker, re-coded into the dictionaries of ~all~
+  group_str all;
+  group_init( &all, gb->n );
+  uint16_t key[GROUP_COLS], k[GROUP_COLS];
+  for (int w = 0; w < n_g; w++) {
+	map[w] = (long *) malloc( ( g[w].combo.n > 0 ? g[w].combo.n : 1 ) * sizeof(long) );
+	if ( map[w] == NULL ){
+	  fprintf( stderr, "Could not allocate memory for ~map~ pointer from within ~group_collect()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+	for (long i = 0; i < g[w].combo.n; i++) {
+	  memcpy( k, g[w].combo.value[i], gb->n * sizeof(uint16_t) );
+	  for (int c = 0; c < gb->n; c++) {
+		key[c] = (uint16_t) dict_code( &all.dict[c], g[w].dict[c].value[ k[c] ], g[w].dict[c].len[ k[c] ] );
+	  }
+	  map[w][i] = dict_code( &all.combo, (const char *) key, gb->n * sizeof(uint16_t) );
+	}
+  }
+
+  // sorted by their values: the rank of each group is its final code
+  long n = all.combo.n;
+  group_sort *order = (group_sort *) malloc( ( n > 0 ? n : 1 ) * sizeof(group_sort) );
+  long *rank = (long *) malloc( ( n > 0 ? n : 1 ) * sizeof(long) );
+  *label = (char **) malloc( ( n > 0 ? n : 1 ) * sizeof(char *) );
+  if ( order == NULL || rank == NULL || *label == NULL ){
+	fprintf( stderr, "Could not allocate memory for the groups from within ~group_collect()~ function. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+  for (long i = 0; i < n; i++) {
+	order[i] = (group_sort) { i, &all, gb->n };
+  }
+  qsort( order, n, sizeof(group_sort), by_values );
+  for (long r = 0; r < n; r++) {
+	rank[ order[r].code ] = r;
+  }
+  for (int w = 0; w < n_g; w++) {
+	for (long i = 0; i < g[w].combo.n; i++) {
+	  map[w][i] = rank[ map[w][i] ];
+	}
+  }
+
+  // labels: the values of each group, delimited as the lines of the cube
+  for (long r = 0; r < n; r++) {
+	memcpy( k, all.combo.value[ order[r].code ], gb->n * sizeof(uint16_t) );
+	size_t len = 1;
+	for (int c = 0; c < gb->n; c++) {
+	  len += all.dict[c].len[ k[c] ] + 1;
+	}
+	char *s = (char *) malloc( len );
+	if ( s == NULL ){
+	  fprintf( stderr, "Could not allocate memory for ~s~ pointer from within ~group_collect()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+	s[0] = '\0';
+	for (int c = 0; c < gb->n; c++) {
+	  strcat( s, all.dict[c].value[ k[c] ] );
+	  strcat( s, ";" );
+	}
+	(*label)[r] = s;
+  }
+
+  free( order );
+  free( rank );
+  group_free( &all, gb->n );
+  return n;
+}
+
+void group_free(
+				group_str *g        // dictionaries to be freed
+				,int n_col          // amount of grouping columns
+				){
+  if ( g->dict != NULL ){
+	for (int c = 0; c < n_col; c++) {
+	  dict_free( &g->dict[c] );
+	}
+	free( g->dict );
+  }
+  dict_free( &g->combo );
+  g->dict = NULL;
+}
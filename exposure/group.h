@@ -0,0 +1,100 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Grouping columns of the aggregate (--group-by)
+//
+//  Extra columns of stdin (past the five inputs of a policy, e.g. gender, product or channel) break the cube of the
+//  aggregate down (agg.h), each combination of their values being a group of its own:
+//
+//    --group-by=6,7             columns by their position in the line (the first one is 1)
+//    --group-by=gender,channel  columns by their name in the header, the first line of stdin (left out by --skip)
+//
+//  Values are dictionary-encoded while the line is packed: each column has a dictionary of the values seen so far,
+//  and the codes of the columns of a line, in turn, a dictionary of the combinations seen so far, whose code is the
+//  group of the policy (~policy_str.group~). The cube is then dense in the groups, [group][attained age][policy year],
+//  with no string handled past the packing of the line.
+//
+//  The amount column (--amount, e.g. the sum assured weighting the exposures) is an extra column of stdin as well,
+//  given and found in the header the same way, though not grouping the cube.
+//
+//  Each worker thread keeps its own dictionaries (no lock, codes in the order the worker met the values): once the
+//  input ends, group_collect() maps the groups of every worker into one set of groups, sorted by their values, so
+//  that ~aggregate.csv~ does not depend on the amount of threads.
+//
+#ifndef GROUP_H
+#define GROUP_H
+
+#include <stddef.h>      // size_t
+#include <stdint.h>      // uint16_t
+#include <stdbool.h>     // bool (data type)
+
+#define GROUP_COLS 8        // most grouping columns
+#define GROUP_MAX  65535    // most groups (combinations of values) seen by a worker thread (see ~policy_str.group~)
+
+// columns given to --group-by
+typedef struct group_by
+{
+  int n;                   // amount of grouping columns, 0 when not grouped
+  int col[GROUP_COLS];     // field of each column in the line (0 for the first), -1 until found in the header
+  char *name[GROUP_COLS];  // each column as given: position or name in the header
+  int n_field;             // fields to be split out of each line: past the inputs of the policy and every column
+  char *amount_name;       // amount column as given (--amount): position or name in the header, NULL when none
+  int amount;              // field of the amount column in the line, -1 until found in the header
+} group_by;
+
+// dictionary of byte strings, coded 0, 1, 2, ... in the order they were added
+typedef struct dict_str
+{
+  char **value;        // values, NUL-terminated copies
+  size_t *len;         // bytes of each value
+  long n;              // amount of values
+  long cap;            // size of ~value~ and ~len~
+  long *slot;          // open-addressing hash table of the codes, -1 when empty
+  long n_slot;         // size of ~slot~ (a power of 2, at least twice ~n~)
+} dict_str;
+
+// dictionaries of a worker thread
+typedef struct group_str
+{
+  dict_str *dict;      // values of each grouping column
+  dict_str combo;      // combinations of the codes of the columns: the groups
+} group_str;
+
+bool group_by_parse(
+					group_by *gb        // columns to be filled
+					,char *arg          // comma-separated positions or names, as given to --group-by
+					);                  // false if the columns are not valid
+bool group_by_amount(
+					 group_by *gb        // columns receiving the amount column
+					 ,char *arg          // position or name, as given to --amount
+					 );                  // false if the column is not valid
+bool group_by_named(
+					group_by *gb        // columns
+					);                  // some columns (or the amount column) are given by name, to be found in the header
+bool group_by_header(
+					 group_by *gb        // columns, whose names are looked up in ...
+					 ,char *header       // ... the header line (cut in place at each delimiter)
+					 );                  // false if a name is not in the header
+void group_by_free(
+				   group_by *gb        // columns whose names are freed
+				   );
+void group_init(
+				group_str *g        // dictionaries to be initialized, empty
+				,int n_col          // amount of grouping columns
+				);
+uint16_t group_code(
+					group_str *g        // dictionaries of the worker thread
+					,const group_by *gb // grouping columns
+					,char **field       // fields of the line, from policy_split()
+					);                  // group of the line
+long group_collect(
+				   group_str *g        // dictionaries of each worker thread
+				   ,int n_g            // amount of worker threads
+				   ,const group_by *gb // grouping columns
+				   ,long **map         // allocated: group of each group of each worker thread
+				   ,char ***label      // allocated: values of each group, "value;value;" (heading the lines of the cube)
+				   );                  // amount of groups
+void group_free(
+				group_str *g        // dictionaries to be freed
+				,int n_col          // amount of grouping columns
+				);
+
+#endif
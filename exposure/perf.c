@@ -0,0 +1,125 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Hardware performance counters of the stages of process_lines() (see perf.h)
+//
+#include <stdio.h>       // fprintf
+#include <string.h>      // memset, strerror
+#include <errno.h>       // errno
+#include <unistd.h>      // read, close, syscall
+#include <sys/syscall.h> // SYS_perf_event_open
+#include <linux/perf_event.h>  // struct perf_event_attr, PERF_COUNT_...
+
+#include "perf.h"
+
+static const struct { uint32_t type; uint64_t config; const char *name; } event[PERF_EVENTS] = {
+  { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK,      "task_ms" },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,      "cycles" },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,    "instructions" },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES,    "llc_misses" },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES,   "branch_misses" },
+};
+enum { TASK_CLOCK, CYCLES, INSTRUCTIONS };
+
+static const char *stage_name[PERF_STAGES] = { "tokenize", "validate", "expose" };
+
+// the first counter that could not be opened, and why, is told once
+static int warned = 0;
+
+static void open_counters( perf_str *p ){
+  p->opened = true;
+  for (int e = 0; e < PERF_EVENTS; e++) {
+	struct perf_event_attr attr;
+	memset( &attr, 0, sizeof(attr) );
+	attr.size = sizeof(attr);
+	attr.type = event[e].type;
+	attr.config = event[e].config;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	// calling thread, any CPU, no group
+	p->fd[e] = syscall( SYS_perf_event_open, &attr, 0, -1, -1, 0 );
+	if ( p->fd[e] < 0 && __atomic_exchange_n( &warned, 1, __ATOMIC_RELAXED ) == 0 ){
+	  fprintf( stderr, "Some performance counters are not available (%s: %s), reported as n/a.\n",
+			   event[e].name, strerror( errno ) );
+	}
+  }
+}
+
+// count of the counter, scaled up when multiplexed
+static double counter( int fd ){
+  uint64_t v[3];
+  if ( read( fd, v, sizeof(v) ) != sizeof(v) || v[2] == 0 ) return 0;
+  return (double) v[0] * ( (double) v[1] / v[2] );
+}
+
+void perf_init(
+			   perf_str *p         // counters of a worker thread, not yet opened
+			   ){
+  memset( p, 0, sizeof(perf_str) );
+  for (int e = 0; e < PERF_EVENTS; e++) {
+	p->fd[e] = -1;
+  }
+}
+
+void perf_mark(
+			   perf_str *p         // counters of the calling worker thread (opened by its first mark)
+			   ,int stage          // stage charged with the counts since the last mark, -1 for none (start)
+			   ){
+  if ( p->opened == false ) open_counters( p );
+  for (int e = 0; e < PERF_EVENTS; e++) {
+	if ( p->fd[e] < 0 ) continue;
+	double now = counter( p->fd[e] );
+	if ( stage >= 0 ) p->count[stage][e] += now - p->last[e];
+	p->last[e] = now;
+  }
+}
+
+void perf_report(
+				 perf_str *p         // counters of each worker thread
+				 ,int n              // amount of worker threads
+				 ,FILE *f            // where the table of counts per stage is written (e.g. stderr)
+				 ){
+  long policies = 0;
+  bool available[PERF_EVENTS] = { false };
+  for (int i = 0; i < n; i++) {
+	policies += p[i].policies;
+	for (int e = 0; e < PERF_EVENTS; e++) {
+	  if ( p[i].fd[e] >= 0 ) available[e] = true;
+	}
+  }
+  fprintf( f, "stage;policies;task_ms;cycles;instructions;ipc;llc_misses;branch_misses;"
+		   "cycles_per_1M;instructions_per_1M;llc_misses_per_1M;branch_misses_per_1M\n" );
+  for (int s = 0; s < PERF_STAGES; s++) {
+	double total[PERF_EVENTS] = { 0 };
+	for (int i = 0; i < n; i++) {
+	  for (int e = 0; e < PERF_EVENTS; e++) {
+		total[e] += p[i].count[s][e];
+	  }
+	}
+	total[TASK_CLOCK] /= 1e6; // ns to ms
+	fprintf( f, "%s;%ld", stage_name[s], policies );
+	for (int e = 0; e < PERF_EVENTS; e++) {
+	  if ( available[e] == false ) fprintf( f, ";n/a" );
+	  else if ( e == TASK_CLOCK ) fprintf( f, ";%.3f", total[e] );
+	  else fprintf( f, ";%.0f", total[e] );
+	  // instructions per cycle, after the instructions
+	  if ( e == INSTRUCTIONS ){
+		if ( available[CYCLES] && available[INSTRUCTIONS] && total[CYCLES] > 0 ) fprintf( f, ";%.3f", total[INSTRUCTIONS] / total[CYCLES] );
+		else fprintf( f, ";n/a" );
+	  }
+	}
+	for (int e = CYCLES; e < PERF_EVENTS; e++) {
+	  if ( available[e] == false || policies == 0 ) fprintf( f, ";n/a" );
+	  else fprintf( f, ";%.0f", total[e] * 1e6 / policies );
+	}
+	fprintf( f, "\n" );
+  }
+}
+
+void perf_close(
+				perf_str *p         // counters whose file descriptors are closed
+				){
+  for (int e = 0; e < PERF_EVENTS; e++) {
+	if ( p->fd[e] >= 0 ) close( p->fd[e] );
+	p->fd[e] = -1;
+  }
+}
@@ -0,0 +1,60 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Hardware performance counters of the stages of process_lines() (--perf-counters)
+//
+//  Each worker thread opens its own counters with perf_event_open(2), counting that thread only (user space), the
+//  first time it processes lines: task clock, cycles, instructions, last level cache misses and branch misses. The
+//  counters are read at the end of each stage of a chunk of lines, the counts since the previous read charged to the
+//  stage that just ended:
+//
+//    tokenize   splitting the lines and packing the policies (step 3, with the grouping columns)
+//    validate   validating the policies against each study (step 4)
+//    expose     exposing the valid ones (step 5, with the aggregate and the writers)
+//
+//  and reported on stderr once the input is over, added up over the worker threads, in totals and per million
+//  policies (lines of the input). Counters the kernel does not offer (e.g. no PMU in a virtual machine, or
+//  perf_event_paranoid) are reported as n/a: the run goes on, with whatever counters could be opened. Counts are
+//  scaled up by the time the kernel had them enabled over running, when it multiplexes them.
+//
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdio.h>       // FILE
+#include <stdint.h>      // uint64_t
+#include <stdbool.h>     // bool (data type)
+
+#define PERF_EVENTS 5    // task clock, cycles, instructions, LLC misses, branch misses
+
+typedef enum perf_stage
+{
+  PERF_TOKENIZE = 0,
+  PERF_VALIDATE,
+  PERF_EXPOSE,
+  PERF_STAGES
+} perf_stage;
+
+typedef struct perf_str
+{
+  bool opened;         // the worker thread tried to open its counters
+  int fd[PERF_EVENTS]; // file descriptor of each counter, -1 when not available
+  double last[PERF_EVENTS];   // counts at the last read
+  double count[PERF_STAGES][PERF_EVENTS];  // counts charged to each stage
+  long policies;       // lines processed by the worker thread
+} perf_str;
+
+void perf_init(
+			   perf_str *p         // counters of a worker thread, not yet opened
+			   );
+void perf_mark(
+			   perf_str *p         // counters of the calling worker thread (opened by its first mark)
+			   ,int stage          // stage charged with the counts since the last mark, -1 for none (start)
+			   );
+void perf_report(
+				 perf_str *p         // counters of each worker thread
+				 ,int n              // amount of worker threads
+				 ,FILE *f            // where the table of counts per stage is written (e.g. stderr)
+				 );
+void perf_close(
+				perf_str *p         // counters whose file descriptors are closed
+				);
+
+#endif
@@ -0,0 +1,179 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Compact policy record (see policy.h)
+//
+#include <stdio.h>       // fprintf
+#include <stdlib.h>      // malloc, realloc, free, exit, strtod
+#include <string.h>      // strchr, strlen, memcpy, strncpy, strcmp
+#include <math.h>        // llround
+
+#include "policy.h"
+#include "datecache.h"   // memoized date parsing, shared with ../dates
+
+// size of the blocks of the arena (a larger one for an ID that would not fit)
+#define ARENA_BLOCK (64 << 10)
+
+_Static_assert( sizeof(policy_str) == 32, "policy_str must stay a 32-byte record" );
+
+int32_t epoch_days(
+				   guint32 julian      // julian day number, 0 (G_DATE_BAD_JULIAN) when invalid
+				   ){
+  return ( julian == 0 ) ? POLICY_DATE_NONE : (int32_t) julian - EPOCH_JULIAN;
+}
+
+// civil dates of the days since 1970-01-01 and back, by eras of 400 years starting on March 1st (the leap day last)
+void epoch_to_civil(
+					int32_t days        // days since 1970-01-01
+					,int *y             // year
+					,int *m             // month 1 .. 12
+					,int *d             // day 1 .. 31
+					){
+  long z = (long) days + 719468;
+  long era = ( z >= 0 ? z : z - 146096 ) / 146097;
+  long doe = z - era * 146097;
+  long yoe = ( doe - doe / 1460 + doe / 36524 - doe / 146096 ) / 365;
+  long doy = doe - ( 365 * yoe + yoe / 4 - yoe / 100 );
+  long mp = ( 5 * doy + 2 ) / 153;
+  *d = doy - ( 153 * mp + 2 ) / 5 + 1;
+  *m = ( mp < 10 ) ? mp + 3 : mp - 9;
+  *y = yoe + era * 400 + ( *m <= 2 ? 1 : 0 );
+}
+
+int32_t civil_to_epoch(
+					   int y               // year
+					   ,int m              // month 1 .. 12
+					   ,int d              // day 1 .. 31
+					   ){
+  long yy = ( m <= 2 ) ? y - 1 : y;
+  long era = ( yy >= 0 ? yy : yy - 399 ) / 400;
+  long yoe = yy - era * 400;
+  long doy = ( 153 * ( m > 2 ? m - 3 : m + 9 ) + 2 ) / 5 + d - 1;
+  long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return (int32_t) ( era * 146097 + doe - 719468 );
+}
+
+int64_t policy_amount(
+					  const char *field   // amount of the policy as read from stdin (e.g. its sum assured)
+					  ){
+  // summed up in integers, as the exposures are: the sums of the aggregate do not depend on the order of the policies
+  char *rest = NULL;
+  double amount = strtod( field, &rest );
+  if ( rest == field || ( *rest != '\0' && strcmp( rest, "\r" ) != 0 ) || !( amount >= 0 && amount < 1e15 ) ){
+	return POLICY_AMOUNT_NONE;
+  }
+  return llround( amount * 100 );
+}
+
+int policy_split(
+				 char *line          // line of stdin, cut in place at each delimiter
+				 ,char **field       // ~n_field~ views into ~line~, "" for the missing ones
+				 ,int n_field        // fields to be split out: POLICY_FIELDS, or more for the grouping columns
+				 ){
+  // as strsep() does, each ';' ending a field is overwritten by '\0', so empty fields are kept; fields past the
+  // last one are left in the last view, cut at its ';'
+  int k = 0;
+  char *p = line;
+  while ( k < n_field && p != NULL ) {
+	field[k++] = p;
+	p = strchr( p, ';' );
+	if ( p != NULL ) *p++ = '\0';
+  }
+  int found = k;
+  while ( k < n_field ) {
+	field[k++] = "";
+  }
+  return found;
+}
+
+// copies an ID longer than POLICY_ID_INLINE characters into the arena
+static char *spill( policy_arena *a, const char *id, size_t len ){
+  if ( a->n_block == 0 || a->used + len + 1 > a->size[a->cur] ){
+	if ( a->n_block > 0 ) a->cur++;
+	a->used = 0;
+	size_t size = ( len + 1 > ARENA_BLOCK ) ? len + 1 : ARENA_BLOCK;
+	if ( a->cur == a->n_block ){
+	  a->block = (char **) realloc( a->block, (a->n_block + 1) * sizeof(char *) );
+	  a->size = (size_t *) realloc( a->size, (a->n_block + 1) * sizeof(size_t) );
+	  if ( a->block == NULL || a->size == NULL ){
+		fprintf( stderr, "Could not allocate memory for ~a->block~ pointer from within ~spill()~ function. Aborting...\n");
+		exit( EXIT_FAILURE );
+	  }
+	  a->block[a->cur] = NULL;
+	  a->size[a->cur] = 0;
+	  a->n_block++;
+	}
+	// a block kept from a previous chunk may be too small for this ID (it holds nothing yet)
+	if ( a->size[a->cur] < size ){
+	  a->block[a->cur] = (char *) realloc( a->block[a->cur], size );
+	  a->size[a->cur] = size;
+	  if ( a->block[a->cur] == NULL ){
+		fprintf( stderr, "Could not allocate memory for the arena of IDs from within ~spill()~ function. Aborting...\n");
+		exit( EXIT_FAILURE );
+	  }
+	}
+  }
+  char *s = a->block[a->cur] + a->used;
+  memcpy( s, id, len + 1 );
+  a->used += len + 1;
+  return s;
+}
+
+void policy_pack(
+				 policy_str *p       // record to be filled
+				 ,char **field       // fields of the line, from policy_split()
+				 ,policy_arena *a    // arena of the worker thread, receiving the long IDs
+				 ){
+  // ID: inline, zero-padded, or spilled
+  size_t len = strlen( field[0] );
+  if ( len <= POLICY_ID_INLINE ){
+	strncpy( p->id, field[0], POLICY_ID_INLINE + 1 );
+  } else {
+	char *s = spill( a, field[0], len );
+	memcpy( p->id, &s, sizeof(char *) );
+	p->id[POLICY_ID_INLINE] = POLICY_ID_SPILLED;
+  }
+
+  // dates, parsed once (memoized, see ../dates/datecache.h)
+  p->dob = epoch_days( date_julian( field[1] ) );
+  p->pid = epoch_days( date_julian( field[2] ) );
+  p->psd = epoch_days( date_julian( field[4] ) );
+
+  // status code: valid as atoi() reads it between 1 and 6; exact when spelled as that single digit, since the claims
+  // of a study are the status codes spelled as its type
+  int code = atoi( field[3] );
+  p->status = ( code >= 1 && code <= 6 ) ? code : 0;
+  p->flags = ( p->status != 0 && field[3][0] == '0' + code && field[3][1] == '\0' ) ? POLICY_STATUS_EXACT : 0;
+  p->group = 0;
+}
+
+const char *policy_id(
+					  const policy_str *p // record
+					  ){
+  if ( p->id[POLICY_ID_INLINE] == POLICY_ID_SPILLED ){
+	const char *s;
+	memcpy( &s, p->id, sizeof(char *) );
+	return s;
+  }
+  return p->id;
+}
+
+void policy_arena_reset(
+						policy_arena *a     // arena whose IDs are no longer needed (blocks kept for reuse)
+						){
+  a->cur = 0;
+  a->used = 0;
+}
+
+void policy_arena_free(
+					   policy_arena *a     // arena whose blocks are freed
+					   ){
+  for (int i = 0; i < a->n_block; i++) {
+	free( a->block[i] );
+  }
+  free( a->block );
+  free( a->size );
+  a->block = NULL;
+  a->size = NULL;
+  a->n_block = 0;
+  a->cur = 0;
+  a->used = 0;
+}
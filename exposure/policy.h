@@ -0,0 +1,92 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Compact policy record
+//
+//  Each line of stdin is packed into a fixed record of 32 bytes, instead of five strings on the heap:
+//
+//    id       16 bytes  IDs of up to POLICY_ID_INLINE characters inline (NUL-terminated); longer ones are copied into
+//                       the arena of the worker thread, the record keeping a pointer to them (the last byte of ~id~
+//                       then holds POLICY_ID_SPILLED)
+//    dob      int32     dates as days since 1970-01-01, POLICY_DATE_NONE when invalid or missing
+//    pid      int32
+//    psd      int32
+//    status   uint8     status code 1 .. 6, 0 when invalid
+//    flags    uint8     POLICY_STATUS_EXACT: status code spelled as its single digit
+//    group    uint16    group of the policy in the aggregate (--group-by, see group.h), 0 when not grouped
+//
+//  so the records of a chunk of lines stay in L1 and a batch of 64k policies (2 MB) in L2. The fields as read from
+//  stdin (views into the line) are kept aside for the LOG of the policies out of study, the cold path.
+//
+#ifndef POLICY_H
+#define POLICY_H
+
+#include <stdint.h>      // int32_t, uint8_t
+#include <stddef.h>      // size_t
+#include <glib.h>        // guint32
+
+#define POLICY_FIELDS     5            // id;date_of_birth;policy_issue_date;policy_status_code;policy_status_date
+#define POLICY_ID_INLINE  15           // longest ID stored inline
+#define POLICY_ID_SPILLED ((char) 0xFF) // last byte of ~id~ of an ID spilled into the arena
+#define POLICY_DATE_NONE  INT32_MIN    // invalid or missing date
+#define POLICY_STATUS_EXACT 0x01       // status code spelled as its single digit (see ~policy_str.flags~)
+#define EPOCH_JULIAN      719163       // julian day number (glib) of 1970-01-01
+#define POLICY_AMOUNT_NONE INT64_MIN   // invalid or missing amount (--amount)
+
+typedef struct policy_str
+{
+  char id[POLICY_ID_INLINE + 1];  // ID inline, or pointer to the ID in the arena (see POLICY_ID_SPILLED)
+  int32_t dob;         // date of birth of policyholder, in days since 1970-01-01
+  int32_t pid;         // policy issue date, in days since 1970-01-01
+  int32_t psd;         // policy status date, in days since 1970-01-01 (POLICY_DATE_NONE when missing)
+  uint8_t status;      // 1 Inforce, 2 Lapsed, 3 Death, 4 Accidental Death, 5 TPD Disease, 6 TPD Accident (0 invalid)
+  uint8_t flags;       // POLICY_STATUS_EXACT
+  uint16_t group;      // code of the values of the grouping columns (group.h)
+} policy_str;
+
+// IDs longer than POLICY_ID_INLINE characters, in blocks reused from one chunk of lines to the next
+typedef struct policy_arena
+{
+  char **block;        // blocks of memory, never moved once allocated
+  size_t *size;        // size of each block
+  int n_block;
+  int cur;             // block being filled
+  size_t used;         // bytes used in the block being filled
+} policy_arena;
+
+int32_t epoch_days(
+				   guint32 julian      // julian day number, 0 (G_DATE_BAD_JULIAN) when invalid
+				   );                  // days since 1970-01-01, POLICY_DATE_NONE when invalid
+void epoch_to_civil(
+					int32_t days        // days since 1970-01-01
+					,int *y             // year
+					,int *m             // month 1 .. 12
+					,int *d             // day 1 .. 31
+					);
+int32_t civil_to_epoch(
+					   int y               // year
+					   ,int m              // month 1 .. 12
+					   ,int d              // day 1 .. 31
+					   );                  // days since 1970-01-01
+int64_t policy_amount(
+					  const char *field   // amount of the policy as read from stdin (e.g. its sum assured)
+					  );                  // amount in hundredths (cents), POLICY_AMOUNT_NONE unless a non-negative number
+int policy_split(
+				 char *line          // line of stdin, cut in place at each delimiter
+				 ,char **field       // ~n_field~ views into ~line~, "" for the missing ones
+				 ,int n_field        // fields to be split out: POLICY_FIELDS, or more for the grouping columns
+				 );                  // amount of fields found in the line
+void policy_pack(
+				 policy_str *p       // record to be filled
+				 ,char **field       // fields of the line, from policy_split()
+				 ,policy_arena *a    // arena of the worker thread, receiving the long IDs
+				 );
+const char *policy_id(
+					  const policy_str *p // record
+					  );                  // ID of the policy, inline or in the arena
+void policy_arena_reset(
+						policy_arena *a     // arena whose IDs are no longer needed (blocks kept for reuse)
+						);
+void policy_arena_free(
+					   policy_arena *a     // arena whose blocks are freed
+					   );
+
+#endif
@@ -0,0 +1,89 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Bounded queues between the stages of the threaded exposure engine (see queue.h)
+//
+//  Circular buffer of ~capacity~ pointers, guarded by one mutex, with one condition for each side.
+//
+#include <stdio.h>       // fprintf
+#include <stdlib.h>      // calloc, free, exit
+#include <stdbool.h>     // bool (data type)
+#include <pthread.h>     // mutex and conditions
+
+#include "queue.h"
+
+struct queue_str
+{
+  void **item;         // circular buffer of batches
+  int capacity;
+  int head;            // oldest batch
+  int n;               // batches in the queue
+  bool closed;         // no more batches will be pushed
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+};
+
+queue_str *queue_new(
+					 int capacity        // batches held at most
+					 ){
+  queue_str *q = (queue_str *) calloc( 1, sizeof(queue_str) );
+  if ( q == NULL || capacity < 1 || (q->item = (void **) calloc( capacity, sizeof(void *) )) == NULL ){
+	fprintf( stderr, "Could not allocate memory for ~q~ pointer from within ~queue_new()~ function. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+  q->capacity = capacity;
+  pthread_mutex_init( &q->lock, NULL );
+  pthread_cond_init( &q->not_empty, NULL );
+  pthread_cond_init( &q->not_full, NULL );
+  return q;
+}
+
+void queue_push(
+				queue_str *q        // queue, waited on while full
+				,void *item         // batch handed to the next stage
+				){
+  pthread_mutex_lock( &q->lock );
+  while ( q->n == q->capacity ){
+	pthread_cond_wait( &q->not_full, &q->lock );
+  }
+  q->item[ (q->head + q->n) % q->capacity ] = item;
+  q->n++;
+  pthread_cond_signal( &q->not_empty );
+  pthread_mutex_unlock( &q->lock );
+}
+
+void *queue_pop(
+				queue_str *q        // queue, waited on while empty
+				){
+  pthread_mutex_lock( &q->lock );
+  while ( q->n == 0 && !q->closed ){
+	pthread_cond_wait( &q->not_empty, &q->lock );
+  }
+  void *item = NULL;
+  if ( q->n > 0 ){
+	item = q->item[ q->head ];
+	q->head = (q->head + 1) % q->capacity;
+	q->n--;
+	pthread_cond_signal( &q->not_full );
+  }
+  pthread_mutex_unlock( &q->lock );
+  return item;
+}
+
+void queue_close(
+				 queue_str *q        // queue receiving no more batches
+				 ){
+  pthread_mutex_lock( &q->lock );
+  q->closed = true;
+  pthread_cond_broadcast( &q->not_empty );
+  pthread_mutex_unlock( &q->lock );
+}
+
+void queue_free(
+				queue_str *q        // queue to be freed
+				){
+  pthread_mutex_destroy( &q->lock );
+  pthread_cond_destroy( &q->not_empty );
+  pthread_cond_destroy( &q->not_full );
+  free( q->item );
+  free( q );
+}
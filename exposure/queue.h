@@ -0,0 +1,33 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Bounded queues between the stages of the threaded exposure engine
+//
+//  The stages of a run (reading lines of stdin, skipping and filtering them, exposing the policies, writing and
+//  aggregating the results) run side by side in one process, each stage handing its batches to the next one through
+//  a queue instead of a shell pipe: a batch is passed as a pointer, so no byte is copied. A queue holds at most
+//  ~capacity~ batches, so a fast stage waits for the slow ones instead of piling batches up in memory.
+//
+//  The stage upstream closes the queue once done; the stage downstream then gets NULL after the last batch.
+//
+#ifndef QUEUE_H
+#define QUEUE_H
+
+typedef struct queue_str queue_str;
+
+queue_str *queue_new(
+					 int capacity        // batches held at most
+					 );
+void queue_push(
+				queue_str *q        // queue, waited on while full
+				,void *item         // batch handed to the next stage
+				);
+void *queue_pop(
+				queue_str *q        // queue, waited on while empty
+				);                  // oldest batch, NULL once the queue is closed and empty
+void queue_close(
+				 queue_str *q        // queue receiving no more batches
+				 );
+void queue_free(
+				queue_str *q        // queue to be freed
+				);
+
+#endif
@@ -0,0 +1,159 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Stratified sample of the policies (see sample.h)
+//
+#include <stdio.h>       // fprintf
+#include <stdlib.h>      // calloc, free, exit
+#include <stdint.h>      // uint64_t
+#include <string.h>      // strlen
+#include <math.h>        // sqrt
+
+#include "sample.h"
+
+bool sample_keep(
+				 const char *id      // ID of the policy
+				 ,double fraction    // fraction of the policies kept
+				 ){
+  // FNV-1a of the ID, then mixed (splitmix64 finalizer) so that sequential IDs spread over the whole range
+  uint64_t h = 14695981039346656037ULL;
+  for (const char *p = id; *p != '\0'; p++) {
+	h = ( h ^ (unsigned char) *p ) * 1099511628211ULL;
+  }
+  h = ( h ^ ( h >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+  h = ( h ^ ( h >> 27 ) ) * 0x94d049bb133111ebULL;
+  h = h ^ ( h >> 31 );
+  return (double) ( h >> 11 ) < fraction * (double) ( 1ULL << 53 );
+}
+
+int sample_stratum_of(
+					  const policy_str *policy // packed policy
+					  ){
+  int year = 0;
+  if ( policy->pid != POLICY_DATE_NONE ){
+	int y, m, d;
+	epoch_to_civil( policy->pid, &y, &m, &d );
+	if ( y >= SAMPLE_FROM && y < SAMPLE_FROM + SAMPLE_YEARS ) year = y - SAMPLE_FROM + 1;
+  }
+  return year * SAMPLE_STATUS + policy->status;
+}
+
+void sample_init(
+				 sample_str *s       // strata to be allocated, empty
+				 ){
+  s->stratum = (sample_stratum *) calloc( SAMPLE_STRATA, sizeof(sample_stratum) );
+  if ( s->stratum == NULL ){
+	fprintf( stderr, "Could not allocate memory for ~s->stratum~ pointer from within ~sample_init()~ function. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+}
+
+void sample_count(
+				  sample_str *s       // strata of the study
+				  ,int stratum        // stratum of the policy
+				  ,bool kept          // the policy is in the sample
+				  ){
+  s->stratum[stratum].policies++;
+  if ( kept ) s->stratum[stratum].sampled++;
+}
+
+void sample_add(
+				sample_str *s       // strata of the study
+				,int stratum        // stratum of the kept policy, exposed to the study
+				,long actual        // claims of the policy over the study
+				,long long exposure // exposure of the policy over the study, in millionths of a year
+				){
+  sample_stratum *h = &s->stratum[stratum];
+  h->actual += actual;
+  h->exposure += exposure;
+  h->claimed += actual * exposure;
+  h->exposure2 += (__int128) exposure * exposure;
+}
+
+void sample_merge(
+				  sample_str *into    // strata receiving the sums of ...
+				  ,sample_str *from   // ... these ones
+				  ){
+  for (int i = 0; i < SAMPLE_STRATA; i++) {
+	sample_stratum *to = &into->stratum[i], *h = &from->stratum[i];
+	to->policies += h->policies;
+	to->sampled += h->sampled;
+	to->actual += h->actual;
+	to->exposure += h->exposure;
+	to->claimed += h->claimed;
+	to->exposure2 += h->exposure2;
+  }
+}
+
+double sample_scale(
+					sample_str *s       // strata of the study
+					){
+  long policies = 0, sampled = 0;
+  for (int i = 0; i < SAMPLE_STRATA; i++) {
+	policies += s->stratum[i].policies;
+	sampled += s->stratum[i].sampled;
+  }
+  return ( sampled > 0 ) ? (double) policies / sampled : 0;
+}
+
+// variance of the estimated total of the stratum, N^2 (1 - n/N) s^2 / n, from the sum and sum of squares of the kept
+// values (in years)
+static double total_var( const sample_stratum *h, double sum, double sum2 ){
+  long N = h->policies, n = h->sampled;
+  if ( n < 2 ) return 0;
+  double s2 = ( sum2 - sum * sum / n ) / ( n - 1 );
+  return (double) N * N * ( 1.0 - (double) n / N ) * s2 / n;
+}
+
+// sums of the stratum in years: a, e, a^2 (= a), a e and e^2
+static void sums( const sample_stratum *h, double *a, double *e, double *ae, double *e2 ){
+  *a = h->actual;
+  *e = h->exposure / 1e6;
+  *ae = h->claimed / 1e6;
+  *e2 = (double) h->exposure2 / 1e12;
+}
+
+void sample_write(
+				  sample_str *s       // strata to be estimated
+				  ,FILE *f            // file receiving the estimates (~sample.csv~)
+				  ){
+  double A = 0, E = 0, var_A = 0, var_E = 0;
+  long policies = 0, sampled = 0;
+
+  // strata, then their totals
+  for (int i = 0; i < SAMPLE_STRATA; i++) {
+	sample_stratum *h = &s->stratum[i];
+	if ( h->policies == 0 ) continue;
+	double a, e, ae, e2;
+	sums( h, &a, &e, &ae, &e2 );
+	double w = ( h->sampled > 0 ) ? (double) h->policies / h->sampled : 0;
+	double va = total_var( h, a, a ), ve = total_var( h, e, e2 );
+	double rate = ( e > 0 ) ? a / e : 0;
+	// z = a - rate e: sum z = a - rate e, sum z^2 = a - 2 rate ae + rate^2 e2
+	double vr = ( e > 0 ) ? total_var( h, a - rate * e, a - 2 * rate * ae + rate * rate * e2 ) / ( w * e * w * e ) : 0;
+	int year = i / SAMPLE_STATUS;
+	fprintf( f, "%d;%d;%ld;%ld;%.2f;%.2f;%.6f;%.6f;%.8f;%.8f\n", ( year > 0 ) ? SAMPLE_FROM + year - 1 : 0,
+			 i % SAMPLE_STATUS, h->policies, h->sampled, w * a, sqrt( va ), w * e, sqrt( ve ), rate, sqrt( vr ) );
+	A += w * a;
+	E += w * e;
+	var_A += va;
+	var_E += ve;
+	policies += h->policies;
+	sampled += h->sampled;
+  }
+  double R = ( E > 0 ) ? A / E : 0, var_R = 0;
+  for (int i = 0; i < SAMPLE_STRATA && E > 0; i++) {
+	sample_stratum *h = &s->stratum[i];
+	if ( h->policies == 0 ) continue;
+	double a, e, ae, e2;
+	sums( h, &a, &e, &ae, &e2 );
+	var_R += total_var( h, a - R * e, a - 2 * R * ae + R * R * e2 ) / ( E * E );
+  }
+  fprintf( f, "all;all;%ld;%ld;%.2f;%.2f;%.6f;%.6f;%.8f;%.8f\n", policies, sampled, A, sqrt( var_A ), E, sqrt( var_E ),
+		   R, sqrt( var_R ) );
+}
+
+void sample_free(
+				 sample_str *s       // strata to be freed
+				 ){
+  free( s->stratum );
+  s->stratum = NULL;
+}
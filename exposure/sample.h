@@ -0,0 +1,89 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Stratified sample of the policies (--sample)
+//
+//  A preview of a study exposes only a fraction of the policies: a policy is kept when the hash of its ID falls below
+//  that fraction of the hash range, so the same policies are kept from one run to the next (and by every study of a
+//  manifest), whatever the amount of threads. Every policy still counts into its stratum, issue year x status code,
+//  so that each stratum is scaled up by its own policies over its kept ones (post-stratification), and the totals
+//  are estimated, with their standard errors, by the stratified estimators of a sample without replacement:
+//
+//    A = sum N_h mean(a)_h        Var A = sum N_h^2 (1 - n_h / N_h) s^2(a)_h / n_h
+//
+//  (and alike for the exposure E), where a and e are the actual and the exposure of each kept policy over the study
+//  (0 when out of study), and the rate A / E by linearization, s^2 taken of z = a - (A / E) e. Each line of
+//  ~sample.csv~ is a stratum, then the last one (all;all) the whole study:
+//
+//    issue_year;status;policies;sampled;actual;actual_se;exposure;exposure_se;rate;rate_se
+//
+//  Invalid issue dates (or out of SAMPLE_FROM .. SAMPLE_FROM + SAMPLE_YEARS - 1) go into year 0, and invalid status
+//  codes into status 0. A stratum with policies but none kept estimates 0, and standard errors need two kept policies.
+//
+//  The cube of the study (~aggregate.csv~, see agg.h) is only scaled up by the ratio of all the policies over the kept
+//  ones (sample_scale()), its cells not being kept by stratum: its totals differ from the stratified estimates of
+//  ~sample.csv~, which are the ones to quote.
+//
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include <stdio.h>       // FILE
+#include <stdbool.h>     // bool (data type)
+
+#include "policy.h"      // compact policy record
+
+#define SAMPLE_FROM   1800              // first issue year of its own stratum (earlier ones join the invalid year)
+#define SAMPLE_YEARS  300               // issue years SAMPLE_FROM .. SAMPLE_FROM + SAMPLE_YEARS - 1
+#define SAMPLE_STATUS 7                 // status codes 1 .. 6, and 0 when invalid
+#define SAMPLE_STRATA ( ( SAMPLE_YEARS + 1 ) * SAMPLE_STATUS )
+
+typedef struct sample_stratum
+{
+  long policies;       // policies of the stratum
+  long sampled;        // ... kept in the sample
+  long actual;         // claims of the kept policies
+  long long exposure;  // exposure of the kept policies, in millionths of a year (as agg.h)
+  long long claimed;   // exposure of the kept policies with a claim (sum of a e, a being 0 or 1)
+  __int128 exposure2;  // sum of the squared exposures of the kept policies (exact, so thread-independent)
+} sample_stratum;
+
+typedef struct sample_str
+{
+  sample_stratum *stratum;  // SAMPLE_STRATA strata, by issue year then status code
+} sample_str;
+
+bool sample_keep(
+				 const char *id      // ID of the policy
+				 ,double fraction    // fraction of the policies kept
+				 );                  // the policy is in the sample
+int sample_stratum_of(
+					  const policy_str *policy // packed policy
+					  );                  // stratum of the policy: issue year x status code
+void sample_init(
+				 sample_str *s       // strata to be allocated, empty
+				 );
+void sample_count(
+				  sample_str *s       // strata of the study
+				  ,int stratum        // stratum of the policy
+				  ,bool kept          // the policy is in the sample
+				  );
+void sample_add(
+				sample_str *s       // strata of the study
+				,int stratum        // stratum of the kept policy, exposed to the study
+				,long actual        // claims of the policy over the study
+				,long long exposure // exposure of the policy over the study, in millionths of a year
+				);
+void sample_merge(
+				  sample_str *into    // strata receiving the sums of ...
+				  ,sample_str *from   // ... these ones
+				  );
+double sample_scale(
+					sample_str *s       // strata of the study
+					);                  // policies over kept ones, scaling up the aggregate
+void sample_write(
+				  sample_str *s       // strata to be estimated
+				  ,FILE *f            // file receiving the estimates (~sample.csv~)
+				  );
+void sample_free(
+				 sample_str *s       // strata to be freed
+				 );
+
+#endif
@@ -0,0 +1,301 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Work-stealing scheduler for the threaded exposure engine (see sched.h)
+//
+//  Chunks are coarse (hundreds of policies each), so every deque is guarded by its own mutex: the lock is taken once
+//  per chunk, which costs nothing next to the chunk itself, and keeps the deque free of lock-free subtleties.
+//
+#include <stdio.h>       // FILE, fprintf
+#include <stdlib.h>      // malloc, calloc, realloc, free
+#include <string.h>      // memmove
+#include <stdbool.h>     // bool (data type)
+#include <pthread.h>     // pthread_create, mutexes and condition variables
+#include <sched.h>       // sched_yield()
+#include <time.h>        // clock_gettime()
+
+#include "sched.h"
+
+// deque of chunk indices owned by a worker: the owner pops at ~bottom~, thieves steal at ~top~
+typedef struct deque_str
+{
+  pthread_mutex_t lock;
+  long *chunk;         // chunk indices, chunk[top] .. chunk[bottom-1] are pending
+  long cap;            // capacity of ~chunk~ (the amount of chunks of the largest batch so far)
+  long top;            // oldest pending chunk, where thieves steal
+  long bottom;         // one past the newest pending chunk, where the owner pops
+} deque_str;
+
+typedef struct worker_str
+{
+  int id;              // worker index 0 .. n_workers-1
+  pthread_t thread;
+  deque_str dq;
+  sched_stats stats;
+  unsigned int seed;   // seed of rand_r(), picking the first victim of each steal round
+  struct sched_pool *pool;
+} worker_str;
+
+struct sched_pool
+{
+  int n_workers;
+  worker_str *worker;
+
+  pthread_mutex_t lock;  // guards ~generation~ and ~quit~, and the wait for ~remaining~ to reach zero
+  pthread_cond_t start;  // signalled when a new batch (generation) begins or the pool quits
+  pthread_cond_t done;   // signalled when the last chunk of the batch is finished
+  long generation;       // batch being run (atomic: read by thieves under the deque locks)
+  bool quit;
+
+  long remaining;        // chunks of the batch not yet finished (atomic)
+  sched_task task;
+  void *arg;
+};
+
+static double now(void){
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// owner side: newest pending chunk of the worker's own deque
+static bool pop_bottom( deque_str *dq, long *chunk ){
+  bool found = false;
+  pthread_mutex_lock( &dq->lock );
+  if ( dq->bottom > dq->top ){
+	*chunk = dq->chunk[ --dq->bottom ];
+	found = true;
+  }
+  pthread_mutex_unlock( &dq->lock );
+  return found;
+}
+
+// appends ~k~ chunks after the bottom of a deque, moving its pending chunks back to the start when they would not fit
+// (the pending chunks of every deque are chunks of one batch, at most ~cap~ of them); called with its lock held
+static void push_bottom( deque_str *dq, const long *chunk, long k ){
+  if ( dq->top == dq->bottom ){
+	dq->top = 0;
+	dq->bottom = 0;
+  }
+  if ( dq->bottom + k > dq->cap ){
+	memmove( dq->chunk, dq->chunk + dq->top, ( dq->bottom - dq->top ) * sizeof(long) );
+	dq->bottom -= dq->top;
+	dq->top = 0;
+  }
+  for (long j = 0; j < k; j++) {
+	dq->chunk[ dq->bottom++ ] = chunk[j];
+  }
+}
+
+// thief side: takes half of the pending chunks (at least one) from the top of a victim's deque, returns the first
+// one to be run and appends the others to the thief's own deque. A thief still in batch ~generation~ while the next
+// one is being dealt steals nothing: it goes back to wait for the batch, instead of robbing deques being dealt
+static bool steal( sched_pool *pool, worker_str *w, long generation, long *chunk ){
+  int first = rand_r( &w->seed ) % pool->n_workers;
+  for (int i = 0; i < pool->n_workers; i++) {
+	worker_str *victim = &pool->worker[ (first + i) % pool->n_workers ];
+	if ( victim == w ) continue;
+
+	// both deques are locked, always in the order of the workers' indices, so two thieves robbing each other
+	// cannot deadlock
+	deque_str *first_dq  = ( w->id < victim->id ) ? &w->dq : &victim->dq;
+	deque_str *second_dq = ( w->id < victim->id ) ? &victim->dq : &w->dq;
+	pthread_mutex_lock( &first_dq->lock );
+	pthread_mutex_lock( &second_dq->lock );
+
+	if ( __atomic_load_n( &pool->generation, __ATOMIC_ACQUIRE ) != generation ){
+	  pthread_mutex_unlock( &second_dq->lock );
+	  pthread_mutex_unlock( &first_dq->lock );
+	  return false;
+	}
+	long n = victim->dq.bottom - victim->dq.top;
+	if ( n <= 0 ){
+	  pthread_mutex_unlock( &second_dq->lock );
+	  pthread_mutex_unlock( &first_dq->lock );
+	  w->stats.failed_steals++;
+	  continue;
+	}
+	long k = (n + 1) / 2;
+	long from = victim->dq.top;
+	victim->dq.top += k;
+
+	// appended, not copied over: the thief's deque may already hold chunks dealt to it since it ran dry
+	*chunk = victim->dq.chunk[ from ];
+	push_bottom( &w->dq, &victim->dq.chunk[ from + 1 ], k - 1 );
+	pthread_mutex_unlock( &second_dq->lock );
+	pthread_mutex_unlock( &first_dq->lock );
+
+	w->stats.steals++;
+	w->stats.stolen += k;
+	return true;
+  }
+  return false;
+}
+
+static void *worker_main( void *arg ){
+  worker_str *w = (worker_str *) arg;
+  sched_pool *pool = w->pool;
+  long generation = 0;
+
+  while (1) {
+	// wait for the next batch
+	pthread_mutex_lock( &pool->lock );
+	while ( pool->generation == generation && !pool->quit ){
+	  pthread_cond_wait( &pool->start, &pool->lock );
+	}
+	if ( pool->quit ){
+	  pthread_mutex_unlock( &pool->lock );
+	  break;
+	}
+	generation = pool->generation;
+	pthread_mutex_unlock( &pool->lock );
+
+	// run own chunks, then steal from the others until every chunk of the batch is finished
+	double idle_since = -1;
+	while ( __atomic_load_n( &pool->remaining, __ATOMIC_ACQUIRE ) > 0 ) {
+	  long chunk;
+	  if ( pop_bottom( &w->dq, &chunk ) || steal( pool, w, generation, &chunk ) ){
+		double t0 = now();
+		if ( idle_since >= 0 ){
+		  w->stats.idle += t0 - idle_since;
+		  idle_since = -1;
+		}
+		pool->task( pool->arg, w->id, chunk );
+		w->stats.busy += now() - t0;
+		w->stats.chunks++;
+
+		if ( __atomic_sub_fetch( &pool->remaining, 1, __ATOMIC_ACQ_REL ) == 0 ){
+		  pthread_mutex_lock( &pool->lock );
+		  pthread_cond_signal( &pool->done );
+		  pthread_mutex_unlock( &pool->lock );
+		}
+	  } else {
+		// the next batch began: back to wait for it, in its generation
+		if ( __atomic_load_n( &pool->generation, __ATOMIC_ACQUIRE ) != generation ) break;
+		// nothing left to steal: the last chunks are running elsewhere
+		if ( idle_since < 0 ) idle_since = now();
+		sched_yield();
+	  }
+	}
+	if ( idle_since >= 0 ) w->stats.idle += now() - idle_since;
+  }
+  return NULL;
+}
+
+sched_pool *sched_new(
+					  int n_workers       // amount of worker threads to start
+					  ){
+  sched_pool *pool = (sched_pool *) calloc( 1, sizeof(sched_pool) );
+  if ( pool == NULL ) return NULL;
+  pool->worker = (worker_str *) calloc( n_workers, sizeof(worker_str) );
+  if ( pool->worker == NULL ){
+	free( pool );
+	return NULL;
+  }
+  pool->n_workers = n_workers;
+  pthread_mutex_init( &pool->lock, NULL );
+  pthread_cond_init( &pool->start, NULL );
+  pthread_cond_init( &pool->done, NULL );
+
+  for (int i = 0; i < n_workers; i++) {
+	worker_str *w = &pool->worker[i];
+	w->id = i;
+	w->pool = pool;
+	w->seed = 2654435761u * (i + 1);
+	pthread_mutex_init( &w->dq.lock, NULL );
+	if ( pthread_create( &w->thread, NULL, worker_main, w ) != 0 ){
+	  fprintf( stderr, "Could not start worker thread %d from within ~sched_new()~ function. Aborting...\n", i );
+	  exit( EXIT_FAILURE );
+	}
+  }
+  return pool;
+}
+
+void sched_run(
+			   sched_pool *pool    // pool of worker threads, from sched_new()
+			   ,long n_chunks      // amount of chunks of the batch
+			   ,sched_task task    // function run once for each chunk 0 .. n_chunks-1
+			   ,void *arg          // argument handed to ~task~ (the batch)
+			   ){
+  if ( n_chunks <= 0 ) return;
+
+  // every deque must be able to hold the whole batch (a thief may end up with most of it), grown while all of them
+  // are empty ...
+  for (int i = 0; i < pool->n_workers; i++) {
+	deque_str *dq = &pool->worker[i].dq;
+	pthread_mutex_lock( &dq->lock );
+	if ( dq->cap < n_chunks ){
+	  dq->chunk = (long *) realloc( dq->chunk, n_chunks * sizeof(long) );
+	  if ( dq->chunk == NULL ){
+		fprintf( stderr, "Could not allocate memory for deques from within ~sched_run()~ function. Aborting...\n");
+		exit( EXIT_FAILURE );
+	  }
+	  dq->cap = n_chunks;
+	}
+	pthread_mutex_unlock( &dq->lock );
+  }
+  // ... then the batch is set and its generation begins before its chunks are dealt: a worker still leaving the
+  // previous batch may already pop the chunks dealt to it (counted in ~remaining~), though not steal any, and the
+  // workers of the new generation append the chunks they steal after the ones dealt to them ...
+  pool->task = task;
+  pool->arg = arg;
+  __atomic_store_n( &pool->remaining, n_chunks, __ATOMIC_RELEASE );
+  pthread_mutex_lock( &pool->lock );
+  __atomic_add_fetch( &pool->generation, 1, __ATOMIC_RELEASE );
+  pthread_mutex_unlock( &pool->lock );
+
+  // ... as contiguous ranges of chunks
+  for (int i = 0; i < pool->n_workers; i++) {
+	deque_str *dq = &pool->worker[i].dq;
+	long from = n_chunks * i / pool->n_workers;
+	long to   = n_chunks * (i + 1) / pool->n_workers;
+	pthread_mutex_lock( &dq->lock );
+	for (long c = from; c < to; c++) {
+	  push_bottom( dq, &c, 1 );
+	}
+	pthread_mutex_unlock( &dq->lock );
+  }
+  // start the batch and wait for its last chunk
+  pthread_mutex_lock( &pool->lock );
+  pthread_cond_broadcast( &pool->start );
+  while ( __atomic_load_n( &pool->remaining, __ATOMIC_ACQUIRE ) > 0 ){
+	pthread_cond_wait( &pool->done, &pool->lock );
+  }
+  pthread_mutex_unlock( &pool->lock );
+}
+
+const sched_stats *sched_get_stats(
+								   sched_pool *pool    // pool of worker threads
+								   ,int worker         // worker whose metrics are returned
+								   ){
+  return &pool->worker[worker].stats;
+}
+
+void sched_report(
+				  sched_pool *pool    // pool of worker threads
+				  ,FILE *f            // where the table of metrics per worker is written (e.g. stderr)
+				  ){
+  fprintf( f, "worker;chunks;steals;stolen_chunks;failed_steals;busy_seconds;idle_seconds\n" );
+  for (int i = 0; i < pool->n_workers; i++) {
+	sched_stats *s = &pool->worker[i].stats;
+	fprintf( f, "%d;%ld;%ld;%ld;%ld;%.6f;%.6f\n", i, s->chunks, s->steals, s->stolen, s->failed_steals, s->busy, s->idle );
+  }
+}
+
+void sched_free(
+				sched_pool *pool    // pool whose threads are joined and memory freed
+				){
+  pthread_mutex_lock( &pool->lock );
+  pool->quit = true;
+  pthread_cond_broadcast( &pool->start );
+  pthread_mutex_unlock( &pool->lock );
+
+  for (int i = 0; i < pool->n_workers; i++) {
+	pthread_join( pool->worker[i].thread, NULL );
+	pthread_mutex_destroy( &pool->worker[i].dq.lock );
+	free( pool->worker[i].dq.chunk );
+  }
+  pthread_mutex_destroy( &pool->lock );
+  pthread_cond_destroy( &pool->start );
+  pthread_cond_destroy( &pool->done );
+  free( pool->worker );
+  free( pool );
+}
@@ -0,0 +1,52 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Work-stealing scheduler for the threaded exposure engine
+//
+//  A batch of work is split in ~n_chunks~ chunks (e.g. 256 lines of stdin each). Every worker thread owns a deque,
+//  initially holding a contiguous range of the chunks. The owner pops chunks from the bottom of its deque and, once
+//  it runs dry, steals half of the chunks left at the top of another worker's deque. Policies issued long before
+//  the study start expand into many policy years, so chunks are far from even: stealing moves the remaining work
+//  to the idle workers instead of leaving them waiting for the slowest one.
+//
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdio.h>       // FILE
+
+// task run for each chunk: ~arg~ as given to sched_run(), ~worker~ running it (0 .. n_workers-1) and ~chunk~ index
+typedef void (*sched_task)( void *arg, int worker, long chunk );
+
+// scheduler metrics, one struct per worker, accumulated over all batches
+typedef struct sched_stats
+{
+  long chunks;         // chunks run by the worker
+  long steals;         // successful steals (each one takes half of the chunks left in the victim's deque)
+  long stolen;         // chunks taken from other workers' deques
+  long failed_steals;  // steal attempts that found the victim's deque empty
+  double busy;         // seconds spent running chunks
+  double idle;         // seconds spent looking for work while a batch was still running
+} sched_stats;
+
+typedef struct sched_pool sched_pool;
+
+sched_pool *sched_new(
+					  int n_workers       // amount of worker threads to start
+					  );
+void sched_run(
+			   sched_pool *pool    // pool of worker threads, from sched_new()
+			   ,long n_chunks      // amount of chunks of the batch
+			   ,sched_task task    // function run once for each chunk 0 .. n_chunks-1
+			   ,void *arg          // argument handed to ~task~ (the batch)
+			   );
+const sched_stats *sched_get_stats(
+								   sched_pool *pool    // pool of worker threads
+								   ,int worker         // worker whose metrics are returned
+								   );
+void sched_report(
+				  sched_pool *pool    // pool of worker threads
+				  ,FILE *f            // where the table of metrics per worker is written (e.g. stderr)
+				  );
+void sched_free(
+				sched_pool *pool    // pool whose threads are joined and memory freed
+				);
+
+#endif
@@ -0,0 +1,180 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Survival by policy duration (see surv.h)
+//
+#include <stdio.h>       // fprintf
+#include <stdlib.h>      // calloc, realloc, free, exit
+#include <string.h>      // memset
+#include <math.h>        // floor
+
+#include "surv.h"
+
+// grows the histograms to ~n_group~ groups, the new ones empty (no block reached)
+static void grow( surv_str *s, long n_group ){
+  if ( n_group <= s->n_group ) return;
+  if ( n_group > s->cap_group ){
+	long cap = ( 2 * s->cap_group > n_group ) ? 2 * s->cap_group : n_group;
+	s->block = (surv_day **) realloc( s->block, cap * SURV_BLOCKS * sizeof(surv_day *) );
+	if ( s->block == NULL ){
+	  fprintf( stderr, "Could not allocate memory for ~s->block~ pointer from within ~grow()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+	memset( s->block + s->cap_group * SURV_BLOCKS, 0, (cap - s->cap_group) * SURV_BLOCKS * sizeof(surv_day *) );
+	s->cap_group = cap;
+  }
+  s->n_group = n_group;
+}
+
+// day ~t~ of a group, its block allocated (empty) when first reached
+static surv_day *day( surv_str *s, long group, int t ){
+  surv_day **b = &s->block[ group * SURV_BLOCKS + t / SURV_BLOCK ];
+  if ( *b == NULL ){
+	*b = (surv_day *) calloc( SURV_BLOCK, sizeof(surv_day) );
+	if ( *b == NULL ){
+	  fprintf( stderr, "Could not allocate memory for a block of days from within ~day()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+  }
+  return &(*b)[ t % SURV_BLOCK ];
+}
+
+void surv_init(
+			   surv_str *s         // histograms to be allocated, all days empty
+			   ){
+  s->block = (surv_day **) calloc( SURV_BLOCKS, sizeof(surv_day *) );
+  s->n_group = 1;
+  s->cap_group = 1;
+  s->dropped = 0;
+  if ( s->block == NULL ){
+	fprintf( stderr, "Could not allocate memory for ~s->block~ pointer from within ~surv_init()~ function. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+}
+
+void surv_add(
+			  surv_str *s         // histograms receiving the policy
+			  ,long group         // group of the policy (0 when not grouped)
+			  ,int entry          // duration at which the policy enters the study, in days
+			  ,int exit           // duration at which the policy leaves the study, in days
+			  ,bool event         // the policy leaves the study with a claim
+			  ){
+  if ( entry < 0 || exit >= SURV_DAYS ){
+	s->dropped++;
+	return;
+  }
+  if ( exit < entry ) return;
+  if ( group >= s->n_group ) grow( s, group + 1 );
+  day( s, group, entry )->entered++;
+  if ( event ){
+	day( s, group, exit )->events++;
+  } else {
+	day( s, group, exit )->censored++;
+  }
+}
+
+void surv_merge(
+				surv_str *into      // histograms receiving the counts of ...
+				,surv_str *from     // ... these ones
+				,const long *map    // group of ~into~ of each group of ~from~ (NULL for the same groups)
+				){
+  for (long g = 0; g < from->n_group; g++) {
+	long h = ( map != NULL ) ? map[g] : g;
+	grow( into, h + 1 );
+	for (int b = 0; b < SURV_BLOCKS; b++) {
+	  surv_day *d = from->block[ g * SURV_BLOCKS + b ];
+	  if ( d == NULL ) continue;
+	  surv_day *to = day( into, h, b * SURV_BLOCK );
+	  for (int t = 0; t < SURV_BLOCK; t++) {
+		to[t].entered += d[t].entered;
+		to[t].events += d[t].events;
+		to[t].censored += d[t].censored;
+	  }
+	}
+  }
+  into->dropped += from->dropped;
+}
+
+// Kaplan-Meier: S(t) = prod (1 - d/n), Var S(t) = S(t)^2 sum d / (n (n - d)) over the days with events up to t
+// (the blocks of days never reached have none)
+static void write_km( surv_day **block, FILE *f, const char *label ){
+  long at_risk = 0, censored = 0;
+  double S = 1.0, greenwood = 0.0;
+  for (int b = 0; b < SURV_BLOCKS; b++) {
+	surv_day *d = block[b];
+	if ( d == NULL ) continue;
+	for (int i = 0; i < SURV_BLOCK; i++) {
+	  // those entering at t are at risk at t, those leaving at t up to t
+	  long t = (long) b * SURV_BLOCK + i;
+	  at_risk += d[i].entered;
+	  long n = at_risk, e = d[i].events;
+	  censored += d[i].censored;
+	  at_risk -= d[i].events + d[i].censored;
+	  if ( e == 0 ) continue;
+	  S *= 1.0 - (double) e / n;
+	  if ( n > e ) greenwood += (double) e / ( (double) n * (n - e) );
+	  fprintf( f, "%s%ld;%ld;%ld;%ld;%.8f;%.8g\n", label, t, n, e, censored, S, S * S * greenwood );
+	  censored = 0;
+	}
+  }
+}
+
+// actuarial life table by policy year: q = d / (n + entered/2 - withdrawn/2), Var S = S^2 sum q / (exposed p). The
+// policies entering within a year and claimed in it count for half a year only, so q may reach 1 (or more): it is
+// then capped at 1, survival drops to 0 and the variance of the year, undefined, is written as n/a
+static void write_table( surv_day **block, FILE *f, float days_in_year, const char *label ){
+  long at_risk = 0;
+  double S = 1.0, greenwood = 0.0;
+  long t = 0;
+  for (int year = 1; t < SURV_DAYS; year++) {
+	long entered = 0, withdrawn = 0, events = 0;
+	for (; t < SURV_DAYS && (int) floor( t / days_in_year ) + 1 == year; t++) {
+	  // the days of a block never reached are all empty, whatever year they fall in: on to the next block
+	  surv_day *d = block[ t / SURV_BLOCK ];
+	  if ( d == NULL ){
+		t = ( t / SURV_BLOCK + 1 ) * SURV_BLOCK - 1;
+		continue;
+	  }
+	  entered += d[ t % SURV_BLOCK ].entered;
+	  withdrawn += d[ t % SURV_BLOCK ].censored;
+	  events += d[ t % SURV_BLOCK ].events;
+	}
+	if ( at_risk == 0 && entered == 0 ) continue;
+	double exposed = at_risk + 0.5 * entered - 0.5 * withdrawn;
+	bool capped = ( events > 0 && exposed <= events );
+	double q = capped ? 1.0 : ( ( events > 0 ) ? events / exposed : 0.0 );
+	S *= 1.0 - q;
+	if ( events > 0 && capped == false ) greenwood += events / ( exposed * ( exposed - events ) );
+	fprintf( f, "%s%d;%ld;%ld;%ld;%ld;%.4f;%.8f;%.8f;", label, year, at_risk, entered, withdrawn, events, exposed, q, S );
+	if ( capped ) fprintf( f, "n/a\n" );
+	else fprintf( f, "%.8g\n", S * S * greenwood );
+	at_risk += entered - withdrawn - events;
+  }
+}
+
+void surv_write(
+				surv_str *s         // histograms to be swept
+				,FILE *f_km         // file receiving the Kaplan-Meier estimate (~survival_km.csv~)
+				,FILE *f_table      // file receiving the life table (~survival_table.csv~)
+				,float days_in_year // basis of the study, cutting the days into policy years
+				,char **label       // values heading the lines of each group (NULL when not grouped)
+				){
+  for (long g = 0; g < s->n_group; g++) {
+	surv_day **block = &s->block[ g * SURV_BLOCKS ];
+	const char *l = ( label != NULL ) ? label[g] : "";
+	write_km( block, f_km, l );
+	write_table( block, f_table, days_in_year, l );
+  }
+  if ( s->dropped > 0 ){
+	fprintf( stderr, "%ld policies observed beyond %d days since issue were left out of the survival estimates.\n",
+			 s->dropped, SURV_DAYS );
+  }
+}
+
+void surv_free(
+			   surv_str *s         // histograms whose blocks are freed
+			   ){
+  for (long b = 0; b < s->n_group * SURV_BLOCKS; b++) {
+	free( s->block[b] );
+  }
+  free( s->block );
+  s->block = NULL;
+}
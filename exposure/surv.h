@@ -0,0 +1,79 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Survival by policy duration (--survival)
+//
+//  Each policy exposed to the study is observed from its duration at the study start (left truncation) to its
+//  duration at the study end or at its termination, in days since issue, with an event when its termination is a
+//  claim of the study within it. Durations are integers bounded by SURV_DAYS, so instead of sorting the policies by
+//  duration, they are counted by day as they stream by (a radix sort of one digit): entries, events and censorings
+//  of each day. Each worker thread counts into its own histograms, merged at the end, and one
+//  sweep over the days gives
+//
+//    survival_km.csv      Kaplan-Meier estimate at each day with events, with Greenwood's variance
+//                         duration_days;at_risk;events;censored;survival;variance
+//    survival_table.csv   actuarial life table by policy year (entries and withdrawals counted as half a year),
+//                         with Greenwood's variance (q capped at 1, and its variance n/a, when the claims of a
+//                         year reach its exposed)
+//                         policy_year;at_risk;entered;withdrawn;events;exposed;q;survival;variance
+//
+//  A policy is at risk at day t when it entered at t or before and left at t or after. Grouped (--group-by, see
+//  group.h), each group has histograms and lines of its own, headed by its values.
+//
+//  The days of a group are kept in blocks of SURV_BLOCK days (a policy year), allocated when a policy first enters or
+//  leaves within them: a group takes 8 B x SURV_BLOCKS (1.2 KB) plus 4.4 KB per block reached, where all its days
+//  would take 0.65 MB. Merging and sweeping skip the blocks never reached.
+//
+#ifndef SURV_H
+#define SURV_H
+
+#include <stdio.h>       // FILE
+#include <stdbool.h>     // bool (data type)
+#include <stdint.h>      // uint32_t
+
+#include "agg.h"         // AGG_YEARS
+
+#define SURV_BLOCK  366                          // days of a block
+#define SURV_BLOCKS AGG_YEARS                    // blocks of a group
+#define SURV_DAYS ( SURV_BLOCKS * SURV_BLOCK )   // durations counted, in days since issue
+
+typedef struct surv_day
+{
+  uint32_t entered;    // policies entering the study at the day (at risk from it on)
+  uint32_t events;     // policies leaving the study with a claim at the day
+  uint32_t censored;   // policies leaving the study otherwise at the day
+} surv_day;
+
+typedef struct surv_str
+{
+  surv_day **block;    // SURV_BLOCKS blocks of SURV_BLOCK days per group, NULL until reached
+  long n_group;        // groups of the histograms, up to the last one added to (1 when not grouped)
+  long cap_group;      // groups allocated in ~block~
+  long dropped;        // policies observed beyond SURV_DAYS
+} surv_str;
+
+void surv_init(
+			   surv_str *s         // histograms to be allocated, all days empty
+			   );
+void surv_add(
+			  surv_str *s         // histograms receiving the policy
+			  ,long group         // group of the policy (0 when not grouped)
+			  ,int entry          // duration at which the policy enters the study, in days
+			  ,int exit           // duration at which the policy leaves the study, in days
+			  ,bool event         // the policy leaves the study with a claim
+			  );
+void surv_merge(
+				surv_str *into      // histograms receiving the counts of ...
+				,surv_str *from     // ... these ones
+				,const long *map    // group of ~into~ of each group of ~from~ (NULL for the same groups)
+				);
+void surv_write(
+				surv_str *s         // histograms to be swept
+				,FILE *f_km         // file receiving the Kaplan-Meier estimate (~survival_km.csv~)
+				,FILE *f_table      // file receiving the life table (~survival_table.csv~)
+				,float days_in_year // basis of the study, cutting the days into policy years
+				,char **label       // values heading the lines of each group (NULL when not grouped)
+				);
+void surv_free(
+			   surv_str *s         // histograms whose blocks are freed
+			   );
+
+#endif
@@ -0,0 +1,171 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Progress telemetry of a run (see tele.h)
+//
+#include <stdio.h>       // fprintf
+#include <stdlib.h>      // malloc, free, exit
+#include <string.h>      // strlen
+#include <time.h>        // clock_gettime
+#include <errno.h>       // ETIMEDOUT
+
+#include "tele.h"
+
+static const char *rule_name[TELE_RULES] = { "I1", "I2", "I3", "I4", "I5", "C1", "C2", "C3", "C4", "C5" };
+
+// snapshot of the counters
+typedef struct tele_snap
+{
+  long lines, bytes, validated, rejected, policy_years;
+  long by_rule[TELE_RULES];
+  double at;           // seconds since the run started
+} tele_snap;
+
+static double now( void ){
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void take( tele_str *t, tele_snap *s ){
+  s->lines = __atomic_load_n( &t->lines, __ATOMIC_RELAXED );
+  s->bytes = __atomic_load_n( &t->bytes, __ATOMIC_RELAXED );
+  s->validated = __atomic_load_n( &t->validated, __ATOMIC_RELAXED );
+  s->policy_years = __atomic_load_n( &t->policy_years, __ATOMIC_RELAXED );
+  s->rejected = __atomic_load_n( &t->rejected, __ATOMIC_RELAXED );
+  for (int r = 0; r < TELE_RULES; r++) {
+	s->by_rule[r] = __atomic_load_n( &t->broken[r], __ATOMIC_RELAXED );
+  }
+  s->at = now() - t->started;
+}
+
+static void hms( char *buf, double seconds ){
+  long s = (long) seconds;
+  sprintf( buf, "%02ld:%02ld:%02ld", s / 3600, ( s / 60 ) % 60, s % 60 );
+}
+
+// line of progress on stderr, rates over the interval since ~last~
+static void report( tele_str *t, tele_snap *s, tele_snap *last, bool done ){
+  double dt = s->at - last->at;
+  if ( dt <= 0 ) dt = 1e-9;
+  char elapsed[32], left[32];
+  hms( elapsed, s->at );
+  fprintf( stderr, "exposure %s %s: lines %ld (%.0f/s) validated %ld rejected %ld policy_years %ld (%.0f/s)",
+		   done ? "done" : "at", elapsed, s->lines, ( s->lines - last->lines ) / dt, s->validated, s->rejected,
+		   s->policy_years, ( s->policy_years - last->policy_years ) / dt );
+  if ( t->total_bytes > 0 && done == false ){
+	double read = (double) s->bytes / t->total_bytes;
+	if ( read > 0 ){
+	  hms( left, s->at * ( 1 - read ) / read );
+	  fprintf( stderr, " read %.1f%% ETA %s", 100 * read, left );
+	}
+  }
+  fprintf( stderr, "\n" );
+}
+
+// counters in the text format of Prometheus, written aside then renamed over ~t->path~
+static void expose_metrics( tele_str *t, tele_snap *s ){
+  size_t n = strlen( t->path );
+  char *tmp = (char *) malloc( n + strlen(".tmp") + 1 );
+  if ( tmp == NULL ){
+	fprintf( stderr, "Could not allocate memory for ~tmp~ pointer from within ~expose_metrics()~ function. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+  sprintf( tmp, "%s.tmp", t->path );
+  FILE *f = fopen( tmp, "w" );
+  if ( f == NULL ){
+	fprintf( stderr, "Could not open telemetry file '%s'.\n", tmp );
+	free( tmp );
+	return;
+  }
+  fprintf( f, "# HELP exposure_lines_read_total Lines read from the input.\n# TYPE exposure_lines_read_total counter\n" );
+  fprintf( f, "exposure_lines_read_total %ld\n", s->lines );
+  fprintf( f, "# HELP exposure_bytes_read_total Bytes read from the input.\n# TYPE exposure_bytes_read_total counter\n" );
+  fprintf( f, "exposure_bytes_read_total %ld\n", s->bytes );
+  fprintf( f, "# HELP exposure_policies_validated_total Policies validated, once per study.\n# TYPE exposure_policies_validated_total counter\n" );
+  fprintf( f, "exposure_policies_validated_total %ld\n", s->validated );
+  fprintf( f, "# HELP exposure_policies_rejected_total Policies out of study.\n# TYPE exposure_policies_rejected_total counter\n" );
+  fprintf( f, "exposure_policies_rejected_total %ld\n", s->rejected );
+  fprintf( f, "# HELP exposure_rule_failures_total Policies breaking each rule of validation (a policy may break several).\n# TYPE exposure_rule_failures_total counter\n" );
+  for (int r = 0; r < TELE_RULES; r++) {
+	fprintf( f, "exposure_rule_failures_total{rule=\"%s\"} %ld\n", rule_name[r], s->by_rule[r] );
+  }
+  fprintf( f, "# HELP exposure_policy_years_total Policy years exposed.\n# TYPE exposure_policy_years_total counter\n" );
+  fprintf( f, "exposure_policy_years_total %ld\n", s->policy_years );
+  if ( t->total_bytes > 0 ){
+	fprintf( f, "# HELP exposure_input_bytes Size of the input.\n# TYPE exposure_input_bytes gauge\n" );
+	fprintf( f, "exposure_input_bytes %ld\n", t->total_bytes );
+  }
+  fprintf( f, "# HELP exposure_elapsed_seconds Seconds since the run started.\n# TYPE exposure_elapsed_seconds gauge\n" );
+  fprintf( f, "exposure_elapsed_seconds %.3f\n", s->at );
+  if ( fclose( f ) != 0 || rename( tmp, t->path ) != 0 ){
+	fprintf( stderr, "Could not write telemetry file '%s'.\n", t->path );
+  }
+  free( tmp );
+}
+
+static void *tele_thread( void *arg ){
+  tele_str *t = (tele_str *) arg;
+  tele_snap last = { 0 }, s;
+  bool quit = false;
+  while ( quit == false ) {
+	// waits for the next report, or for the end of the run
+	struct timespec until;
+	clock_gettime( CLOCK_REALTIME, &until );
+	until.tv_sec += t->interval;
+	pthread_mutex_lock( &t->lock );
+	while ( t->quit == false ){
+	  if ( pthread_cond_timedwait( &t->wake, &t->lock, &until ) == ETIMEDOUT ) break;
+	}
+	quit = t->quit;
+	pthread_mutex_unlock( &t->lock );
+
+	take( t, &s );
+	report( t, &s, quit ? &(tele_snap) { 0 } : &last, quit );
+	if ( t->path != NULL ) expose_metrics( t, &s );
+	last = s;
+  }
+  return NULL;
+}
+
+void tele_start(
+				tele_str *t         // telemetry of the run, its counters at 0
+				,int interval       // seconds between reports
+				,char *path         // Prometheus text file rewritten at each report, NULL for none
+				,long total_bytes   // size of the input, 0 when unknown
+				){
+  t->interval = interval;
+  t->path = path;
+  t->total_bytes = total_bytes;
+  t->started = now();
+  t->quit = false;
+  pthread_mutex_init( &t->lock, NULL );
+  pthread_cond_init( &t->wake, NULL );
+  if ( pthread_create( &t->thread, NULL, tele_thread, t ) != 0 ){
+	fprintf( stderr, "Could not start the telemetry thread from within ~tele_start()~ function. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+}
+
+void tele_read(
+			   tele_str *t         // telemetry of the run
+			   ,size_t *len        // bytes of the lines of a block read, '\n' included
+			   ,long n             // amount of lines
+			   ){
+  long bytes = 0;
+  for (long i = 0; i < n; i++) {
+	bytes += len[i];
+  }
+  TELE_ADD( t, lines, n );
+  TELE_ADD( t, bytes, bytes );
+}
+
+void tele_stop(
+			   tele_str *t         // telemetry whose thread reports a last time and is joined
+			   ){
+  pthread_mutex_lock( &t->lock );
+  t->quit = true;
+  pthread_cond_signal( &t->wake );
+  pthread_mutex_unlock( &t->lock );
+  pthread_join( t->thread, NULL );
+  pthread_mutex_destroy( &t->lock );
+  pthread_cond_destroy( &t->wake );
+}
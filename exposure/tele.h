@@ -0,0 +1,72 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Progress telemetry of a run (--telemetry, --telemetry-file)
+//
+//  The readers and worker threads add into counters of the run as they go, with relaxed atomic additions once per
+//  block of lines or chunk of policies (the rejections, on the cold path of the LOG, once each):
+//
+//    lines          lines read from the input (and their bytes)
+//    validated      policies validated, once per study
+//    rejected       policies out of study, and by each rule of validate() they break (a policy may break several)
+//    policy_years   lines of exposures (policy years) computed, written or added into the aggregate
+//
+//  A thread of its own wakes up every ~interval~ seconds, prints the counters on stderr with their rates over the
+//  last interval and, when the size of the input is known (regular files), how much of it was read and the time
+//  left at the pace so far. With a file path, it also rewrites that file in the text format of Prometheus (written
+//  aside then renamed, as the textfile collector of node_exporter expects):
+//
+//    exposure_lines_read_total 1234567
+//    exposure_rule_failures_total{rule="C4"} 2345
+//    ...
+//
+#ifndef TELE_H
+#define TELE_H
+
+#include <stdbool.h>     // bool (data type)
+#include <stddef.h>      // size_t
+#include <pthread.h>     // telemetry thread
+
+// rules of validate(), as numbered there
+typedef enum tele_rule
+{
+  TELE_I1 = 0, TELE_I2, TELE_I3, TELE_I4, TELE_I5, TELE_C1, TELE_C2, TELE_C3, TELE_C4, TELE_C5,
+  TELE_RULES
+} tele_rule;
+
+typedef struct tele_str
+{
+  long lines;          // lines read
+  long bytes;          // bytes read
+  long validated;      // policies validated (once per study)
+  long rejected;        // policies out of study (once per study)
+  long broken[TELE_RULES];  // policies breaking each rule
+  long policy_years;   // policy years exposed
+  long total_bytes;    // size of the input, 0 when unknown (e.g. a pipe)
+
+  int interval;        // seconds between reports
+  char *path;          // Prometheus text file, NULL when not written
+  double started;      // time the run started (seconds)
+  pthread_t thread;
+  pthread_mutex_t lock;  // guards ~quit~
+  pthread_cond_t wake;   // signalled when the run is over
+  bool quit;
+} tele_str;
+
+// counter of the run added to by any thread
+#define TELE_ADD(t, counter, v) __atomic_fetch_add( &(t)->counter, (v), __ATOMIC_RELAXED )
+
+void tele_start(
+				tele_str *t         // telemetry of the run, its counters at 0
+				,int interval       // seconds between reports
+				,char *path         // Prometheus text file rewritten at each report, NULL for none
+				,long total_bytes   // size of the input, 0 when unknown
+				);
+void tele_read(
+			   tele_str *t         // telemetry of the run
+			   ,size_t *len        // bytes of the lines of a block read, '\n' included
+			   ,long n             // amount of lines
+			   );
+void tele_stop(
+			   tele_str *t         // telemetry whose thread reports a last time and is joined
+			   );
+
+#endif
@@ -0,0 +1,113 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Writers of the exposures of a study (see writer.h)
+//
+#include <stdio.h>       // FILE, fopen, setvbuf, snprintf
+#include <stdlib.h>      // realloc, free, exit
+#include <string.h>      // strcmp, strdup, memset
+#include <errno.h>       // errno, EEXIST
+#include <sys/stat.h>    // mkdir()
+
+#include "writer.h"
+
+// buffer of each partition file: partitions receive their lines scattered, so a larger buffer keeps writes big
+#define PART_BUFSIZE 65536
+
+partition_by partition_parse(
+							 char *name          // "policy_year" or "attained_age"
+							 ){
+  if ( strcmp( name, "policy_year" ) == 0 )  return PARTITION_POLICY_YEAR;
+  if ( strcmp( name, "attained_age" ) == 0 ) return PARTITION_ATTAINED_AGE;
+  return PARTITION_NONE;
+}
+
+const char *partition_name(
+						   partition_by by     // column of the partitions
+						   ){
+  switch (by)
+	{
+	case PARTITION_POLICY_YEAR:  return "policy_year";
+	case PARTITION_ATTAINED_AGE: return "attained_age";
+	default:                     return "none";
+	}
+}
+
+void writer_single(
+				   writer_str *w       // writer to be initialized
+				   ,FILE *f            // file receiving every line
+				   ){
+  memset( w, 0, sizeof(writer_str) );
+  w->f = f;
+  w->by = PARTITION_NONE;
+}
+
+void writer_partitioned(
+						writer_str *w       // writer to be initialized
+						,partition_by by    // column of the partitions
+						,char *dir          // directory holding the partition directories (must exist)
+						,int part           // part number of the files of this writer
+						){
+  memset( w, 0, sizeof(writer_str) );
+  w->by = by;
+  w->dir = strdup( dir );
+  w->part = part;
+  if ( w->dir == NULL ){
+	fprintf( stderr, "Could not allocate memory for ~w->dir~ pointer from within ~writer_partitioned()~ function. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+}
+
+FILE *writer_file(
+				  writer_str *w       // writer of the exposures of a study
+				  ,int policy_year    // policy year of the line to be written
+				  ,int attained_age   // attained age of the line to be written
+				  ){
+  if ( w->by == PARTITION_NONE ) return w->f;
+
+  int value = ( w->by == PARTITION_POLICY_YEAR ) ? policy_year : attained_age;
+  if ( value < 0 ) value = 0; // no policy year nor attained age below 0 passes validate(), but stay safe
+
+  // table of partition files, indexed by the partition value, grown as larger values show up
+  if ( value >= w->n_part ){
+	int n = ( value + 1 > 2 * w->n_part ) ? value + 1 : 2 * w->n_part;
+	w->f_part = (FILE **) realloc( w->f_part, n * sizeof(FILE *) );
+	if ( w->f_part == NULL ){
+	  fprintf( stderr, "Could not allocate memory for ~w->f_part~ pointer from within ~writer_file()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+	memset( w->f_part + w->n_part, 0, (n - w->n_part) * sizeof(FILE *) );
+	w->n_part = n;
+  }
+
+  // first line of the partition: create its directory (other writer threads may have done it already) and file
+  if ( w->f_part[value] == NULL ){
+	size_t n = strlen( w->dir ) + 64;
+	char fname[n];
+
+	snprintf( fname, n, "%s/%s=%02d", w->dir, partition_name( w->by ), value );
+	if ( mkdir( fname, 0777 ) != 0 && errno != EEXIST ){
+	  fprintf( stderr, "Could not create partition directory '%s'. Aborting...\n", fname );
+	  exit( EXIT_FAILURE );
+	}
+	snprintf( fname, n, "%s/%s=%02d/part-%d.csv", w->dir, partition_name( w->by ), value, w->part );
+	w->f_part[value] = fopen( fname, "w" );
+	if ( w->f_part[value] == NULL ){
+	  fprintf( stderr, "Could not open file '%s' (too many open files? see ulimit -n). Aborting...\n", fname );
+	  exit( EXIT_FAILURE );
+	}
+	setvbuf( w->f_part[value], NULL, _IOFBF, PART_BUFSIZE );
+  }
+  return w->f_part[value];
+}
+
+void writer_close(
+				  writer_str *w       // writer whose partition files are closed (a single file is left open)
+				  ){
+  for (int i = 0; i < w->n_part; i++) {
+	if ( w->f_part[i] != NULL ) fclose( w->f_part[i] );
+  }
+  free( w->f_part );
+  free( w->dir );
+  w->f_part = NULL;
+  w->n_part = 0;
+  w->dir = NULL;
+}
@@ -0,0 +1,73 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Writers of the exposures of a study
+//
+//  Either a single file (~exposures.csv~, or a memory buffer of a chunk of the threaded engine), or a directory tree
+//  partitioned by policy year or by attained age
+//
+//    <output>/exposures/policy_year=01/part-0.csv
+//    <output>/exposures/policy_year=01/part-1.csv
+//    <output>/exposures/policy_year=02/part-0.csv
+//    ...
+//
+//  where each writer thread K keeps its own buffered file per partition (part-K.csv), opened with its first line.
+//  The partitions can then be bulk-loaded in parallel downstream, with no repartitioning.
+//
+//  A writer may also add the exposures into a cube of the study (--aggregate, see agg.h), and write no file at all
+//  (--aggregate-only: single writer of a NULL file).
+//
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stdio.h>       // FILE
+
+#include "agg.h"         // cube of aggregated exposures
+#include "surv.h"        // histograms of the durations
+#include "sample.h"      // strata of the sampled policies
+
+// column by which the exposures are partitioned (--partition-by)
+typedef enum partition_by
+{
+  PARTITION_NONE = 0,      // single file
+  PARTITION_POLICY_YEAR,   // policy_year=NN directories
+  PARTITION_ATTAINED_AGE   // attained_age=NN directories
+} partition_by;
+
+typedef struct writer_str
+{
+  FILE *f;             // single file, when not partitioned
+  partition_by by;     // column of the partitions
+  char *dir;           // partitioned: directory holding the partition directories, i.e. <output>/exposures
+  int part;            // partitioned: part number of the files of this writer (the writer thread)
+  FILE **f_part;       // partitioned: file of each partition value, NULL until its first line
+  int n_part;          // partitioned: size of ~f_part~
+  agg_str *agg;        // cube receiving the exposures as well (--aggregate), NULL otherwise
+  surv_str *surv;      // histograms receiving the durations of the policies as well (--survival), NULL otherwise
+  sample_str *sample;  // strata receiving the totals of the sampled policies (--sample), NULL otherwise
+} writer_str;
+
+partition_by partition_parse(
+							 char *name          // "policy_year" or "attained_age"
+							 );
+const char *partition_name(
+						   partition_by by     // column of the partitions
+						   );
+void writer_single(
+				   writer_str *w       // writer to be initialized
+				   ,FILE *f            // file receiving every line
+				   );
+void writer_partitioned(
+						writer_str *w       // writer to be initialized
+						,partition_by by    // column of the partitions
+						,char *dir          // directory holding the partition directories (must exist)
+						,int part           // part number of the files of this writer
+						);
+FILE *writer_file(
+				  writer_str *w       // writer of the exposures of a study
+				  ,int policy_year    // policy year of the line to be written
+				  ,int attained_age   // attained age of the line to be written
+				  );                  // file of the line, NULL when no file is written (--aggregate-only)
+void writer_close(
+				  writer_str *w       // writer whose partition files are closed (a single file is left open)
+				  );
+
+#endif
@@ -10,26 +10,27 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+
+#include "lines.h"   /* leitura em blocos, compartilhada com ../strtok_r e ../exposure */
 
 int main(void) {
 
-  /* ponteiro para sequência de strings por linha */
-  char *line = NULL;
+  /* leitor de stdin em blocos de LINES_BLOCK bytes, com leitura antecipada */
+  line_reader *r = lines_open(0, 0, true);
+  char *line;
   size_t len = 0;
-  ssize_t read = 0;
-
-  while (1) {
-	read = getline(&line, &len, stdin);
-
-	if (read == -1)
-	  break;
 
+  while ((line = lines_next(r, &len)) != NULL) {
+	/* o '\n' virou '\0' no fim da linha (a última pode não ter '\n') */
 	printf("line = %s", line);
-	printf("line length = %zu\n", read);
+	if (line[len - 1] == '\0')
+	  putchar('\n');
+	printf("line length = %zu\n", len);
 	puts("");
   }
-  /* libera a memória alocada para variável line */
-  free(line);
+  /* libera os blocos do leitor */
+  lines_close(r);
 
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,320 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Block line reader (see lines.h)
+//
+//  Every buffer of the ring keeps ~reserve~ bytes in front of its data: the unfinished line at the end of a block is
+//  kept aside (~carry~) and copied there, right before the rest of it, once the next block is taken, so that blocks
+//  may be released in any order. A line longer than the reserve grows the buffer that receives it.
+//
+#include <stdio.h>       // fprintf
+#include <stdlib.h>      // malloc, realloc, free, exit
+#include <string.h>      // memchr, memcpy
+#include <errno.h>       // errno, EINTR
+#include <unistd.h>      // read
+#include <poll.h>        // poll
+#include <pthread.h>     // read-ahead thread
+
+#include "lines.h"
+
+// room kept in front of each block for the piece of line carried from the previous one
+#define LINES_RESERVE (64 << 10)
+
+// milliseconds a slow input is waited for once the block holds a whole line (see fill())
+#define LINES_WAIT 1
+
+typedef enum ring_state { RING_FREE, RING_FILLED, RING_HELD } ring_state;
+
+typedef struct ring_str
+{
+  char *buf;           // reserve, then up to ~block~ bytes of input, then one byte for a final '\0'
+  size_t reserve;      // bytes in front of the data
+  size_t n;            // bytes of input in the buffer
+  bool eof;            // the input ended within this block
+  ring_state state;    // free (to be read into), filled (ready to be taken) or held (lines being processed)
+  char **line;         // lines of the block
+  size_t *len;
+  long n_line;
+  long cap_line;       // size of ~line~ and ~len~
+} ring_str;
+
+struct line_reader
+{
+  int fd;
+  size_t block;
+  bool read_ahead;
+  ring_str ring[LINES_RING];
+  long next_fill;      // read-ahead: next buffer of the ring to be filled
+  long next_take;      // next buffer of the ring to be taken
+  char *carry;         // unfinished line at the end of the last block taken ...
+  size_t carry_len;    // ... its bytes
+  size_t carry_cap;    // ... and the size of ~carry~
+  bool done;           // the last line was handed out
+
+  int held;            // lines_block() and lines_next(): buffer whose lines are being processed (-1 if none)
+  long next_line;      // lines_next(): next line of the held buffer
+
+  pthread_t thread;
+  pthread_mutex_t lock;  // guards the states of the ring and ~quit~
+  pthread_cond_t cond;   // signalled when the state of a buffer changes or the reader quits
+  bool quit;
+};
+
+// reads a whole block (or up to the end of the input) into a buffer of the ring. A slow input (a terminal, or a pipe
+// from e.g. tail -f) does not wait for the block to fill: once a read came short with a whole line in the block, the
+// block is handed out when nothing more comes within LINES_WAIT. Files and fast pipes fill whole blocks
+static void fill( line_reader *r, ring_str *b ){
+  b->n = 0;
+  b->eof = false;
+  bool newline = false;
+  while ( b->n < r->block ) {
+	if ( newline ){
+	  struct pollfd p = { .fd = r->fd, .events = POLLIN };
+	  if ( poll( &p, 1, LINES_WAIT ) == 0 ) break;
+	}
+	ssize_t k = read( r->fd, b->buf + b->reserve + b->n, r->block - b->n );
+	if ( k < 0 ){
+	  if ( errno == EINTR ) continue;
+	  fprintf( stderr, "Could not read the input from within ~fill()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+	if ( k == 0 ){
+	  b->eof = true;
+	  break;
+	}
+	if ( newline == false && memchr( b->buf + b->reserve + b->n, '\n', k ) != NULL ) newline = true;
+	b->n += k;
+  }
+}
+
+static void *reader_thread( void *arg ){
+  line_reader *r = (line_reader *) arg;
+  while (1) {
+	pthread_mutex_lock( &r->lock );
+	ring_str *b = &r->ring[ r->next_fill % LINES_RING ];
+	while ( b->state != RING_FREE && !r->quit ){
+	  pthread_cond_wait( &r->cond, &r->lock );
+	}
+	if ( r->quit ){
+	  pthread_mutex_unlock( &r->lock );
+	  break;
+	}
+	pthread_mutex_unlock( &r->lock );
+
+	fill( r, b );
+
+	pthread_mutex_lock( &r->lock );
+	b->state = RING_FILLED;
+	r->next_fill++;
+	pthread_cond_broadcast( &r->cond );
+	pthread_mutex_unlock( &r->lock );
+	if ( b->eof ) break;
+  }
+  return NULL;
+}
+
+// next block of the input, held by the caller until released
+static int take( line_reader *r ){
+  int i = r->next_take % LINES_RING;
+  ring_str *b = &r->ring[i];
+  pthread_mutex_lock( &r->lock );
+  if ( r->read_ahead ){
+	while ( b->state != RING_FILLED ){
+	  pthread_cond_wait( &r->cond, &r->lock );
+	}
+	b->state = RING_HELD;
+	pthread_mutex_unlock( &r->lock );
+  } else {
+	// the buffer may still be kept by a stage of a pipeline (lines_take())
+	while ( b->state != RING_FREE ){
+	  pthread_cond_wait( &r->cond, &r->lock );
+	}
+	b->state = RING_HELD;
+	pthread_mutex_unlock( &r->lock );
+	fill( r, b );
+  }
+  r->next_take++;
+  return i;
+}
+
+static void release( line_reader *r, int i ){
+  pthread_mutex_lock( &r->lock );
+  r->ring[i].state = RING_FREE;
+  pthread_cond_broadcast( &r->cond );
+  pthread_mutex_unlock( &r->lock );
+}
+
+static void push( ring_str *b, char *line, size_t len ){
+  if ( b->n_line == b->cap_line ){
+	b->cap_line = ( b->cap_line > 0 ) ? 2 * b->cap_line : 65536;
+	b->line = (char **) realloc( b->line, b->cap_line * sizeof(char *) );
+	b->len = (size_t *) realloc( b->len, b->cap_line * sizeof(size_t) );
+	if ( b->line == NULL || b->len == NULL ){
+	  fprintf( stderr, "Could not allocate memory for ~b->line~ pointer from within ~push()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+  }
+  b->line[ b->n_line ] = line;
+  b->len[ b->n_line ] = len;
+  b->n_line++;
+}
+
+line_reader *lines_open(
+						int fd              // file descriptor to be read (0 for stdin), left open by lines_close()
+						,size_t block       // bytes read at a time (0 for LINES_BLOCK)
+						,bool read_ahead    // read the next blocks in a thread of the reader
+						){
+  line_reader *r = (line_reader *) calloc( 1, sizeof(line_reader) );
+  if ( r == NULL ){
+	fprintf( stderr, "Could not allocate memory for ~r~ pointer from within ~lines_open()~ function. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+  r->fd = fd;
+  r->block = ( block > 0 ) ? block : LINES_BLOCK;
+  r->read_ahead = read_ahead;
+  r->held = -1;
+  for (int i = 0; i < LINES_RING; i++) {
+	r->ring[i].reserve = LINES_RESERVE;
+	r->ring[i].buf = (char *) malloc( LINES_RESERVE + r->block + 1 );
+	r->ring[i].state = RING_FREE;
+	if ( r->ring[i].buf == NULL ){
+	  fprintf( stderr, "Could not allocate memory for the ring of blocks from within ~lines_open()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+  }
+  pthread_mutex_init( &r->lock, NULL );
+  pthread_cond_init( &r->cond, NULL );
+  if ( read_ahead ){
+	if ( pthread_create( &r->thread, NULL, reader_thread, r ) != 0 ){
+	  fprintf( stderr, "Could not start the read-ahead thread from within ~lines_open()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+  }
+  return r;
+}
+
+long lines_take(
+				line_reader *r      // reader
+				,char ***line       // lines of the next block, without their '\n' (valid until the block is released)
+				,size_t **len       // bytes of each line in the input, '\n' included
+				,int *block         // block to be given back with lines_release()
+				){
+  if ( r->done ) return 0;
+
+  while (1) {
+	int i = take( r );
+	ring_str *b = &r->ring[i];
+	b->n_line = 0;
+
+	// the unfinished line of the previous block goes right in front of this one
+	if ( r->carry_len > b->reserve ){
+	  size_t reserve = 2 * r->carry_len;
+	  char *buf = (char *) malloc( reserve + r->block + 1 );
+	  if ( buf == NULL ){
+		fprintf( stderr, "Could not allocate memory for a line of %zu bytes from within ~lines_take()~ function. Aborting...\n", r->carry_len );
+		exit( EXIT_FAILURE );
+	  }
+	  memcpy( buf + reserve, b->buf + b->reserve, b->n );
+	  free( b->buf );
+	  b->buf = buf;
+	  b->reserve = reserve;
+	}
+	char *start = b->buf + b->reserve - r->carry_len;
+	memcpy( start, r->carry, r->carry_len );
+
+	// lines of the block, each '\n' turned into the '\0' ending the line
+	char *p = start, *end = b->buf + b->reserve + b->n;
+	char *nl;
+	while ( (nl = memchr( p, '\n', end - p )) != NULL ) {
+	  *nl = '\0';
+	  push( b, p, nl - p + 1 );
+	  p = nl + 1;
+	}
+	size_t tail = end - p;
+
+	if ( b->eof ){
+	  // last line, without '\n'
+	  if ( tail > 0 ){
+		*end = '\0';
+		push( b, p, tail );
+	  }
+	  r->carry_len = 0;
+	  r->done = true;
+	} else {
+	  // unfinished line, kept aside for the next block
+	  if ( tail > r->carry_cap ){
+		r->carry_cap = 2 * tail;
+		r->carry = (char *) realloc( r->carry, r->carry_cap );
+		if ( r->carry == NULL ){
+		  fprintf( stderr, "Could not allocate memory for ~r->carry~ pointer from within ~lines_take()~ function. Aborting...\n");
+		  exit( EXIT_FAILURE );
+		}
+	  }
+	  memcpy( r->carry, p, tail );
+	  r->carry_len = tail;
+	}
+
+	if ( b->n_line > 0 ){
+	  *line = b->line;
+	  *len = b->len;
+	  *block = i;
+	  return b->n_line;
+	}
+	// no '\n' in the whole block (carried whole into the next one), or nothing left at the end of the input
+	release( r, i );
+	if ( r->done ) return 0;
+  }
+}
+
+void lines_release(
+				   line_reader *r      // reader
+				   ,int block          // block taken by lines_take(), whose lines are no longer needed
+				   ){
+  release( r, block );
+}
+
+long lines_block(
+				 line_reader *r      // reader
+				 ,char ***line       // lines of the next block, without their '\n' (valid until the next call)
+				 ,size_t **len       // bytes of each line in the input, '\n' included
+				 ){
+  if ( r->held >= 0 ) release( r, r->held );
+  r->held = -1;
+  r->next_line = 0;
+  long n = lines_take( r, line, len, &r->held );
+  if ( n == 0 ) r->held = -1;
+  return n;
+}
+
+char *lines_next(
+				 line_reader *r      // reader
+				 ,size_t *len        // bytes of the line in the input, '\n' included as getline() counts them
+				 ){
+  if ( r->held < 0 || r->next_line >= r->ring[ r->held ].n_line ){
+	char **line;
+	size_t *l;
+	if ( lines_block( r, &line, &l ) == 0 ) return NULL;
+  }
+  ring_str *b = &r->ring[ r->held ];
+  *len = b->len[ r->next_line ];
+  return b->line[ r->next_line++ ];
+}
+
+void lines_close(
+				 line_reader *r      // reader whose thread is joined and buffers freed
+				 ){
+  if ( r->read_ahead ){
+	pthread_mutex_lock( &r->lock );
+	r->quit = true;
+	pthread_cond_broadcast( &r->cond );
+	pthread_mutex_unlock( &r->lock );
+	pthread_join( r->thread, NULL );
+  }
+  pthread_mutex_destroy( &r->lock );
+  pthread_cond_destroy( &r->cond );
+  for (int i = 0; i < LINES_RING; i++) {
+	free( r->ring[i].buf );
+	free( r->ring[i].line );
+	free( r->ring[i].len );
+  }
+  free( r->carry );
+  free( r );
+}
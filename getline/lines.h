@@ -0,0 +1,73 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Block line reader
+//
+//  getline() takes the stdio lock, may realloc and copies every line. The reader instead read()s the input (a pipe
+//  as well as a file) in large blocks, LINES_BLOCK bytes by default, into a ring of LINES_RING buffers, and hands
+//  out views of the lines right inside the block: each '\n' is overwritten by '\0', so a view is a C string (which
+//  strsep() and friends may cut further) and no byte is copied, but for the piece of a line crossing into the next
+//  block, carried to the front of it.
+//
+//  With read-ahead, a thread of the reader fills the next buffers of the ring while the lines of the current one are
+//  being processed.
+//
+//  A slow input (a terminal, tail -f into a pipe) is not held up until a block fills: a block holding a whole line
+//  is handed out once the input pauses, so its lines stream as they arrive, as with getline().
+//
+//    line_reader *r = lines_open( 0, 0, true );    // stdin, blocks of LINES_BLOCK bytes, read-ahead
+//    size_t len;
+//    char *line;
+//    while ( (line = lines_next( r, &len )) != NULL ) { ... }
+//    lines_close( r );
+//
+//  or, a whole block of lines at a time (e.g. to be split among threads):
+//
+//    char **line;
+//    size_t *len;
+//    long n;
+//    while ( (n = lines_block( r, &line, &len )) > 0 ) { ... }
+//
+//  lines_block() gives the block back to the reader on its next call. Stages of a pipeline, passing blocks from one
+//  thread to the next, keep them instead with lines_take() until done with their lines (lines_release()). Up to
+//  LINES_RING blocks may be kept at a time: lines_take() waits for one of them to be released when all are kept, so
+//  they must be released by another thread than the one taking them. Each block kept is one buffer less read ahead.
+//
+#ifndef LINES_H
+#define LINES_H
+
+#include <stddef.h>      // size_t
+#include <stdbool.h>     // bool (data type)
+
+#define LINES_BLOCK (4 << 20)   // default size of the blocks read at a time
+#define LINES_RING  3           // buffers of the ring: one being processed, the others read ahead
+
+typedef struct line_reader line_reader;
+
+line_reader *lines_open(
+						int fd              // file descriptor to be read (0 for stdin), left open by lines_close()
+						,size_t block       // bytes read at a time (0 for LINES_BLOCK)
+						,bool read_ahead    // read the next blocks in a thread of the reader
+						);
+char *lines_next(
+				 line_reader *r      // reader
+				 ,size_t *len        // bytes of the line in the input, '\n' included as getline() counts them
+				 );                  // next line without its '\n' (valid until the lines of the next block), NULL at the end
+long lines_block(
+				 line_reader *r      // reader
+				 ,char ***line       // lines of the next block, without their '\n' (valid until the next call)
+				 ,size_t **len       // bytes of each line in the input, '\n' included
+				 );                  // amount of lines, 0 at the end of the input
+long lines_take(
+				line_reader *r      // reader
+				,char ***line       // lines of the next block, without their '\n' (valid until the block is released)
+				,size_t **len       // bytes of each line in the input, '\n' included
+				,int *block         // block to be given back with lines_release()
+				);                  // amount of lines, 0 at the end of the input (no block taken)
+void lines_release(
+				   line_reader *r      // reader
+				   ,int block          // block taken by lines_take(), whose lines are no longer needed
+				   );
+void lines_close(
+				 line_reader *r      // reader whose thread is joined and buffers freed
+				 );
+
+#endif
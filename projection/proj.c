@@ -0,0 +1,545 @@
+/*
+  Stochastic projection of an in-force portfolio: claim, lapse and in-force distributions per future year
+
+  run as
+	tail +2 stdin.txt | ./proj --valuation=2020-12-31 --mortality=qx.csv --lapse=wx.csv --horizon=30 \
+							   --scenarios=10000 --threads=4 --seed=1 > projection.csv
+
+  where stdin holds the policies (id;date_of_birth;policy_issue_date;policy_status_code;policy_status_date), as read
+  by ../exposure/exposure, ~qx.csv~ the mortality table (one age;q pair per line) and ~wx.csv~ the optional lapse
+  table (one policy_year;w pair per line), e.g.
+	printf 'age;q\n40;0.00120\n41;0.00131\n42;0.00143\n' > qx.csv
+	printf 'policy_year;w\n1;0.15\n2;0.10\n3;0.06\n' > wx.csv
+  Ages above the last age of the mortality table die within the year; policy years above the last one of the lapse
+  table keep its last (ultimate) rate.
+
+  Policies in force at the valuation date (issued up to it, with status code 1 or a status date after it) are
+  grouped by attained age and policy year at the valuation date. Year t of the projection applies the rates of
+  age x + t - 1 and policy year d + t - 1, deaths before lapses. Every cell holds the cumulative probabilities of
+  leaving the portfolio by death or lapse in each year of the horizon, so the fate of a policy in a scenario is a
+  single uniform: the year and cause where it falls, or survival past the horizon.
+
+  Scenario s seeds the generator of the thread running it with seed + s, so the results are the same whatever the
+  amount of threads. The uniforms are drawn in batches, and each scenario is folded into the distributions of its
+  thread (exact sums and histograms per year and measure) as soon as it ends: memory does not grow with the amount
+  of scenarios.
+
+  stdout holds one line per future year and measure (claims, lapses, inforce at the end of the year):
+	year;measure;expected;mean;sd;min;p05;p50;p95;p995;max
+  where ~expected~ comes straight from the tables, as a check of the simulated ~mean~.
+*/
+
+#include <stdio.h>       // stdin, stdout, stderr, fprintf, FILE, ...
+#include <stdlib.h>      // malloc, calloc, strtol, strtod ...
+#include <string.h>      // strsep, strcmp
+#include <stdbool.h>     // bool (data type)
+#include <math.h>        // sqrt, ceil, floor, NAN
+#include <time.h>        // clock_gettime()
+#include <getopt.h>      // command line arguments: getopt_long()
+#include <pthread.h>     // worker threads
+#include <glib.h>        // date functions
+#include <gsl/gsl_rng.h> // one generator per thread
+
+// attained ages 0 .. MAX_AGE-1 and policy years 1 .. MAX_YEAR-1
+#define MAX_AGE  150
+#define MAX_YEAR 150
+
+// uniforms drawn at a time by each thread
+#define BATCH 4096
+
+// histogram bins of each distribution (bins get wider when the range around the expected value is larger)
+#define MAX_BINS 4096
+
+const char *DELIM = ";";
+const float DAYS_IN_YEAR = 365.25;
+
+// measures projected for every future year
+enum { CLAIMS, LAPSES, INFORCE, N_MEASURE };
+const char *MEASURE[N_MEASURE] = { "claims", "lapses", "inforce" };
+
+// policies sharing attained age and policy year at the valuation date
+typedef struct cell_str
+{
+  int age;             // attained age at the valuation date
+  int year;            // policy year at the valuation date
+  long n;              // policies in force in the cell
+  double *cum;         // 2 * horizon cumulative probabilities: death in year 1, lapse in year 1, death in year 2, ...
+} cell_str;
+
+// distribution of a measure in a future year, accumulated scenario by scenario
+typedef struct dist_str
+{
+  double expected;     // expected value from the tables
+  double var;          // variance from the tables (policies are independent)
+  long shift;          // expected value rounded: the sums below hold deviations from it, exact in integers
+  long lo;             // value of the first bin
+  long width;          // values per bin
+  int n_bins;
+  long *count;         // n_bins + 2 counts: below the first bin, the bins, above the last bin
+  long n;              // scenarios
+  long sum_d;          // sum of the deviations from ~shift~
+  long sum_d2;         // sum of the squared deviations from ~shift~
+  long min;
+  long max;
+} dist_str;
+
+// projection shared by the threads
+typedef struct proj_str
+{
+  cell_str *cell;
+  int n_cell;
+  int horizon;         // future years projected
+  long scenarios;
+  unsigned long seed;
+  long next;           // next scenario to be run (shared by the threads)
+  dist_str *dist;      // horizon x N_MEASURE distributions, copied by every thread and merged at the end
+} proj_str;
+
+typedef struct thread_str
+{
+  proj_str *proj;
+  dist_str *dist;      // distributions of the scenarios run by the thread
+} thread_str;
+
+void read_table(
+				char *fname         // decrement table, one age;rate (or policy_year;rate) pair per line
+				,double *rate       // array of MAX_AGE rates, filled from the table
+				,int *last          // last age (policy year) of the table, -1 when empty
+				);
+void read_policies(
+				   FILE *f             // lines of the policies
+				   ,guint32 valuation  // valuation date as julian day number
+				   ,long *grid         // MAX_AGE x MAX_YEAR policy counts, accumulated
+				   );
+void dist_init(
+			   dist_str *d         // distribution whose bins are set around its expected value and variance
+			   );
+void dist_add(
+			  dist_str *d         // distribution receiving the value of a scenario
+			  ,long value
+			  );
+void dist_merge(
+				dist_str *d         // distribution receiving the counts of ~from~ (same bins)
+				,dist_str *from
+				);
+double dist_quantile(
+					 dist_str *d         // distribution
+					 ,double p           // probability
+					 );
+void *run_scenarios(
+					void *arg           // pointer to the ~thread_str~ of the thread
+					);
+
+
+// --------------------------------------------------------------------------------------------------------------------------
+// main
+int main(int argc, char **argv){
+
+  proj_str proj = { .horizon = 30, .scenarios = 1000, .seed = 1 };
+  int n_threads = 1;
+  char *valuation = NULL;
+  char *mortality = NULL;
+  char *lapse = NULL;
+  bool ok = true;
+
+  // Step 1: Read the command line arguments
+  int c;
+  while (1)
+	{
+	  int option_index = 0;
+	  static struct option long_options[] =
+		{
+		  {"valuation", required_argument, NULL, 'v' },
+		  {"mortality", required_argument, NULL, 'q' },
+		  {"lapse",     required_argument, NULL, 'w' },
+		  {"horizon",   required_argument, NULL, 'h' },
+		  {"scenarios", required_argument, NULL, 'n' },
+		  {"threads",   required_argument, NULL, 'j' },
+		  {"seed",      required_argument, NULL, 's' },
+		  {NULL,        0,                 NULL,  0 }
+		};
+
+	  c = getopt_long(argc, argv, ":v:q:w:h:n:j:s:", long_options, &option_index);
+	  if (c == -1)
+		break;
+
+	  switch (c)
+		{
+		case 'v': valuation = optarg; break;
+		case 'q': mortality = optarg; break;
+		case 'w': lapse = optarg; break;
+		case 'h': proj.horizon = atoi(optarg); break;
+		case 'n': proj.scenarios = atol(optarg); break;
+		case 'j': n_threads = atoi(optarg); break;
+		case 's': proj.seed = strtoul(optarg, NULL, 10); break;
+		case '?':
+		  fprintf( stderr, "Unknown option %c\n", optopt);
+		  ok = false;
+		  break;
+		case ':':
+		  fprintf( stderr, "Missing option for %c\n", optopt);
+		  ok = false;
+		  break;
+		}
+	}
+  if ( valuation == NULL || mortality == NULL ){
+	fprintf( stderr, "Missing mandatory projection parameters: valuation and mortality.\n");
+	ok = false;
+  }
+  GDate *date = g_date_new();
+  if ( valuation != NULL ){
+	g_date_set_parse( date, valuation );
+	if ( !g_date_valid( date ) ){
+	  fprintf( stderr, "Valuation date must be a valid date YYYY-MM-DD.\n");
+	  ok = false;
+	}
+  }
+  if ( proj.horizon < 1 || proj.horizon >= MAX_YEAR || proj.scenarios < 1 || n_threads < 1 ){
+	fprintf( stderr, "Horizon must be between 1 and %d years, scenarios and threads must be positive.\n", MAX_YEAR - 1);
+	ok = false;
+  }
+  if ( ok == false ){
+	fprintf( stderr, "Inconsistent projection parameters. Exiting...\n");
+	exit( EXIT_FAILURE );
+  }
+
+  // Step 2: Read the decrement tables (ages above the mortality table die, policy years above the lapse table keep
+  //         its ultimate rate)
+  double q[MAX_AGE], w[MAX_YEAR];
+  int last_q, last_w;
+  read_table( mortality, q, &last_q );
+  for (int x = last_q + 1; x < MAX_AGE; x++) q[x] = 1;
+  if ( lapse != NULL ){
+	read_table( lapse, w, &last_w );
+	for (int d = last_w + 1; d < MAX_YEAR; d++) w[d] = ( last_w >= 0 ) ? w[last_w] : 0;
+  } else {
+	for (int d = 0; d < MAX_YEAR; d++) w[d] = 0;
+  }
+
+  // Step 3: Group the policies in force at the valuation date by attained age and policy year
+  long *grid = (long *) calloc( MAX_AGE * MAX_YEAR, sizeof(long) );
+  proj.cell = (cell_str *) malloc( MAX_AGE * MAX_YEAR * sizeof(cell_str) );
+  if ( grid == NULL || proj.cell == NULL ){
+	fprintf( stderr, "Could not allocate memory for the cells. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+  read_policies( stdin, g_date_get_julian( date ), grid );
+  g_date_free( date );
+
+  // Step 4: Cumulative probabilities of leaving each cell by death or lapse in every year of the horizon, and the
+  //         expected values and variances of the measures
+  int H = proj.horizon;
+  proj.dist = (dist_str *) calloc( H * N_MEASURE, sizeof(dist_str) );
+  if ( proj.dist == NULL ){
+	fprintf( stderr, "Could not allocate memory for the distributions. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+  long n_policies = 0;
+  for (int x = 0; x < MAX_AGE; x++) {
+	for (int d = 1; d < MAX_YEAR; d++) {
+	  long n = grid[ x * MAX_YEAR + d ];
+	  if ( n == 0 ) continue;
+
+	  cell_str *cl = &proj.cell[ proj.n_cell++ ];
+	  cl->age = x;
+	  cl->year = d;
+	  cl->n = n;
+	  cl->cum = (double *) malloc( 2 * H * sizeof(double) );
+	  if ( cl->cum == NULL ){
+		fprintf( stderr, "Could not allocate memory for ~cl->cum~ pointer from within ~main()~ function. Aborting...\n");
+		exit( EXIT_FAILURE );
+	  }
+	  n_policies += n;
+
+	  double alive = 1, left = 0;
+	  for (int t = 1; t <= H; t++) {
+		int age  = ( x + t - 1 < MAX_AGE ) ? x + t - 1 : MAX_AGE - 1;
+		int year = ( d + t - 1 < MAX_YEAR ) ? d + t - 1 : MAX_YEAR - 1;
+		double p_death = alive * q[age];
+		double p_lapse = alive * ( 1 - q[age] ) * w[year];
+		left += p_death;
+		cl->cum[ 2 * (t-1) ] = left;
+		left += p_lapse;
+		cl->cum[ 2 * (t-1) + 1 ] = left;
+		alive -= p_death + p_lapse;
+
+		dist_str *dt = &proj.dist[ (t-1) * N_MEASURE ];
+		dt[CLAIMS].expected += n * p_death;
+		dt[CLAIMS].var      += n * p_death * ( 1 - p_death );
+		dt[LAPSES].expected += n * p_lapse;
+		dt[LAPSES].var      += n * p_lapse * ( 1 - p_lapse );
+		dt[INFORCE].expected += n * alive;
+		dt[INFORCE].var      += n * alive * ( 1 - alive );
+	  }
+	}
+  }
+  free( grid );
+  for (int i = 0; i < H * N_MEASURE; i++) dist_init( &proj.dist[i] );
+
+  // Step 5: Run the scenarios over the threads, each one with its own generator and distributions
+  struct timespec t0, t1;
+  clock_gettime( CLOCK_MONOTONIC, &t0 );
+  gsl_rng_env_setup();
+  pthread_t thread[n_threads];
+  thread_str arg[n_threads];
+  for (int i = 0; i < n_threads; i++) {
+	arg[i].proj = &proj;
+	arg[i].dist = (dist_str *) malloc( H * N_MEASURE * sizeof(dist_str) );
+	if ( arg[i].dist == NULL ){
+	  fprintf( stderr, "Could not allocate memory for the distributions of the threads. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+	for (int k = 0; k < H * N_MEASURE; k++) {
+	  arg[i].dist[k] = proj.dist[k];
+	  arg[i].dist[k].count = (long *) calloc( proj.dist[k].n_bins + 2, sizeof(long) );
+	  if ( arg[i].dist[k].count == NULL ){
+		fprintf( stderr, "Could not allocate memory for the histograms of the threads. Aborting...\n");
+		exit( EXIT_FAILURE );
+	  }
+	}
+	pthread_create( &thread[i], NULL, run_scenarios, &arg[i] );
+  }
+  for (int i = 0; i < n_threads; i++) {
+	pthread_join( thread[i], NULL );
+	for (int k = 0; k < H * N_MEASURE; k++) {
+	  dist_merge( &proj.dist[k], &arg[i].dist[k] );
+	  free( arg[i].dist[k].count );
+	}
+	free( arg[i].dist );
+  }
+  clock_gettime( CLOCK_MONOTONIC, &t1 );
+  double seconds = ( t1.tv_sec - t0.tv_sec ) + ( t1.tv_nsec - t0.tv_nsec ) * 1e-9;
+  fprintf( stderr, "%ld policies in force in %d cells, %ld scenarios of %d years in %.3f seconds (%.0f policy scenarios/sec).\n",
+		   n_policies, proj.n_cell, proj.scenarios, H, seconds, seconds > 0 ? n_policies * proj.scenarios / seconds : 0 );
+
+  // Step 6: Distribution of each measure in every future year
+  printf( "year;measure;expected;mean;sd;min;p05;p50;p95;p995;max\n" );
+  for (int t = 1; t <= H; t++) {
+	for (int m = 0; m < N_MEASURE; m++) {
+	  dist_str *d = &proj.dist[ (t-1) * N_MEASURE + m ];
+	  double mean = d->shift + (double) d->sum_d / d->n;
+	  double sd = ( d->n > 1 ) ? sqrt( ( d->sum_d2 - (double) d->sum_d * d->sum_d / d->n ) / (d->n - 1) ) : NAN;
+	  printf( "%d;%s;%f;%f;%f;%ld;%.1f;%.1f;%.1f;%.1f;%ld\n", t, MEASURE[m], d->expected, mean, sd, d->min,
+			  dist_quantile( d, 0.05 ), dist_quantile( d, 0.50 ), dist_quantile( d, 0.95 ), dist_quantile( d, 0.995 ),
+			  d->max );
+	}
+  }
+
+  for (int i = 0; i < proj.n_cell; i++) free( proj.cell[i].cum );
+  for (int k = 0; k < H * N_MEASURE; k++) free( proj.dist[k].count );
+  free( proj.dist );
+  free( proj.cell );
+
+  return EXIT_SUCCESS;
+} // main
+
+
+// --------------------------------------------------------------------------------------------------------------------------
+// declarations of functions
+void read_table(
+				char *fname         // decrement table, one age;rate (or policy_year;rate) pair per line
+				,double *rate       // array of MAX_AGE rates, filled from the table
+				,int *last          // last age (policy year) of the table, -1 when empty
+				){
+  FILE *f = fopen( fname, "r" );
+  if ( f == NULL ){
+	fprintf( stderr, "Could not open decrement table '%s'. Aborting...\n", fname );
+	exit( EXIT_FAILURE );
+  }
+  for (int x = 0; x < MAX_AGE; x++) rate[x] = 0;
+  *last = -1;
+
+  char *line = NULL;
+  size_t len = 0;
+  while ( getline( &line, &len, f ) >= 0 ) {
+	char *rest;
+	long x = strtol( line, &rest, 10 );
+	if ( rest == line || *rest != ';' ) continue; // header or comment
+	if ( x >= 0 && x < MAX_AGE ){
+	  rate[x] = strtod( rest + 1, NULL );
+	  if ( x > *last ) *last = x;
+	}
+  }
+  free( line );
+  fclose( f );
+}
+
+void read_policies(
+				   FILE *f             // lines of the policies
+				   ,guint32 valuation  // valuation date as julian day number
+				   ,long *grid         // MAX_AGE x MAX_YEAR policy counts, accumulated
+				   ){
+  // id;date_of_birth;policy_issue_date;policy_status_code;policy_status_date
+  char *line = NULL;
+  size_t len = 0;
+  long skipped = 0, not_inforce = 0;
+  GDate *date = g_date_new();
+
+  while ( getline( &line, &len, f ) >= 0 ) {
+	line[ strcspn( line, "\r\n" ) ] = '\0';
+	char *rest = line;
+	strsep( &rest, DELIM );                       // id
+	char *date_of_birth = strsep( &rest, DELIM );
+	char *issue_date    = strsep( &rest, DELIM );
+	char *status_code   = strsep( &rest, DELIM );
+	char *status_date   = strsep( &rest, DELIM );
+	if ( status_code == NULL ){ skipped++; continue; }
+
+	guint32 dob, pid, psd = 0;
+	g_date_set_parse( date, date_of_birth );
+	if ( !g_date_valid( date ) ){ skipped++; continue; }
+	dob = g_date_get_julian( date );
+	g_date_set_parse( date, issue_date );
+	if ( !g_date_valid( date ) ){ skipped++; continue; }
+	pid = g_date_get_julian( date );
+	if ( strcmp( status_code, "1" ) != 0 ){
+	  if ( status_date == NULL ){ skipped++; continue; }
+	  g_date_set_parse( date, status_date );
+	  if ( !g_date_valid( date ) ){ skipped++; continue; }
+	  psd = g_date_get_julian( date );
+	}
+
+	// in force at the valuation date: issued up to it, and still in force or left the portfolio after it
+	if ( pid > valuation || dob > pid || ( psd != 0 && psd <= valuation ) ){ not_inforce++; continue; }
+
+	int age_issue = (int) ( ( pid - dob ) / DAYS_IN_YEAR );
+	int year = (int) ( ( valuation - pid ) / DAYS_IN_YEAR ) + 1;
+	int age = age_issue + year - 1;
+	if ( age >= MAX_AGE || year >= MAX_YEAR ){ skipped++; continue; }
+	grid[ age * MAX_YEAR + year ]++;
+  }
+  g_date_free( date );
+  free( line );
+  if ( skipped > 0 ){
+	fprintf( stderr, "%ld lines of stdin skipped (not id;date_of_birth;policy_issue_date;policy_status_code;policy_status_date).\n", skipped );
+  }
+  if ( not_inforce > 0 ){
+	fprintf( stderr, "%ld policies not in force at the valuation date.\n", not_inforce );
+  }
+}
+
+void dist_init(
+			   dist_str *d         // distribution whose bins are set around its expected value and variance
+			   ){
+  // eight standard deviations on each side: values outside are only counted below or above the bins (they still
+  // enter the sums, the minimum and the maximum)
+  d->shift = (long) floor( d->expected + 0.5 );
+  long half = (long) ceil( 8 * sqrt( d->var ) ) + 8;
+  d->lo = d->shift - half;
+  if ( d->lo < 0 ) d->lo = 0;
+  long span = d->shift + half - d->lo + 1;
+  d->width = ( span + MAX_BINS - 1 ) / MAX_BINS;
+  d->n_bins = (int) ( ( span + d->width - 1 ) / d->width );
+  d->count = (long *) calloc( d->n_bins + 2, sizeof(long) );
+  if ( d->count == NULL ){
+	fprintf( stderr, "Could not allocate memory for ~d->count~ pointer from within ~dist_init()~ function. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+  d->n = d->sum_d = d->sum_d2 = 0;
+  d->min = -1;
+  d->max = -1;
+}
+
+void dist_add(
+			  dist_str *d         // distribution receiving the value of a scenario
+			  ,long value
+			  ){
+  long dev = value - d->shift;
+  d->n++;
+  d->sum_d += dev;
+  d->sum_d2 += dev * dev;
+  if ( d->min < 0 || value < d->min ) d->min = value;
+  if ( value > d->max ) d->max = value;
+
+  long bin = ( value - d->lo ) / d->width;
+  if ( value < d->lo ) d->count[0]++;
+  else if ( bin >= d->n_bins ) d->count[ d->n_bins + 1 ]++;
+  else d->count[ bin + 1 ]++;
+}
+
+void dist_merge(
+				dist_str *d         // distribution receiving the counts of ~from~ (same bins)
+				,dist_str *from
+				){
+  if ( from->n == 0 ) return;
+  for (int b = 0; b < d->n_bins + 2; b++) d->count[b] += from->count[b];
+  if ( d->n == 0 || from->min < d->min ) d->min = from->min;
+  if ( from->max > d->max ) d->max = from->max;
+  d->n += from->n;
+  d->sum_d += from->sum_d;
+  d->sum_d2 += from->sum_d2;
+}
+
+double dist_quantile(
+					 dist_str *d         // distribution
+					 ,double p           // probability
+					 ){
+  // smallest value (the middle of its bin) whose cumulative count reaches p of the scenarios
+  long target = (long) ceil( p * d->n );
+  if ( target < 1 ) target = 1;
+  long cum = d->count[0];
+  if ( cum >= target ) return d->min;
+  for (int b = 0; b < d->n_bins; b++) {
+	cum += d->count[ b + 1 ];
+	if ( cum >= target ) return d->lo + b * d->width + ( d->width - 1 ) / 2.0;
+  }
+  return d->max;
+}
+
+void *run_scenarios(
+					void *arg           // pointer to the ~thread_str~ of the thread
+					){
+  thread_str *th = (thread_str *) arg;
+  proj_str *proj = th->proj;
+  int H = proj->horizon;
+  int n_exit = 2 * H;
+  long exits[n_exit];
+  double u[BATCH];
+
+  // one generator per thread, seeded again for each scenario so that scenario s draws the same numbers whichever
+  // thread runs it
+  gsl_rng *rng = gsl_rng_alloc( gsl_rng_default );
+
+  long s;
+  while ( (s = __atomic_fetch_add( &proj->next, 1, __ATOMIC_RELAXED )) < proj->scenarios ) {
+	gsl_rng_set( rng, proj->seed + s );
+	for (int k = 0; k < n_exit; k++) exits[k] = 0;
+	long n_policies = 0;
+
+	for (int i = 0; i < proj->n_cell; i++) {
+	  cell_str *cl = &proj->cell[i];
+	  double *cum = cl->cum;
+	  double stay = cum[ n_exit - 1 ];  // uniforms from here on survive the whole horizon
+	  n_policies += cl->n;
+
+	  for (long done = 0; done < cl->n; done += BATCH) {
+		int m = ( cl->n - done < BATCH ) ? (int) ( cl->n - done ) : BATCH;
+		for (int j = 0; j < m; j++) u[j] = gsl_rng_uniform( rng );
+		for (int j = 0; j < m; j++) {
+		  if ( u[j] >= stay ) continue;
+		  // first death or lapse whose cumulative probability is above the uniform
+		  int lo = 0, hi = n_exit - 1;
+		  while ( lo < hi ) {
+			int mid = (lo + hi) / 2;
+			if ( u[j] < cum[mid] ) hi = mid;
+			else lo = mid + 1;
+		  }
+		  exits[lo]++;
+		}
+	  }
+	}
+
+	// fold the scenario into the distributions of the thread
+	long inforce = n_policies;
+	for (int t = 0; t < H; t++) {
+	  dist_str *dt = &th->dist[ t * N_MEASURE ];
+	  inforce -= exits[ 2 * t ] + exits[ 2 * t + 1 ];
+	  dist_add( &dt[CLAIMS], exits[ 2 * t ] );
+	  dist_add( &dt[LAPSES], exits[ 2 * t + 1 ] );
+	  dist_add( &dt[INFORCE], inforce );
+	}
+  }
+
+  gsl_rng_free( rng );
+  return NULL;
+}
@@ -0,0 +1,100 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Philox4x32-10 counter-based generator (see philox.h)
+//
+#include "philox.h"
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u  // golden ratio
+#define PHILOX_W1 0xBB67AE85u  // sqrt(3) - 1
+
+typedef struct philox_state
+{
+  uint32_t key[2];     // seed
+  uint64_t block;      // counter of the block in ~out~
+  uint32_t out[4];     // numbers of the current block
+  int used;            // numbers of ~out~ already drawn
+} philox_state;
+
+void philox4x32_10(
+				   const uint32_t ctr[4]     // counter
+				   ,const uint32_t key[2]    // key (the seed)
+				   ,uint32_t out[4]          // numbers of the block
+				   ){
+  uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+  uint32_t k0 = key[0], k1 = key[1];
+
+  for (int round = 0; round < 10; round++) {
+	uint64_t p0 = (uint64_t) PHILOX_M0 * c0;
+	uint64_t p1 = (uint64_t) PHILOX_M1 * c2;
+	uint32_t n0 = (uint32_t) (p1 >> 32) ^ c1 ^ k0;
+	uint32_t n2 = (uint32_t) (p0 >> 32) ^ c3 ^ k1;
+	c1 = (uint32_t) p1;
+	c3 = (uint32_t) p0;
+	c0 = n0;
+	c2 = n2;
+	k0 += PHILOX_W0;
+	k1 += PHILOX_W1;
+  }
+  out[0] = c0;
+  out[1] = c1;
+  out[2] = c2;
+  out[3] = c3;
+}
+
+static void fill( philox_state *s ){
+  uint32_t ctr[4] = { (uint32_t) s->block, (uint32_t) (s->block >> 32), 0, 0 };
+  philox4x32_10( ctr, s->key, s->out );
+  s->used = 0;
+}
+
+static void philox_set( void *vstate, unsigned long int seed ){
+  philox_state *s = (philox_state *) vstate;
+  s->key[0] = (uint32_t) seed;
+  s->key[1] = (uint32_t) ( (uint64_t) seed >> 32 );
+  s->block = 0;
+  fill( s );
+}
+
+static unsigned long int philox_get( void *vstate ){
+  philox_state *s = (philox_state *) vstate;
+  if ( s->used == 4 ){
+	s->block++;
+	fill( s );
+  }
+  return s->out[ s->used++ ];
+}
+
+static double philox_get_double( void *vstate ){
+  return philox_get( vstate ) / 4294967296.0;
+}
+
+void philox_seek(
+				 const gsl_rng *r          // generator of type rng_philox4x32
+				 ,uint64_t position        // position of the next number drawn, 0 being the first one after gsl_rng_set()
+				 ){
+  philox_state *s = (philox_state *) r->state;
+  s->block = position / 4;
+  fill( s );
+  s->used = (int) ( position % 4 );
+}
+
+uint64_t philox_tell(
+					 const gsl_rng *r          // generator of type rng_philox4x32
+					 ){
+  philox_state *s = (philox_state *) r->state;
+  return s->block * 4 + s->used;
+}
+
+static const gsl_rng_type philox_type =
+  {
+	"philox4x32",            // name
+	0xffffffffUL,            // RAND_MAX
+	0,                       // RAND_MIN
+	sizeof(philox_state),
+	&philox_set,
+	&philox_get,
+	&philox_get_double
+  };
+
+const gsl_rng_type *rng_philox4x32 = &philox_type;
@@ -0,0 +1,37 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Philox4x32-10 counter-based generator (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3", SC11)
+//
+//  The n-th number of a stream is a pure function of (seed, n): block n / 4 of the counter is run through ten rounds
+//  of multiplications keyed by the seed, and number n is word n % 4 of the result. Jumping to any position is
+//  therefore O(1), so one logical stream can be split across threads or machines (each one seeking to the start of
+//  its shard) and still hold exactly the numbers of a serial run.
+//
+//  The generator is a gsl_rng_type, so it plugs into gsl_rng_alloc(), gsl_rng_uniform(), gsl_ran_*() and friends:
+//
+//    gsl_rng *r = gsl_rng_alloc( rng_philox4x32 );
+//    gsl_rng_set( r, seed );
+//    philox_seek( r, position );   // next number drawn is number ~position~ of the stream
+//
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <stdint.h>      // uint32_t, uint64_t
+#include <gsl/gsl_rng.h>
+
+extern const gsl_rng_type *rng_philox4x32;
+
+// the block function itself: four 32-bit numbers from a 128-bit counter and a 64-bit key
+void philox4x32_10(
+				   const uint32_t ctr[4]     // counter
+				   ,const uint32_t key[2]    // key (the seed)
+				   ,uint32_t out[4]          // numbers of the block
+				   );
+void philox_seek(
+				 const gsl_rng *r          // generator of type rng_philox4x32
+				 ,uint64_t position        // position of the next number drawn, 0 being the first one after gsl_rng_set()
+				 );
+uint64_t philox_tell(
+					 const gsl_rng *r          // generator of type rng_philox4x32
+					 );
+
+#endif
@@ -0,0 +1,158 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Low-discrepancy sequences: Sobol and Halton (see qmc.h)
+//
+#include "qmc.h"
+
+// primitive polynomials (degree s, coefficients a) and initial direction numbers m of dimensions 2 .. QMC_MAX_DIMS,
+// from Joe & Kuo's new-joe-kuo-6.21201 (dimension 1 is the van der Corput sequence in base 2)
+static const struct { int s; int a; uint32_t m[6]; } JOE_KUO[QMC_MAX_DIMS - 1] =
+  {
+	{ 1,  0, { 1 } },
+	{ 2,  1, { 1, 3 } },
+	{ 3,  1, { 1, 3, 1 } },
+	{ 3,  2, { 1, 1, 1 } },
+	{ 4,  1, { 1, 1, 3, 3 } },
+	{ 4,  4, { 1, 3, 5, 13 } },
+	{ 5,  2, { 1, 1, 5, 5, 17 } },
+	{ 5,  4, { 1, 1, 5, 5, 5 } },
+	{ 5,  7, { 1, 1, 7, 11, 19 } },
+	{ 5, 11, { 1, 1, 5, 1, 1 } },
+	{ 5, 13, { 1, 1, 1, 3, 11 } },
+	{ 5, 14, { 1, 3, 5, 5, 31 } },
+	{ 6,  1, { 1, 3, 3, 9, 7, 49 } },
+	{ 6, 13, { 1, 1, 1, 15, 21, 21 } },
+	{ 6, 16, { 1, 3, 1, 13, 27, 49 } }
+  };
+
+static const int PRIME[QMC_MAX_DIMS] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53 };
+
+// splitmix64: seeds of the dimensions from the seed of the sequence
+static uint64_t splitmix64( uint64_t *state ){
+  uint64_t z = ( *state += 0x9E3779B97F4A7C15ull );
+  z = ( z ^ (z >> 30) ) * 0xBF58476D1CE4E5B9ull;
+  z = ( z ^ (z >> 27) ) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+static uint32_t reverse_bits( uint32_t x ){
+  x = ( (x >> 1) & 0x55555555u ) | ( (x & 0x55555555u) << 1 );
+  x = ( (x >> 2) & 0x33333333u ) | ( (x & 0x33333333u) << 2 );
+  x = ( (x >> 4) & 0x0F0F0F0Fu ) | ( (x & 0x0F0F0F0Fu) << 4 );
+  x = ( (x >> 8) & 0x00FF00FFu ) | ( (x & 0x00FF00FFu) << 8 );
+  return ( x >> 16 ) | ( x << 16 );
+}
+
+// Owen scrambling of a 32-bit fraction: the Laine-Karras hash flips each bit depending only on the bits above it
+static uint32_t owen_scramble( uint32_t x, uint32_t key ){
+  x = reverse_bits( x );
+  x += key;
+  x ^= x * 0x6c50b47cu;
+  x ^= x * 0xb82f1e52u;
+  x ^= x * 0xc7afe638u;
+  x ^= x * 0x8d22f6e6u;
+  return reverse_bits( x );
+}
+
+static double radical_inverse( uint64_t i, int base ){
+  double inv = 1.0 / base, f = inv, u = 0;
+  while ( i > 0 ) {
+	u += f * (double) ( i % base );
+	i /= base;
+	f *= inv;
+  }
+  return u;
+}
+
+bool qmc_init(
+			  qmc_str *q               // sequence to be initialized at point 0
+			  ,qmc_kind kind           // Sobol or Halton
+			  ,int dims                // coordinates of each point (1 .. QMC_MAX_DIMS)
+			  ,bool scramble           // randomize the sequence
+			  ,unsigned long seed      // seed of the scrambling
+			  ){
+  if ( dims < 1 || dims > QMC_MAX_DIMS ) return false;
+  q->kind = kind;
+  q->dims = dims;
+  q->scramble = scramble;
+
+  // direction numbers v[d][k] = m_k / 2^(k+1) as 32-bit fractions, extended by the recurrence of the polynomial
+  for (int k = 0; k < 32; k++) q->v[0][k] = 1u << (31 - k);
+  for (int d = 1; d < dims; d++) {
+	int s = JOE_KUO[d-1].s, a = JOE_KUO[d-1].a;
+	for (int k = 0; k < 32; k++) {
+	  if ( k < s ){
+		q->v[d][k] = JOE_KUO[d-1].m[k] << (31 - k);
+	  } else {
+		uint32_t v = q->v[d][k-s] ^ ( q->v[d][k-s] >> s );
+		for (int j = 1; j < s; j++) {
+		  if ( (a >> (s - 1 - j)) & 1 ) v ^= q->v[d][k-j];
+		}
+		q->v[d][k] = v;
+	  }
+	}
+  }
+
+  uint64_t state = seed;
+  for (int d = 0; d < dims; d++) {
+	uint64_t h = splitmix64( &state );
+	q->key[d] = (uint32_t) h;
+	q->shift[d] = ( h >> 11 ) * ( 1.0 / 9007199254740992.0 );
+  }
+  qmc_seek( q, 0 );
+  return true;
+}
+
+void qmc_seek(
+			  qmc_str *q               // sequence
+			  ,uint64_t index          // index of the next point
+			  ){
+  q->index = index;
+  q->next = q->dims;
+  if ( q->kind == QMC_SOBOL ){
+	uint64_t gray = index ^ (index >> 1);
+	for (int d = 0; d < q->dims; d++) {
+	  uint32_t x = 0;
+	  for (int k = 0; k < 32 && (gray >> k) != 0; k++) {
+		if ( (gray >> k) & 1 ) x ^= q->v[d][k];
+	  }
+	  q->x[d] = x;
+	}
+  }
+}
+
+void qmc_next(
+			  qmc_str *q               // sequence
+			  ,double *u               // ~dims~ coordinates of the next point, in [0,1)
+			  ){
+  if ( q->kind == QMC_SOBOL ){
+	for (int d = 0; d < q->dims; d++) {
+	  uint32_t x = q->scramble ? owen_scramble( q->x[d], q->key[d] ) : q->x[d];
+	  u[d] = x * ( 1.0 / 4294967296.0 );
+	}
+	// Gray code order: the next point flips the direction number of the lowest zero bit of the index
+	int k = __builtin_ctzll( ~q->index );
+	if ( k < 32 ){
+	  for (int d = 0; d < q->dims; d++) q->x[d] ^= q->v[d][k];
+	}
+  } else {
+	for (int d = 0; d < q->dims; d++) {
+	  double x = radical_inverse( q->index, PRIME[d] );
+	  if ( q->scramble ){
+		x += q->shift[d];
+		if ( x >= 1 ) x -= 1;
+	  }
+	  u[d] = x;
+	}
+  }
+  q->index++;
+}
+
+double qmc_uniform(
+				   qmc_str *q               // sequence, handed out one coordinate at a time (points in a row)
+				   ){
+  if ( q->next == q->dims ){
+	qmc_next( q, q->point );
+	q->next = 0;
+  }
+  return q->point[ q->next++ ];
+}
@@ -0,0 +1,59 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Low-discrepancy (quasi Monte Carlo) sequences: Sobol and Halton
+//
+//  A sequence fills the unit cube [0,1)^dims far more evenly than pseudo-random points, so integrals over it (e.g.
+//  over the decrement tables) converge close to 1/N instead of 1/sqrt(N). Point i is a function of i alone:
+//
+//    Sobol   coordinate d is the XOR of the direction numbers of dimension d picked by the bits of the Gray code of
+//            i (Joe & Kuo, new-joe-kuo-6.21201, first QMC_MAX_DIMS dimensions)
+//    Halton  coordinate d is the radical inverse of i in the d-th prime base
+//
+//  so qmc_seek() jumps to any point at once (at most 32 steps, one per bit of i) and the points can be split across
+//  threads, each one seeking to the start of its share. Scrambling randomizes a sequence while keeping its
+//  uniformity: Sobol points get a hash-based Owen (nested uniform) scrambling (Burley, "Practical hash-based Owen
+//  scrambling", JCGT 2020), Halton points a random shift modulo 1 (Cranley-Patterson rotation), both keyed by a seed.
+//
+#ifndef QMC_H
+#define QMC_H
+
+#include <stdint.h>      // uint32_t, uint64_t
+#include <stdbool.h>     // bool (data type)
+
+#define QMC_MAX_DIMS 16
+
+typedef enum qmc_kind { QMC_SOBOL, QMC_HALTON } qmc_kind;
+
+typedef struct qmc_str
+{
+  qmc_kind kind;
+  int dims;                          // coordinates of each point
+  bool scramble;
+  uint64_t index;                    // index of the next point
+  uint32_t v[QMC_MAX_DIMS][32];      // Sobol: direction numbers of each dimension
+  uint32_t x[QMC_MAX_DIMS];          // Sobol: coordinates of point ~index~ as 32-bit fractions (not scrambled)
+  uint32_t key[QMC_MAX_DIMS];        // Sobol: Owen scrambling seed of each dimension
+  double shift[QMC_MAX_DIMS];        // Halton: random shift of each dimension
+  double point[QMC_MAX_DIMS];        // qmc_uniform(): point being handed out coordinate by coordinate
+  int next;                          // qmc_uniform(): next coordinate of ~point~ (dims when none left)
+} qmc_str;
+
+bool qmc_init(
+			  qmc_str *q               // sequence to be initialized at point 0
+			  ,qmc_kind kind           // Sobol or Halton
+			  ,int dims                // coordinates of each point (1 .. QMC_MAX_DIMS)
+			  ,bool scramble           // randomize the sequence
+			  ,unsigned long seed      // seed of the scrambling
+			  );
+void qmc_seek(
+			  qmc_str *q               // sequence
+			  ,uint64_t index          // index of the next point
+			  );
+void qmc_next(
+			  qmc_str *q               // sequence
+			  ,double *u               // ~dims~ coordinates of the next point, in [0,1)
+			  );
+double qmc_uniform(
+				   qmc_str *q               // sequence, handed out one coordinate at a time (points in a row)
+				   );
+
+#endif
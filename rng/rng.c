@@ -1,48 +1,534 @@
 #include <stdio.h>
+#include <stdlib.h>      // strtol, malloc, free, exit
+#include <string.h>      // strcmp
+#include <stdbool.h>     // bool (data type)
+#include <stdint.h>      // uint32_t
+#include <math.h>        // log2, sin, fabs, M_PI
+#include <time.h>        // clock_gettime()
+#include <getopt.h>      // command line arguments: getopt_long()
+#include <pthread.h>     // one writer thread per output file
+#include <fcntl.h>       // open
+#include <unistd.h>      // write, close, ftruncate
+#include <sys/mman.h>    // mmap, munmap
 #include <gsl/gsl_rng.h>
 
+#include "philox.h"
+#include "qmc.h"
+
 /* https://www.gnu.org/software/gsl/doc/html/rng.html */
 
-/*   run as 
-	 ./a.out 10000 rnd_u.csv
+/*   run as
+	 ./rng 10000 rnd_u.csv
+
+	 text file with a header "u" and one uniform per line (%.6f), as ever; bulk modes write raw binary numbers instead,
+	 filling buffers of BUFFER_SIZE numbers at a time:
+
+	 ./rng --format=f64 1000000000 rnd_u.bin                 raw doubles in [0,1), native byte order
+	 ./rng --format=u32 1000000000 rnd_u.bin                 raw gsl_rng_get() as uint32 (bits above gsl_rng_max are 0)
+	 ./rng --format=f64 --mmap 1000000000 rnd_u.bin          maps the output file and fills it in place
+	 ./rng --format=f64 --threads=8 1000000000 rnd_u.bin     one file per thread, rnd_u.bin.0 .. rnd_u.bin.7
+
+	 thread K (or the single stream) is seeded with GSL_RNG_SEED + K, and the generator is picked with GSL_RNG_TYPE
+	 (see gsl_rng_env_setup) or --type=NAME. Numbers per second of every GSL generator type (and philox4x32):
+
+	 ./rng --bench 100000000
+
+	 --type=philox4x32 is the counter-based generator of philox.h: the threads share a single stream seeded with
+	 GSL_RNG_SEED, thread K seeking straight to the start of its share, so cat rnd_u.bin.* holds the very numbers of
+	 a serial run whatever the amount of threads. Check it on a long stream, without writing it, with
+
+	 ./rng --type=philox4x32 --check-shards=64 10000000000
+
+	 low-discrepancy sequences of qmc.h instead of a generator, in the same formats, N being the amount of points
+	 (of --dims numbers each, written one after the other); threads seek to the start of their share of the points,
+	 so cat rnd_u.csv.* again holds the numbers of a serial run (the text header aside):
+
+	 ./rng --sequence=sobol --dims=4 --scramble 1048576 rnd_u.csv
+	 ./rng --sequence=halton --dims=4 --format=f64 --threads=8 1048576 rnd_u.bin
+
+	 and the error of each one against pseudo-random points (--type or GSL_RNG_TYPE) integrating a smooth function
+	 over [0,1)^dims, at every power of 2 up to N points:
+
+	 ./rng --convergence --dims=4 1048576
 */
 
-gsl_rng * r;  /* global generator */
+// numbers generated at a time before being written
+#define BUFFER_SIZE (1 << 20)
+
+typedef enum rng_format { FORMAT_TEXT, FORMAT_F64, FORMAT_U32 } rng_format;
+
+// stream of numbers written by a thread
+typedef struct stream_str
+{
+  const gsl_rng_type *T;  // generator type
+  unsigned long seed;
+  long n;                 // amount of numbers
+  rng_format format;
+  bool map;               // mmap the output file instead of write()
+  char *fname;            // output file
+  uint64_t skip;          // philox4x32 and sequences: position of the first number of the thread in the shared stream
+  int sequence;           // -1 for the generator, or the qmc_kind of a low-discrepancy sequence
+  int dims;               // sequences: numbers of each point
+  bool scramble;          // sequences: randomized with the seed
+  uint64_t sum;           // --check-shards: sum of the numbers, and of the numbers weighted by their positions + 1
+  uint64_t wsum;
+} stream_str;
+
+void *write_stream(
+				   void *arg           // pointer to the ~stream_str~ of the thread
+				   );
+void *sum_stream(
+				 void *arg           // pointer to the ~stream_str~ of the thread
+				 );
+void bench(
+		   long n              // amount of numbers drawn from each generator type
+		   );
+void convergence(
+				 const gsl_rng_type *T  // generator of the pseudo-random points
+				 ,long n                // largest amount of points
+				 ,int dims              // dimension of the integral
+				 );
+void bench_type(
+				const gsl_rng_type *T  // generator type
+				,long n                // amount of numbers drawn
+				,double *u             // buffer of BUFFER_SIZE doubles
+				,uint32_t *v           // buffer of BUFFER_SIZE uint32s
+				);
+double now(void);
+
 
 int main(int argc, char **argv) {
-  const gsl_rng_type * T;
-  gsl_rng * r;
+  rng_format format = FORMAT_TEXT;
+  bool map = false;
+  bool do_bench = false;
+  int n_threads = 1;
+  int n_shards = 0;
+  int sequence = -1;
+  int dims = 1;
+  bool scramble = false;
+  bool do_convergence = false;
+  char *type = NULL;
+  bool ok = true;
 
-  if( argc > 1) {
+  int c;
+  while (1)
+	{
+	  int option_index = 0;
+	  static struct option long_options[] =
+		{
+		  {"format",  required_argument, NULL, 'f' },
+		  {"threads", required_argument, NULL, 'j' },
+		  {"type",    required_argument, NULL, 't' },
+		  {"mmap",    no_argument,       NULL, 'm' },
+		  {"bench",   no_argument,       NULL, 'B' },
+		  {"check-shards", required_argument, NULL, 'c' },
+		  {"sequence", required_argument, NULL, 'Q' },
+		  {"dims",     required_argument, NULL, 'd' },
+		  {"scramble", no_argument,       NULL, 'x' },
+		  {"convergence", no_argument,    NULL, 'C' },
+		  {NULL,      0,                 NULL,  0 }
+		};
 
-	FILE *fp; /* file container for random numbers */
-	double i, n = atoi( argv[1] );
-	char *fname = argv[2]; 
+	  c = getopt_long(argc, argv, ":f:j:t:mBc:Q:d:xC", long_options, &option_index);
+	  if (c == -1)
+		break;
 
-	fp = fopen(fname,"w");
-	if( fp == NULL) {
-	  printf("file can't be opened\n");
-	  exit(1);
+	  switch (c)
+		{
+		case 'f':
+		  if ( strcmp( optarg, "text" ) == 0 ) format = FORMAT_TEXT;
+		  else if ( strcmp( optarg, "f64" ) == 0 ) format = FORMAT_F64;
+		  else if ( strcmp( optarg, "u32" ) == 0 ) format = FORMAT_U32;
+		  else {
+			fprintf( stderr, "Format must be text, f64 or u32.\n");
+			ok = false;
+		  }
+		  break;
+		case 'j': n_threads = atoi(optarg); break;
+		case 't': type = optarg; break;
+		case 'm': map = true; break;
+		case 'B': do_bench = true; break;
+		case 'c': n_shards = atoi(optarg); break;
+		case 'd': dims = atoi(optarg); break;
+		case 'x': scramble = true; break;
+		case 'C': do_convergence = true; break;
+		case 'Q':
+		  if ( strcmp( optarg, "sobol" ) == 0 ) sequence = QMC_SOBOL;
+		  else if ( strcmp( optarg, "halton" ) == 0 ) sequence = QMC_HALTON;
+		  else {
+			fprintf( stderr, "Sequence must be sobol or halton.\n");
+			ok = false;
+		  }
+		  break;
+		case '?':
+		  fprintf( stderr, "Unknown option %c\n", optopt);
+		  ok = false;
+		  break;
+		case ':':
+		  fprintf( stderr, "Missing option for %c\n", optopt);
+		  ok = false;
+		  break;
+		}
 	}
 
-	fprintf( fp, "u\n");
-	
-	gsl_rng_env_setup();
+  // amount of numbers, as a whole count (a double counter loses units past 2^53, and atoi() overflows past 2^31)
+  long n = 0;
+  if ( optind < argc ){
+	char *end;
+	n = strtol( argv[optind], &end, 10 );
+	if ( *end != '\0' || n < 0 ){
+	  fprintf( stderr, "Amount of numbers must be a non-negative integer.\n");
+	  ok = false;
+	}
+  }
+  char *fname = ( optind + 1 < argc ) ? argv[optind + 1] : NULL;
+  if ( n_threads < 1 ) ok = false;
+  if ( dims < 1 || dims > QMC_MAX_DIMS ){
+	fprintf( stderr, "Dimensions must be between 1 and %d.\n", QMC_MAX_DIMS);
+	ok = false;
+  }
+  if ( map && format == FORMAT_TEXT ){
+	fprintf( stderr, "--mmap needs a binary format (f64 or u32).\n");
+	ok = false;
+  }
+  if ( ok == false ){
+	fprintf( stderr, "Inconsistent parameters. Exiting...\n");
+	exit( EXIT_FAILURE );
+  }
+
+  gsl_rng_env_setup();
 
-	T = gsl_rng_default;
-	r = gsl_rng_alloc (T);
+  if ( do_bench ){
+	bench( n > 0 ? n : 10000000 );
+	return EXIT_SUCCESS;
+  }
 
-	for (i = 0; i < n; i++)
+  const gsl_rng_type *T = gsl_rng_default;
+  if ( type != NULL ){
+	T = NULL;
+	if ( strcmp( rng_philox4x32->name, type ) == 0 ) T = rng_philox4x32;
+	for (const gsl_rng_type **t = gsl_rng_types_setup(); *t != NULL; t++) {
+	  if ( strcmp( (*t)->name, type ) == 0 ) T = *t;
+	}
+	if ( T == NULL ){
+	  fprintf( stderr, "Unknown generator type '%s' (see ./rng --bench for the available ones).\n", type );
+	  exit( EXIT_FAILURE );
+	}
+  }
+
+  if ( do_convergence ){
+	convergence( T, n > 0 ? n : 1048576, dims );
+	return EXIT_SUCCESS;
+  }
+
+  if ( n_shards > 0 ){
+	// the stream drawn serially and split in shards, each one seeking to its start, must hold the same numbers
+	if ( T != rng_philox4x32 ){
+	  fprintf( stderr, "--check-shards needs --type=philox4x32.\n");
+	  exit( EXIT_FAILURE );
+	}
+	stream_str serial = { .T = T, .seed = gsl_rng_default_seed, .n = n, .skip = 0, .sequence = -1 };
+	double t0 = now();
+	sum_stream( &serial );
+	double t1 = now();
+
+	pthread_t thread[n_shards];
+	stream_str shard[n_shards];
+	uint64_t sum = 0, wsum = 0;
+	for (int k = 0; k < n_shards; k++) {
+	  shard[k] = serial;
+	  shard[k].skip = n * k / n_shards;
+	  shard[k].n = n * (k + 1) / n_shards - n * k / n_shards;
+	  pthread_create( &thread[k], NULL, sum_stream, &shard[k] );
+	}
+	for (int k = 0; k < n_shards; k++) {
+	  pthread_join( thread[k], NULL );
+	  sum += shard[k].sum;
+	  wsum += shard[k].wsum;
+	}
+	double t2 = now();
+
+	bool same = ( sum == serial.sum && wsum == serial.wsum );
+	printf( "numbers;shards;serial_seconds;sharded_seconds;serial_checksum;sharded_checksum;identical\n" );
+	printf( "%ld;%d;%.3f;%.3f;%016lx%016lx;%016lx%016lx;%s\n", n, n_shards, t1 - t0, t2 - t1,
+			(unsigned long) serial.sum, (unsigned long) serial.wsum, (unsigned long) sum, (unsigned long) wsum,
+			same ? "yes" : "no" );
+	return same ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  if( fname != NULL ) {
+	// a single stream writes ~fname~ itself, threads write fname.0, fname.1, ...
+	pthread_t thread[n_threads];
+	stream_str stream[n_threads];
+	for (int k = 0; k < n_threads; k++) {
+	  stream[k].T = T;
+	  stream[k].sequence = sequence;
+	  stream[k].dims = dims;
+	  stream[k].scramble = scramble;
+	  if ( sequence >= 0 ){
+		// shares of whole points
+		stream[k].seed = gsl_rng_default_seed;
+		stream[k].skip = n * k / n_threads * dims;
+		stream[k].n = ( n * (k + 1) / n_threads - n * k / n_threads ) * dims;
+	  } else if ( T == rng_philox4x32 ){
+		stream[k].seed = gsl_rng_default_seed;
+		stream[k].skip = n * k / n_threads;
+		stream[k].n = n * (k + 1) / n_threads - n * k / n_threads;
+	  } else {
+		stream[k].seed = gsl_rng_default_seed + k;
+		stream[k].skip = 0;
+		stream[k].n = n * (k + 1) / n_threads - n * k / n_threads;
+	  }
+	  stream[k].format = format;
+	  stream[k].map = map;
+	  if ( n_threads == 1 ){
+		stream[k].fname = fname;
+	  } else {
+		size_t len = strlen( fname ) + 16;
+		stream[k].fname = (char *) malloc( len );
+		if ( stream[k].fname == NULL ){
+		  fprintf( stderr, "Could not allocate memory for ~fname~ pointer from within ~main()~ function. Aborting...\n");
+		  exit( EXIT_FAILURE );
+		}
+		snprintf( stream[k].fname, len, "%s.%d", fname, k );
+	  }
+	  pthread_create( &thread[k], NULL, write_stream, &stream[k] );
+	}
+	for (int k = 0; k < n_threads; k++) {
+	  pthread_join( thread[k], NULL );
+	  if ( n_threads > 1 ) free( stream[k].fname );
+	}
+  }
+
+  return EXIT_SUCCESS;
+}
+
+// next number of a stream, from its generator ~r~ or its sequence ~q~
+static inline double next_uniform( gsl_rng *r, qmc_str *q ){
+  return ( q != NULL ) ? qmc_uniform( q ) : gsl_rng_uniform( r );
+}
+
+static inline uint32_t next_u32( gsl_rng *r, qmc_str *q ){
+  return ( q != NULL ) ? (uint32_t) ( qmc_uniform( q ) * 4294967296.0 ) : (uint32_t) gsl_rng_get( r );
+}
+
+void *write_stream(
+				   void *arg           // pointer to the ~stream_str~ of the thread
+				   ){
+  stream_str *s = (stream_str *) arg;
+  gsl_rng *r = NULL;
+  qmc_str *q = NULL;
+  if ( s->sequence >= 0 ){
+	q = (qmc_str *) malloc( sizeof(qmc_str) );
+	if ( q == NULL ){
+	  fprintf( stderr, "Could not allocate memory for ~q~ pointer from within ~write_stream()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+	qmc_init( q, (qmc_kind) s->sequence, s->dims, s->scramble, s->seed );
+	qmc_seek( q, s->skip / s->dims );
+  } else {
+	r = gsl_rng_alloc( s->T );
+	gsl_rng_set( r, s->seed );
+	if ( s->skip > 0 ) philox_seek( r, s->skip );
+  }
+
+  if ( s->format == FORMAT_TEXT ){
+	FILE *fp; /* file container for random numbers */
+	fp = fopen( s->fname, "w" );
+	if( fp == NULL) {
+	  fprintf( stderr, "file %s can't be opened\n", s->fname );
+	  exit(1);
+	}
+	setvbuf( fp, NULL, _IOFBF, BUFFER_SIZE );
+	fprintf( fp, "u\n");
+	for (long i = 0; i < s->n; i++)
 	  {
-		double u = gsl_rng_uniform (r);
-		/* printf ("%.5f\t%s\n", u, fname); */
+		double u = next_uniform( r, q );
 		fprintf( fp, "%.6f\n", u);
 	  }
-
 	fclose(fp);
-	
-	gsl_rng_free (r);
+	if ( r != NULL ) gsl_rng_free (r);
+	free( q );
+	return NULL;
   }
 
-  return EXIT_SUCCESS;
+  // binary formats: whole buffers of numbers, written at once or straight into the mapped file
+  size_t size = ( s->format == FORMAT_F64 ) ? sizeof(double) : sizeof(uint32_t);
+  int fd = open( s->fname, O_RDWR | O_CREAT | O_TRUNC, 0666 );
+  if ( fd < 0 ){
+	fprintf( stderr, "file %s can't be opened\n", s->fname );
+	exit(1);
+  }
+  char *out = NULL;
+  if ( s->map && s->n > 0 ){
+	if ( ftruncate( fd, s->n * size ) != 0 ){
+	  fprintf( stderr, "file %s can't be sized to %ld bytes\n", s->fname, s->n * size );
+	  exit(1);
+	}
+	out = mmap( NULL, s->n * size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	if ( out == MAP_FAILED ){
+	  fprintf( stderr, "file %s can't be mapped\n", s->fname );
+	  exit(1);
+	}
+  }
+  char *buf = out;
+  if ( out == NULL ){
+	buf = (char *) malloc( BUFFER_SIZE * size );
+	if ( buf == NULL ){
+	  fprintf( stderr, "Could not allocate memory for ~buf~ pointer from within ~write_stream()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+  }
+
+  for (long done = 0; done < s->n; done += BUFFER_SIZE) {
+	long m = ( s->n - done < BUFFER_SIZE ) ? s->n - done : BUFFER_SIZE;
+	char *p = ( out != NULL ) ? out + done * size : buf;
+	if ( s->format == FORMAT_F64 ){
+	  double *u = (double *) p;
+	  for (long i = 0; i < m; i++) u[i] = next_uniform( r, q );
+	} else {
+	  uint32_t *u = (uint32_t *) p;
+	  for (long i = 0; i < m; i++) u[i] = next_u32( r, q );
+	}
+	if ( out == NULL ){
+	  size_t left = m * size;
+	  while ( left > 0 ) {
+		ssize_t w = write( fd, p, left );
+		if ( w < 0 ){
+		  fprintf( stderr, "file %s can't be written\n", s->fname );
+		  exit(1);
+		}
+		p += w;
+		left -= w;
+	  }
+	}
+  }
+
+  if ( out != NULL ) munmap( out, s->n * size );
+  else free( buf );
+  close( fd );
+  if ( r != NULL ) gsl_rng_free (r);
+  free( q );
+  return NULL;
+}
+
+void *sum_stream(
+				 void *arg           // pointer to the ~stream_str~ of the thread
+				 ){
+  stream_str *s = (stream_str *) arg;
+  gsl_rng *r = gsl_rng_alloc( s->T );
+  gsl_rng_set( r, s->seed );
+  if ( s->skip > 0 ) philox_seek( r, s->skip );
+
+  uint64_t sum = 0, wsum = 0;
+  uint64_t position = s->skip;
+  for (long i = 0; i < s->n; i++) {
+	uint64_t x = gsl_rng_get( r );
+	sum += x;
+	wsum += x * ++position;
+  }
+  s->sum = sum;
+  s->wsum = wsum;
+  gsl_rng_free( r );
+  return NULL;
+}
+
+void bench(
+		   long n              // amount of numbers drawn from each generator type
+		   ){
+  // numbers per second of gsl_rng_uniform() and gsl_rng_get(), filling buffers as the bulk modes do: the default
+  // generator first, then philox4x32, then every GSL generator type
+  double *u = (double *) malloc( BUFFER_SIZE * sizeof(double) );
+  uint32_t *v = (uint32_t *) malloc( BUFFER_SIZE * sizeof(uint32_t) );
+  if ( u == NULL || v == NULL ){
+	fprintf( stderr, "Could not allocate memory for ~u~ and ~v~ pointers from within ~bench()~ function. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+
+  printf( "generator;bits;uniform_per_sec;get_per_sec\n" );
+  bench_type( gsl_rng_default, n, u, v );
+  bench_type( rng_philox4x32, n, u, v );
+  for (const gsl_rng_type **t = gsl_rng_types_setup(); *t != NULL; t++) {
+	if ( *t != gsl_rng_default ) bench_type( *t, n, u, v );
+  }
+  free( u );
+  free( v );
+}
+
+void bench_type(
+				const gsl_rng_type *T  // generator type
+				,long n                // amount of numbers drawn
+				,double *u             // buffer of BUFFER_SIZE doubles
+				,uint32_t *v           // buffer of BUFFER_SIZE uint32s
+				){
+  gsl_rng *r = gsl_rng_alloc( T );
+  volatile double sink = 0; // keeps the draws from being optimized away
+
+  double t0 = now();
+  for (long done = 0; done < n; done += BUFFER_SIZE) {
+	long m = ( n - done < BUFFER_SIZE ) ? n - done : BUFFER_SIZE;
+	for (long i = 0; i < m; i++) u[i] = gsl_rng_uniform( r );
+	sink += u[m-1];
+  }
+  double t1 = now();
+  for (long done = 0; done < n; done += BUFFER_SIZE) {
+	long m = ( n - done < BUFFER_SIZE ) ? n - done : BUFFER_SIZE;
+	for (long i = 0; i < m; i++) v[i] = (uint32_t) gsl_rng_get( r );
+	sink += v[m-1];
+  }
+  double t2 = now();
+
+  printf( "%s;%.1f;%.0f;%.0f\n", gsl_rng_name( r ), log2( (double) gsl_rng_max( r ) - gsl_rng_min( r ) + 1 ),
+		  n / (t1 - t0), n / (t2 - t1) );
+  fflush( stdout );
+  gsl_rng_free( r );
+}
+
+void convergence(
+				 const gsl_rng_type *T  // generator of the pseudo-random points
+				 ,long n                // largest amount of points
+				 ,int dims              // dimension of the integral
+				 ){
+  // integral of f(u) = prod_d (pi/2) sin(pi u_d) over [0,1)^dims, which is exactly 1: absolute error of the estimate
+  // from the first N points of each source, N = 16, 32, ... up to n
+  enum { PSEUDO, SOBOL, SOBOL_SCRAMBLED, HALTON, HALTON_SCRAMBLED, N_SOURCE };
+  gsl_rng *r = gsl_rng_alloc( T );
+  qmc_str *q = (qmc_str *) malloc( (N_SOURCE - 1) * sizeof(qmc_str) );
+  if ( q == NULL ){
+	fprintf( stderr, "Could not allocate memory for ~q~ pointer from within ~convergence()~ function. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+  qmc_init( &q[0], QMC_SOBOL,  dims, false, gsl_rng_default_seed );
+  qmc_init( &q[1], QMC_SOBOL,  dims, true,  gsl_rng_default_seed );
+  qmc_init( &q[2], QMC_HALTON, dims, false, gsl_rng_default_seed );
+  qmc_init( &q[3], QMC_HALTON, dims, true,  gsl_rng_default_seed );
+
+  double sum[N_SOURCE] = { 0 };
+  double u[QMC_MAX_DIMS];
+  printf( "points;%s;sobol;sobol_scrambled;halton;halton_scrambled\n", gsl_rng_name( r ) );
+  for (long i = 1; i <= n; i++) {
+	for (int k = 0; k < N_SOURCE; k++) {
+	  if ( k == PSEUDO ){
+		for (int d = 0; d < dims; d++) u[d] = gsl_rng_uniform( r );
+	  } else {
+		qmc_next( &q[k-1], u );
+	  }
+	  double f = 1;
+	  for (int d = 0; d < dims; d++) f *= M_PI / 2 * sin( M_PI * u[d] );
+	  sum[k] += f;
+	}
+	if ( i >= 16 && ( i & (i - 1) ) == 0 ){
+	  printf( "%ld", i );
+	  for (int k = 0; k < N_SOURCE; k++) printf( ";%.3e", fabs( sum[k] / i - 1 ) );
+	  printf( "\n" );
+	}
+  }
+  free( q );
+  gsl_rng_free( r );
+}
+
+double now(void){
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
 }
@@ -0,0 +1,180 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Two-stage splitter of delimited records (see split.h)
+//
+//  Stage 1 turns each block of 64 bytes into a mask with one bit per byte matching the delimiter or the end of record,
+//  then writes the offsets of the set bits, lowest first (count trailing zeros, clear the lowest bit). The last, partial
+//  block is copied into a zeroed block of 64 bytes and the bits past the end of the buffer are cleared.
+//
+#include <stdio.h>       // fprintf
+#include <stdlib.h>      // realloc, free, exit
+#include <string.h>      // memcpy, memset
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>   // SSE2 and AVX2 intrinsics
+#define SPLIT_X86
+#endif
+
+#include "split.h"
+
+// mask of the bytes of a block of 64 matching ~delim~ or ~eol~, one byte at a time
+static uint64_t mask_scalar( const char *b, char delim, char eol ){
+  uint64_t m = 0;
+  for (int i = 0; i < 64; i++) {
+	m |= (uint64_t) ( b[i] == delim || b[i] == eol ) << i;
+  }
+  return m;
+}
+
+#ifdef SPLIT_X86
+// 16 bytes at a time (SSE2 is part of every x86-64 CPU)
+__attribute__((target("sse2")))
+static uint64_t mask_sse2( const char *b, char delim, char eol ){
+  __m128i d = _mm_set1_epi8( delim );
+  __m128i e = _mm_set1_epi8( eol );
+  uint64_t m = 0;
+  for (int i = 0; i < 4; i++) {
+	__m128i x = _mm_loadu_si128( (const __m128i *) (b + 16 * i) );
+	__m128i hit = _mm_or_si128( _mm_cmpeq_epi8( x, d ), _mm_cmpeq_epi8( x, e ) );
+	m |= (uint64_t) (uint16_t) _mm_movemask_epi8( hit ) << (16 * i);
+  }
+  return m;
+}
+
+// 32 bytes at a time
+__attribute__((target("avx2")))
+static uint64_t mask_avx2( const char *b, char delim, char eol ){
+  __m256i d = _mm256_set1_epi8( delim );
+  __m256i e = _mm256_set1_epi8( eol );
+  __m256i lo = _mm256_loadu_si256( (const __m256i *) b );
+  __m256i hi = _mm256_loadu_si256( (const __m256i *) (b + 32) );
+  __m256i hit_lo = _mm256_or_si256( _mm256_cmpeq_epi8( lo, d ), _mm256_cmpeq_epi8( lo, e ) );
+  __m256i hit_hi = _mm256_or_si256( _mm256_cmpeq_epi8( hi, d ), _mm256_cmpeq_epi8( hi, e ) );
+  return (uint64_t) (uint32_t) _mm256_movemask_epi8( hit_lo ) | (uint64_t) (uint32_t) _mm256_movemask_epi8( hit_hi ) << 32;
+}
+#endif
+
+split_isa split_best(void){
+#ifdef SPLIT_X86
+  __builtin_cpu_init();
+  if ( __builtin_cpu_supports( "avx2" ) ) return SPLIT_AVX2;
+  if ( __builtin_cpu_supports( "sse2" ) ) return SPLIT_SSE2;
+#endif
+  return SPLIT_SCALAR;
+}
+
+const char *split_isa_name(
+						   split_isa isa       // instruction set
+						   ){
+  switch ( isa ){
+  case SPLIT_AVX2: return "avx2";
+  case SPLIT_SSE2: return "sse2";
+  default:         return "scalar";
+  }
+}
+
+// offsets of the set bits of ~m~, added to ~base~
+static inline size_t flatten( uint64_t m, uint32_t base, uint32_t *pos ){
+  size_t k = 0;
+  while ( m != 0 ) {
+	pos[k++] = base + __builtin_ctzll( m );
+	m &= m - 1;
+  }
+  return k;
+}
+
+size_t split_index(
+				   split_isa isa       // instruction set of stage 1
+				   ,const char *buf    // buffer to be indexed
+				   ,size_t n           // bytes of the buffer
+				   ,char delim         // field delimiter
+				   ,char eol           // end of record
+				   ,uint32_t *pos      // offsets of ~delim~ and ~eol~ in ~buf~, room for ~n~ of them
+				   ){
+  uint64_t (*mask)( const char *, char, char ) = mask_scalar;
+#ifdef SPLIT_X86
+  if ( isa == SPLIT_AVX2 ) mask = mask_avx2;
+  if ( isa == SPLIT_SSE2 ) mask = mask_sse2;
+#endif
+
+  size_t k = 0, i = 0;
+  for (; i + 64 <= n; i += 64) {
+	k += flatten( mask( buf + i, delim, eol ), i, pos + k );
+  }
+  if ( i < n ){
+	// last, partial block: zeroed past the end, whose bits are cleared (in case ~eol~ is '\0')
+	char last[64];
+	memset( last, 0, 64 );
+	memcpy( last, buf + i, n - i );
+	uint64_t m = mask( last, delim, eol ) & ( ( (uint64_t) 1 << (n - i) ) - 1 );
+	k += flatten( m, i, pos + k );
+  }
+  return k;
+}
+
+void split_init(
+				split_str *s        // splitter
+				,char delim         // field delimiter
+				,char eol           // end of record
+				){
+  memset( s, 0, sizeof(split_str) );
+  s->isa = split_best();
+  s->delim = delim;
+  s->eol = eol;
+}
+
+void split_load(
+				split_str *s        // splitter, reset to the first field of the buffer
+				,const char *buf    // buffer to be split (not modified)
+				,size_t n           // bytes of the buffer
+				){
+  if ( n > UINT32_MAX ){
+	fprintf( stderr, "Buffers of 4 GB or more cannot be split from within ~split_load()~ function. Aborting...\n");
+	exit( EXIT_FAILURE );
+  }
+  if ( n > s->cap_pos ){
+	s->cap_pos = n;
+	s->pos = (uint32_t *) realloc( s->pos, n * sizeof(uint32_t) );
+	if ( s->pos == NULL ){
+	  fprintf( stderr, "Could not allocate memory for ~s->pos~ pointer from within ~split_load()~ function. Aborting...\n");
+	  exit( EXIT_FAILURE );
+	}
+  }
+  s->buf = buf;
+  s->n = n;
+  s->n_pos = split_index( s->isa, buf, n, s->delim, s->eol, s->pos );
+  s->next = 0;
+  s->start = 0;
+}
+
+bool split_next(
+				split_str *s        // splitter
+				,const char **field // start of the next field
+				,size_t *len        // bytes of the field (0 for an empty field)
+				,bool *eol          // the field ends a record
+				){
+  if ( s->next < s->n_pos ){
+	uint32_t p = s->pos[ s->next++ ];
+	*field = s->buf + s->start;
+	*len = p - s->start;
+	*eol = ( s->buf[p] == s->eol );
+	s->start = p + 1;
+	return true;
+  }
+  // last record without its end: its last field runs to the end of the buffer (and is empty after a delimiter)
+  if ( s->start < s->n || ( s->start == s->n && s->n > 0 && s->buf[ s->n - 1 ] == s->delim ) ){
+	*field = s->buf + s->start;
+	*len = s->n - s->start;
+	*eol = true;
+	s->start = s->n + 1;
+	return true;
+  }
+  return false;
+}
+
+void split_free(
+				split_str *s        // splitter whose offsets are freed
+				){
+  free( s->pos );
+  s->pos = NULL;
+  s->cap_pos = 0;
+}
@@ -0,0 +1,81 @@
+// --------------------------------------------------------------------------------------------------------------------------
+// Two-stage splitter of delimited records
+//
+//  strtok_r() collapses empty fields (";;" is one delimiter to it), which is why exposure's tokenize() has to use
+//  strsep(), and both look at one byte at a time. The splitter works as simdjson does, in two stages:
+//
+//    1. split_index() compares 64 bytes at a time against the field delimiter and the end of record (AVX2 or SSE2,
+//       chosen at run time, or plain C elsewhere), turns the matches into a 64-bit mask and writes the offset of
+//       every set bit into an array of positions;
+//    2. split_next() walks the positions, handing out the fields as slices of the buffer (pointer and length, the
+//       buffer is left untouched), empty fields included, and telling which field ends a record.
+//
+//    split_str s;
+//    split_init( &s, ';', '\n' );
+//    split_load( &s, buf, n );                      // stage 1 over the whole buffer
+//    const char *field;
+//    size_t len;
+//    bool eol;
+//    while ( split_next( &s, &field, &len, &eol ) ) { ... }    // stage 2
+//    split_free( &s );
+//
+//  The end of record may also be '\0', as in the blocks of the line reader (../getline/lines.h). Offsets are 32-bit,
+//  so a buffer holds less than 4 GB.
+//
+#ifndef SPLIT_H
+#define SPLIT_H
+
+#include <stddef.h>      // size_t
+#include <stdint.h>      // uint32_t
+#include <stdbool.h>     // bool (data type)
+
+// instruction sets of stage 1
+typedef enum split_isa { SPLIT_SCALAR, SPLIT_SSE2, SPLIT_AVX2 } split_isa;
+
+typedef struct split_str
+{
+  split_isa isa;       // instruction set of stage 1 (the best one of the CPU, see split_init())
+  char delim;          // field delimiter
+  char eol;            // end of record
+  const char *buf;     // buffer being split
+  size_t n;            // bytes of the buffer
+  uint32_t *pos;       // offsets of the delimiters and ends of record in ~buf~ (stage 1)
+  size_t n_pos;        // amount of offsets in ~pos~
+  size_t cap_pos;      // size of ~pos~
+  size_t next;         // stage 2: next offset of ~pos~
+  size_t start;        // stage 2: start of the next field
+} split_str;
+
+split_isa split_best(void);               // best instruction set of the CPU running the program
+const char *split_isa_name(
+						   split_isa isa       // instruction set
+						   );
+size_t split_index(
+				   split_isa isa       // instruction set of stage 1
+				   ,const char *buf    // buffer to be indexed
+				   ,size_t n           // bytes of the buffer
+				   ,char delim         // field delimiter
+				   ,char eol           // end of record
+				   ,uint32_t *pos      // offsets of ~delim~ and ~eol~ in ~buf~, room for ~n~ of them
+				   );                  // amount of offsets written
+void split_init(
+				split_str *s        // splitter
+				,char delim         // field delimiter
+				,char eol           // end of record
+				);
+void split_load(
+				split_str *s        // splitter, reset to the first field of the buffer
+				,const char *buf    // buffer to be split (not modified)
+				,size_t n           // bytes of the buffer
+				);
+bool split_next(
+				split_str *s        // splitter
+				,const char **field // start of the next field
+				,size_t *len        // bytes of the field (0 for an empty field)
+				,bool *eol          // the field ends a record
+				);                  // false after the last field of the buffer
+void split_free(
+				split_str *s        // splitter whose offsets are freed
+				);
+
+#endif
@@ -1,46 +1,175 @@
 /* https://stackoverflow.com/a/35695762 */
 /* https://www.geeksforgeeks.org/strtok-strtok_r-functions-c-examples/ */
 
-/*   run as 
+/*   run as
 
 	 printf 'dob;policy_issue_date;policy_status_code;policy_status_date\n' > linhas.txt
-	 printf '1982-11-17;2010-01-01;1;\n' >> linhas.txt 
-	 printf '1977-06-23;2012-03-04;3;2015-09-17\n' >> linhas.txt 
+	 printf '1982-11-17;2010-01-01;1;\n' >> linhas.txt
+	 printf '1977-06-23;2012-03-04;3;2015-09-17\n' >> linhas.txt
 	 tail -n+2 linhas.txt | ./tok
+
+	 campos vazios são preservados (split.h); o laço antigo com strtok_r, que os descarta, roda com
+
+	 tail -n+2 linhas.txt | ./tok --strtok
+
+	 e a vazão (GB/s) do strtok_r e do separador em duas etapas (escalar, SSE2, AVX2) é medida com
+
+	 ./tok --bench < arquivo.csv
 */
 
 #include <stdio.h>
 #include <stdlib.h>  /* EXIT_SUCESS */
 #include <string.h>  /* strtok_r */
+#include <stdbool.h>
+#include <unistd.h>  /* read */
+#include <time.h>    /* clock_gettime */
 
-int main(void) {
+#include "lines.h"   /* leitura em blocos, de ../getline */
+#include "split.h"   /* separador de campos em duas etapas */
 
-  /* ponteiro para sequência de strings por linha */
-  char *line = NULL;
+#define BENCH_REPS 5
+
+static double now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+/* laço com strtok_r sobre uma cópia do buffer (strtok_r o altera), como o antigo tok */
+static long bench_strtok(char *buf, long *sum) {
+  char *line, *rest_line = buf;
+  char *token, *rest;
+  long n = 0;
+  while ((line = strtok_r(rest_line, "\n", &rest_line))) {
+	rest = line;
+	while ((token = strtok_r(rest, ";", &rest))) {
+	  *sum += token[0];
+	  n++;
+	}
+  }
+  return n;
+}
+
+/* etapas 1 e 2 do separador */
+static long bench_split(split_str *s, const char *buf, size_t n_buf, long *sum) {
+  const char *field;
+  size_t len;
+  bool eol;
+  long n = 0;
+  split_load(s, buf, n_buf);
+  while (split_next(s, &field, &len, &eol)) {
+	*sum += len;
+	n++;
+  }
+  return n;
+}
+
+/* lê stdin inteiro para a memória e mede a vazão de cada forma de separar os campos */
+static void bench(void) {
+  size_t n = 0, cap = 1 << 20;
+  char *buf = malloc(cap + 1);
+  ssize_t k;
+  while (buf != NULL && (k = read(0, buf + n, cap - n)) > 0) {
+	n += k;
+	if (n == cap) {
+	  cap *= 2;
+	  buf = realloc(buf, cap + 1);
+	}
+  }
+  char *work = malloc(n + 1);
+  if (buf == NULL || work == NULL || n == 0) {
+	fprintf(stderr, "Could not read stdin into memory from within ~bench()~ function. Aborting...\n");
+	exit(EXIT_FAILURE);
+  }
+  buf[n] = '\0';
+
+  printf("method;GB/s;fields\n");
+  double best = 1e30;
+  long fields = 0, sum = 0;
+  for (int r = 0; r < BENCH_REPS; r++) {
+	memcpy(work, buf, n + 1);
+	double t0 = now();
+	fields = bench_strtok(work, &sum);
+	double t = now() - t0;
+	if (t < best) best = t;
+  }
+  printf("strtok_r;%.3f;%ld\n", n / best / 1e9, fields);
+
+  split_str s;
+  split_init(&s, ';', '\n');
+  split_isa top = split_best();
+  for (split_isa isa = SPLIT_SCALAR; isa <= top; isa++) {
+	s.isa = isa;
+	/* só a etapa 1 (índice das posições) e as duas etapas (campos) */
+	double best1 = 1e30, best2 = 1e30;
+	size_t n_pos = 0;
+	for (int r = 0; r < BENCH_REPS; r++) {
+	  double t0 = now();
+	  split_load(&s, buf, n);
+	  double t = now() - t0;
+	  if (t < best1) best1 = t;
+	  n_pos = s.n_pos;
+	  t0 = now();
+	  fields = bench_split(&s, buf, n, &sum);
+	  t = now() - t0;
+	  if (t < best2) best2 = t;
+	}
+	printf("split-%s-stage1;%.3f;%zu\n", split_isa_name(isa), n / best1 / 1e9, n_pos);
+	printf("split-%s;%.3f;%ld\n", split_isa_name(isa), n / best2 / 1e9, fields);
+  }
+  fprintf(stderr, "checksum %ld\n", sum);
+
+  split_free(&s);
+  free(work);
+  free(buf);
+}
+
+int main(int argc, char **argv) {
+
+  if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+	bench();
+	return EXIT_SUCCESS;
+  }
+  bool use_strtok = (argc > 1 && strcmp(argv[1], "--strtok") == 0);
+
+  /* leitor de stdin em blocos de LINES_BLOCK bytes, com leitura antecipada */
+  line_reader *r = lines_open(0, 0, true);
+  char *line;
   size_t len = 0;
-  ssize_t read = 0;
 
   /* ponteiros para strtok_r  */
   char *token;
   char *rest;
   char *delim = ";";
 
-  while (1) {
-	read = getline(&line, &len, stdin);
-
-	if (read == -1)
-	  break;
-
-	/* parsing da linha */
-	rest=line;
-	while ((token = strtok_r(rest, delim, &rest)))
-	  printf("%s\n", token);
+  if (use_strtok) {
+	while ((line = lines_next(r, &len)) != NULL) {
+	  /* parsing da linha */
+	  rest=line;
+	  while ((token = strtok_r(rest, delim, &rest)))
+		printf("%s\n", token);
 
+	}
+  } else {
+	/* cada bloco de linhas é separado de uma vez: o '\n' de cada linha virou '\0' no bloco */
+	split_str s;
+	split_init(&s, ';', '\0');
+	char **lines;
+	size_t *lens;
+	long n;
+	const char *field;
+	size_t field_len;
+	bool eol;
+	while ((n = lines_block(r, &lines, &lens)) > 0) {
+	  split_load(&s, lines[0], lines[n - 1] - lines[0] + lens[n - 1]);
+	  while (split_next(&s, &field, &field_len, &eol))
+		printf("%.*s\n", (int) field_len, field);
+	}
+	split_free(&s);
   }
-  
-  /* libera a memória alocada para variável line */
-  free(line);
+
+  /* libera os blocos do leitor */
+  lines_close(r);
 
   return EXIT_SUCCESS;
 }
-